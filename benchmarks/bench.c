@@ -0,0 +1,281 @@
+// Copyright (c) 2025 Mateus Menezes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "bench.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/// Samples stop growing there even if still too short, e.g. for an operation the compiler removed
+#define BENCH_MAX_ITERATIONS (UINT64_C(1) << 32)
+
+uint64_t
+bench_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+bool
+bench_selected(const bench_suite_t * suite, const char * name)
+{
+    return suite->config->filter == NULL || strstr(name, suite->config->filter) != NULL;
+}
+
+static int
+compare_doubles(const void * a, const void * b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/// @return the @a percentile of the sorted @a values, interpolated between the closest two
+static double
+percentile(const double * values, size_t count, double percentile)
+{
+    double rank = percentile / 100.0 * (double)(count - 1);
+    size_t below = (size_t)rank;
+    if (below + 1 >= count) {
+        return values[count - 1];
+    }
+    return values[below] + (rank - (double)below) * (values[below + 1] - values[below]);
+}
+
+/**
+ * @brief Runs one sample of @a iterations iterations.
+ * @return its duration in ns, 0 if @a fn failed
+ */
+static uint64_t
+run_sample(bench_fn_t fn, void * arg, uint64_t iterations)
+{
+    uint64_t start = bench_now_ns();
+    if (!fn(arg, iterations)) {
+        return 0;
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    return elapsed > 0 ? elapsed : 1;
+}
+
+static void
+print_result(FILE * stream, const bench_result_t * result)
+{
+    fprintf(stream, "%-36s %10llu %12.1f %12.1f %12.1f %8.1f%%", result->name,
+        (unsigned long long)result->iterations, result->median_ns, result->mean_ns,
+        result->p95_ns, result->mean_ns > 0 ? 100.0 * result->stddev_ns / result->mean_ns : 0.0);
+    if (result->bytes > 0) {
+        fprintf(stream, " %10.1f MB/s", result->bytes / result->median_ns * 1e9 / 1e6);
+    }
+    fputc('\n', stream);
+    fflush(stream);
+}
+
+void
+bench_print_header(FILE * stream)
+{
+    fprintf(stream, "%-36s %10s %12s %12s %12s %9s\n", "benchmark", "iter/sample", "median ns",
+        "mean ns", "p95 ns", "stddev");
+}
+
+bool
+bench_run(bench_suite_t * suite, const char * name, bench_fn_t fn, void * arg,
+    double bytes_per_iteration)
+{
+    const bench_config_t * config = suite->config;
+    if (!bench_selected(suite, name)) {
+        return false;
+    }
+
+    if (suite->num_results == suite->results_capacity) {
+        size_t capacity = suite->results_capacity ? suite->results_capacity * 2 : 16;
+        bench_result_t * results = realloc(suite->results, capacity * sizeof(*results));
+        if (results == NULL) {
+            fprintf(stderr, "%s: out of memory\n", name);
+            suite->num_failed++;
+            return false;
+        }
+        suite->results = results;
+        suite->results_capacity = capacity;
+    }
+
+    unsigned repetitions = config->repetitions > 0 ? config->repetitions : 1;
+    double * samples = malloc(repetitions * sizeof(double));
+    if (samples == NULL) {
+        fprintf(stderr, "%s: out of memory\n", name);
+        suite->num_failed++;
+        return false;
+    }
+
+    // Calibration, which also warms up caches, branch predictors and lazily allocated state
+    uint64_t iterations = 1;
+    while (true) {
+        uint64_t elapsed = run_sample(fn, arg, iterations);
+        if (elapsed == 0) {
+            goto failed;
+        }
+        if (elapsed >= config->min_sample_ns || iterations >= BENCH_MAX_ITERATIONS) {
+            break;
+        }
+
+        // Aim a bit past the target from the rate measured, growing at least twofold
+        double target = (double)iterations * 1.2 * (double)config->min_sample_ns / (double)elapsed;
+        uint64_t next = target > (double)BENCH_MAX_ITERATIONS ? BENCH_MAX_ITERATIONS :
+            (uint64_t)target;
+        iterations = next > iterations * 2 ? next : iterations * 2;
+    }
+
+    for (unsigned i = 0; i < config->warmup; i++) {
+        if (run_sample(fn, arg, iterations) == 0) {
+            goto failed;
+        }
+    }
+
+    double sum = 0;
+    for (unsigned i = 0; i < repetitions; i++) {
+        uint64_t elapsed = run_sample(fn, arg, iterations);
+        if (elapsed == 0) {
+            goto failed;
+        }
+        samples[i] = (double)elapsed / (double)iterations;
+        sum += samples[i];
+    }
+    qsort(samples, repetitions, sizeof(double), compare_doubles);
+
+    bench_result_t * result = &suite->results[suite->num_results++];
+    memset(result, 0, sizeof(*result));
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->iterations = iterations;
+    result->samples = repetitions;
+    result->min_ns = samples[0];
+    result->max_ns = samples[repetitions - 1];
+    result->median_ns = percentile(samples, repetitions, 50);
+    result->p95_ns = percentile(samples, repetitions, 95);
+    result->mean_ns = sum / repetitions;
+    double squares = 0;
+    for (unsigned i = 0; i < repetitions; i++) {
+        squares += (samples[i] - result->mean_ns) * (samples[i] - result->mean_ns);
+    }
+    result->stddev_ns = repetitions > 1 ? sqrt(squares / (repetitions - 1)) : 0;
+    result->bytes = bytes_per_iteration;
+    free(samples);
+
+    print_result(stdout, result);
+    return true;
+
+failed:
+    fprintf(stderr, "%-36s FAILED\n", name);
+    free(samples);
+    suite->num_failed++;
+    return false;
+}
+
+int
+bench_silence_stdout(void)
+{
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (saved == -1 || null_fd == -1 || dup2(null_fd, STDOUT_FILENO) == -1) {
+        if (saved != -1) {
+            close(saved);
+        }
+        if (null_fd != -1) {
+            close(null_fd);
+        }
+        return -1;
+    }
+    close(null_fd);
+    return saved;
+}
+
+void
+bench_restore_stdout(int saved)
+{
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+}
+
+bool
+bench_write_json(FILE * stream, const bench_suite_t * suite)
+{
+    const bench_config_t * config = suite->config;
+    fprintf(stream, "{\n  \"config\": {\"warmup\": %u, \"repetitions\": %u, \"min_sample_ns\": %llu},\n",
+        config->warmup, config->repetitions, (unsigned long long)config->min_sample_ns);
+    fprintf(stream, "  \"benchmarks\": [\n");
+    for (size_t i = 0; i < suite->num_results; i++) {
+        const bench_result_t * result = &suite->results[i];
+        // Names are made of letters, digits, '_', '/' and '-': nothing to escape
+        fprintf(stream, "    {\"name\": \"%s\", \"iterations\": %llu, \"samples\": %u, "
+            "\"min_ns\": %.1f, \"median_ns\": %.1f, \"mean_ns\": %.1f, \"stddev_ns\": %.1f, "
+            "\"p95_ns\": %.1f, \"max_ns\": %.1f, \"bytes_per_iteration\": %.0f}%s\n",
+            result->name, (unsigned long long)result->iterations, result->samples,
+            result->min_ns, result->median_ns, result->mean_ns, result->stddev_ns,
+            result->p95_ns, result->max_ns, result->bytes,
+            i + 1 < suite->num_results ? "," : "");
+    }
+    fprintf(stream, "  ]\n}\n");
+    return fflush(stream) == 0 && !ferror(stream);
+}
+
+int
+bench_compare_baseline(const bench_suite_t * suite, const char * path, double tolerance_pct)
+{
+    FILE * baseline = fopen(path, "r");
+    if (baseline == NULL) {
+        fprintf(stderr, "Cannot open the baseline %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    int regressions = 0;
+    char * line = NULL;
+    size_t line_capacity = 0;
+    while (getline(&line, &line_capacity, baseline) != -1) {
+        char name[64];
+        const char * median = strstr(line, "\"median_ns\": ");
+        if (sscanf(line, " {\"name\": \"%63[^\"]\"", name) != 1 || median == NULL) {
+            continue;
+        }
+        double baseline_ns = strtod(median + strlen("\"median_ns\": "), NULL);
+
+        for (size_t i = 0; i < suite->num_results; i++) {
+            const bench_result_t * result = &suite->results[i];
+            if (strcmp(result->name, name) != 0 || baseline_ns <= 0) {
+                continue;
+            }
+            double change_pct = 100.0 * (result->median_ns - baseline_ns) / baseline_ns;
+            if (change_pct > tolerance_pct) {
+                printf("REGRESSION %-36s %12.1f ns -> %12.1f ns (%+.1f%%)\n", name, baseline_ns,
+                    result->median_ns, change_pct);
+                regressions++;
+            }
+        }
+    }
+
+    free(line);
+    fclose(baseline);
+    return regressions;
+}
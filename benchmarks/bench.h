@@ -0,0 +1,132 @@
+// Copyright (c) 2025 Mateus Menezes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef BENCHMARKS_BENCH_H_
+#define BENCHMARKS_BENCH_H_
+
+/**
+ * @brief Timing harness of the aesd-bench micro-benchmarks.
+ *
+ * A benchmark is a function running a given number of iterations of the operation measured.
+ * The harness first doubles that number until one call, a sample, lasts long enough for the
+ * clock resolution and the call overhead not to matter, then runs warmup samples it discards
+ * and the measured ones. Results are per iteration: the spread of the samples shows how noisy
+ * the run was, and the median is what runs are compared on.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct bench_config_s {
+    unsigned warmup;  // Samples run and discarded before measuring
+    unsigned repetitions;  // Samples measured
+    uint64_t min_sample_ns;  // Iterations per sample grow until a sample lasts this long
+    const char * filter;  // Only the benchmarks whose name holds it run. NULL runs them all
+} bench_config_t;
+
+/// Times of one benchmark, in ns per iteration
+typedef struct bench_result_s {
+    char name[64];
+    uint64_t iterations;  // Per sample
+    unsigned samples;
+    double min_ns;
+    double median_ns;
+    double mean_ns;
+    double stddev_ns;
+    double p95_ns;
+    double max_ns;
+    double bytes;  // Moved per iteration, 0 when throughput means nothing for the benchmark
+} bench_result_t;
+
+typedef struct bench_suite_s {
+    const bench_config_t * config;
+    bench_result_t * results;
+    size_t num_results;
+    size_t results_capacity;
+    size_t num_failed;
+} bench_suite_t;
+
+/**
+ * @brief Runs @a iterations iterations of the operation measured.
+ * @return false if it failed, which discards the benchmark
+ */
+typedef bool (*bench_fn_t)(void * arg, uint64_t iterations);
+
+uint64_t
+bench_now_ns(void);
+
+/**
+ * @brief Whether @a name passes the filter of the suite, so benchmarks with a costly setup can
+ * skip it.
+ */
+bool
+bench_selected(const bench_suite_t * suite, const char * name);
+
+/**
+ * @brief Measures @a fn, if selected, prints its result and adds it to @a suite.
+ *
+ * @param bytes_per_iteration Bytes moved by an iteration, for a throughput. 0 if none
+ * @return false if the benchmark failed or was not selected
+ */
+bool
+bench_run(bench_suite_t * suite, const char * name, bench_fn_t fn, void * arg,
+    double bytes_per_iteration);
+
+/// Header of the lines printed by bench_run()
+void
+bench_print_header(FILE * stream);
+
+/**
+ * @brief Sends stdout to /dev/null, for the code measured that prints as it goes.
+ * @return the descriptor to pass to bench_restore_stdout(), -1 on errors
+ */
+int
+bench_silence_stdout(void);
+void
+bench_restore_stdout(int saved);
+
+/**
+ * @brief Writes the configuration and the results of @a suite as a JSON object, with one
+ * benchmark per line so the file can be read back by bench_compare_baseline().
+ */
+bool
+bench_write_json(FILE * stream, const bench_suite_t * suite);
+
+/**
+ * @brief Compares the medians of @a suite to those of a JSON file written by a previous run.
+ *
+ * Prints every benchmark more than @a tolerance_pct percent slower than in the baseline.
+ * Benchmarks missing from either side are ignored.
+ * @return the number of such regressions, -1 if the baseline could not be read
+ */
+int
+bench_compare_baseline(const bench_suite_t * suite, const char * path, double tolerance_pct);
+
+// Benchmark groups, each adding its benchmarks to the suite
+void
+bench_server(bench_suite_t * suite);
+void
+bench_threading(bench_suite_t * suite);
+void
+bench_systemcalls(bench_suite_t * suite);
+
+#endif  // BENCHMARKS_BENCH_H_
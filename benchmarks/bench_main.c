@@ -0,0 +1,133 @@
+// Copyright (c) 2025 Mateus Menezes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+static void
+usage(const char * program)
+{
+    fprintf(stderr,
+        "Usage: %s [-w warmup] [-r repetitions] [-t min_sample_ms] [-f filter] [-o json]\n"
+        "          [-b baseline.json [-T tolerance_pct]] [-q]\n"
+        "  -w  samples discarded before measuring (default 2)\n"
+        "  -r  samples measured (default 10)\n"
+        "  -t  minimum duration of a sample, in ms (default 20)\n"
+        "  -f  only run the benchmarks whose name holds this string\n"
+        "  -o  write the results as JSON to this file, - for stdout\n"
+        "  -b  compare the medians to those of a previous JSON file, failing on regressions\n"
+        "  -T  slowdown tolerated by -b, in percent (default 10)\n"
+        "  -q  quick run checking that every benchmark works, not meant for comparisons\n",
+        program);
+}
+
+int
+main(int argc, char ** argv)
+{
+    bench_config_t config = {
+        .warmup = 2,
+        .repetitions = 10,
+        .min_sample_ns = 20 * 1000000ull,
+        .filter = NULL,
+    };
+    const char * json_path = NULL;
+    const char * baseline_path = NULL;
+    double tolerance_pct = 10;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "w:r:t:f:o:b:T:qh")) != -1) {
+        switch (opt) {
+        case 'w':
+            config.warmup = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            config.repetitions = strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            config.min_sample_ns = strtoull(optarg, NULL, 10) * 1000000ull;
+            break;
+        case 'f':
+            config.filter = optarg;
+            break;
+        case 'o':
+            json_path = optarg;
+            break;
+        case 'b':
+            baseline_path = optarg;
+            break;
+        case 'T':
+            tolerance_pct = strtod(optarg, NULL);
+            break;
+        case 'q':
+            config.warmup = 0;
+            config.repetitions = 2;
+            config.min_sample_ns = 1000000ull;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (optind != argc || config.repetitions == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // The server logs every connection: keep that out of the measurements and of the journal
+    setlogmask(LOG_UPTO(LOG_ERR));
+    // Clients hanging up mid-reply must not kill the benchmark
+    signal(SIGPIPE, SIG_IGN);
+
+    bench_suite_t suite = {
+        .config = &config,
+    };
+    printf("# %ld online CPUs, %u warmup and %u measured samples of at least %llu ms\n",
+        sysconf(_SC_NPROCESSORS_ONLN), config.warmup, config.repetitions,
+        (unsigned long long)(config.min_sample_ns / 1000000ull));
+    bench_print_header(stdout);
+
+    bench_server(&suite);
+    bench_threading(&suite);
+    bench_systemcalls(&suite);
+
+    int status = suite.num_failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    if (json_path != NULL) {
+        FILE * json = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+        if (json == NULL || !bench_write_json(json, &suite)) {
+            perror(json_path);
+            status = EXIT_FAILURE;
+        }
+        if (json != NULL && json != stdout) {
+            fclose(json);
+        }
+    }
+    if (baseline_path != NULL && bench_compare_baseline(&suite, baseline_path, tolerance_pct) != 0) {
+        status = EXIT_FAILURE;
+    }
+
+    free(suite.results);
+    return status;
+}
@@ -0,0 +1,359 @@
+// Copyright (c) 2025 Mateus Menezes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * Server benchmarks: a client thread of the same process talks to the server over loopback,
+ * as aesdsocket clients would, while the benchmark plays the part of main.c.
+ *
+ * The client only sends what each sample asks for, so no line is left over for the next
+ * benchmark, and the server is never handed more lines than the sample counts. Replies are sent
+ * while the server waits for the next line, so the end of the last reply of a sample is sent
+ * during the next one: each sample is still made of as many whole round trips.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <aeds/lz_log.h>
+#include <aeds/server.h>
+
+#include "bench.h"
+
+#define LINE_LEN 64
+/// Lines the client writes with each send
+#define LINES_PER_SEND 1024
+#define SERVER_PORT 9000
+
+enum client_mode {
+    CLIENT_STREAM_LINES,  // Sends the lines back to back. The replies are empty
+    CLIENT_REQUEST_REPLY,  // Sends a line and reads its whole reply before the next one
+    CLIENT_REQUEST_FRAMES,  // Same with compressed replies, read up to their end frame
+};
+
+struct client {
+    pthread_t thread;
+    int fd;
+    enum client_mode mode;
+    size_t reply_len;
+    sem_t go;  // Posted once the requests of a sample are set
+    uint64_t requests;
+    bool stop;
+    char lines[LINES_PER_SEND * LINE_LEN];
+};
+
+struct server_bench {
+    aesd_server_t * server;  // Created for the first benchmark selected
+    bool unavailable;  // The server could not be created
+    struct client * client;
+    int reply_fd;
+    bool batched;  // aesd_server_get_lines() instead of aesd_server_get_line()
+    char buf[AESD_SERVER_RX_BUF_SIZE];
+};
+
+static bool
+send_all(int fd, const char * data, size_t len)
+{
+    while (len > 0) {
+        ssize_t sent = send(fd, data, len, MSG_NOSIGNAL);
+        if (sent == -1 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+static bool
+recv_exactly(int fd, char * buf, size_t buf_len, size_t len)
+{
+    while (len > 0) {
+        ssize_t received = recv(fd, buf, len < buf_len ? len : buf_len, 0);
+        if (received == -1 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        len -= received;
+    }
+    return true;
+}
+
+/// Reads a framed reply, as described in aeds/lz_log.h, without decoding it
+static bool
+recv_frames(int fd, char * buf, size_t buf_len)
+{
+    uint8_t header[AESD_LZ_FRAME_HEADER_SIZE];
+    while (recv_exactly(fd, (char *)header, sizeof(header), sizeof(header)) &&
+        header[0] == AESD_LZ_FRAME_MAGIC)
+    {
+        if (header[1] == AESD_LZ_FRAME_END) {
+            return true;
+        }
+        size_t data_len = (size_t)header[8] << 24 | header[9] << 16 | header[10] << 8 | header[11];
+        if (!recv_exactly(fd, buf, buf_len, data_len)) {
+            return false;
+        }
+    }
+    return false;
+}
+
+static void *
+client_thread(void * arg)
+{
+    struct client * client = arg;
+    char reply[64 * 1024];
+
+    // Answered as soon as the server looks for the first line
+    static const char compress[] = AESD_SERVER_CTRL_PREFIX AESD_SERVER_CTRL_COMPRESS "\n";
+    if (client->mode == CLIENT_REQUEST_FRAMES &&
+        (!send_all(client->fd, compress, sizeof(compress) - 1) ||
+            !recv_frames(client->fd, reply, sizeof(reply))))
+    {
+        return NULL;
+    }
+
+    while (true) {
+        sem_wait(&client->go);
+        if (__atomic_load_n(&client->stop, __ATOMIC_ACQUIRE)) {
+            return NULL;
+        }
+
+        uint64_t requests = client->requests;
+        if (client->mode == CLIENT_STREAM_LINES) {
+            while (requests > 0) {
+                uint64_t lines = requests < LINES_PER_SEND ? requests : LINES_PER_SEND;
+                if (!send_all(client->fd, client->lines, lines * LINE_LEN)) {
+                    return NULL;
+                }
+                requests -= lines;
+            }
+            continue;
+        }
+
+        for (; requests > 0; requests--) {
+            if (!send_all(client->fd, client->lines, LINE_LEN)) {
+                return NULL;
+            }
+            bool received = client->mode == CLIENT_REQUEST_FRAMES ?
+                recv_frames(client->fd, reply, sizeof(reply)) :
+                recv_exactly(client->fd, reply, sizeof(reply), client->reply_len);
+            if (!received) {
+                return NULL;
+            }
+        }
+    }
+}
+
+static struct client *
+client_start(enum client_mode mode, size_t reply_len)
+{
+    struct client * client = calloc(1, sizeof(*client));
+    if (client == NULL) {
+        return NULL;
+    }
+    client->mode = mode;
+    client->reply_len = reply_len;
+    for (size_t i = 0; i < sizeof(client->lines); i++) {
+        client->lines[i] = i % LINE_LEN == LINE_LEN - 1 ? '\n' : 'a' + i % 26;
+    }
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(SERVER_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    client->fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (client->fd == -1) {
+        free(client);
+        return NULL;
+    }
+    // The connection is accepted by the server once it waits for lines
+    if (connect(client->fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        close(client->fd);
+        free(client);
+        return NULL;
+    }
+
+    sem_init(&client->go, 0, 0);
+    if (pthread_create(&client->thread, NULL, client_thread, client) != 0) {
+        sem_destroy(&client->go);
+        close(client->fd);
+        free(client);
+        return NULL;
+    }
+    return client;
+}
+
+static void
+client_stop(struct client * client)
+{
+    __atomic_store_n(&client->stop, true, __ATOMIC_RELEASE);
+    sem_post(&client->go);
+    // Wakes the client up if it still waits for the reply of the last request
+    shutdown(client->fd, SHUT_RDWR);
+    pthread_join(client->thread, NULL);
+    sem_destroy(&client->go);
+    close(client->fd);
+    free(client);
+}
+
+static bool
+server_bench_run(void * arg, uint64_t iterations)
+{
+    struct server_bench * bench = arg;
+    bench->client->requests = iterations;
+    sem_post(&bench->client->go);
+
+    uint64_t lines = 0;
+    while (lines < iterations) {
+        size_t size;
+        aesd_server_ret_t ret = bench->batched ?
+            aesd_server_get_lines(bench->server, bench->buf, sizeof(bench->buf), &size) :
+            aesd_server_get_line(bench->server, bench->buf, sizeof(bench->buf), &size);
+        if (ret != AESD_SERVER_RET_EOL_FOUND) {
+            return false;
+        }
+        // A batch ends with the '\n' at offset size
+        lines += bench->batched ? (size + 1) / LINE_LEN : 1;
+
+        if (aesd_server_send_file_content(bench->server, bench->reply_fd) != AESD_SERVER_RET_OK) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// @return a log of @a size bytes of syslog-like lines, already unlinked, -1 on errors
+static int
+reply_file(size_t size)
+{
+    char path[] = "/tmp/aesd-bench-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        return -1;
+    }
+    unlink(path);
+
+    char chunk[64 * 1024];
+    size_t chunk_len = 0;
+    for (unsigned line = 0; size > 0; line++) {
+        if (chunk_len + 256 > sizeof(chunk) || chunk_len >= size) {
+            size_t len = size < chunk_len ? size : chunk_len;
+            if (write(fd, chunk, len) != (ssize_t)len) {
+                close(fd);
+                return -1;
+            }
+            size -= len;
+            chunk_len = 0;
+        }
+        chunk_len += snprintf(chunk + chunk_len, sizeof(chunk) - chunk_len,
+            "Oct 19 07:%02u:%02u host aesdsocket[%u]: Accepted connection from 10.0.%u.%u, "
+            "line %u\n", line / 60 % 60, line % 60, 1000 + line / 5000, line % 7, line % 251,
+            line);
+    }
+    return fd;
+}
+
+static void
+run_with_client(bench_suite_t * suite, struct server_bench * bench, const char * name,
+    enum client_mode mode, size_t reply_len, double bytes_per_iteration)
+{
+    if (!bench_selected(suite, name) || bench->unavailable) {
+        return;
+    }
+
+    if (bench->server == NULL) {
+        bench->server = aesd_server_create();
+        if (bench->server == NULL) {
+            // Most likely an aesdsocket already listening
+            fprintf(stderr, "Skipping the server benchmarks: cannot listen on port %d\n",
+                SERVER_PORT);
+            bench->unavailable = true;
+            return;
+        }
+        aesd_server_start_accept_connections(bench->server);
+    }
+
+    bench->reply_fd = reply_file(reply_len);
+    bench->client = bench->reply_fd != -1 ? client_start(mode, reply_len) : NULL;
+    if (bench->client == NULL) {
+        fprintf(stderr, "%-36s FAILED to set up: %s\n", name, strerror(errno));
+        suite->num_failed++;
+    } else {
+        bench_run(suite, name, server_bench_run, bench, bytes_per_iteration);
+        client_stop(bench->client);
+    }
+    if (bench->reply_fd != -1) {
+        close(bench->reply_fd);
+    }
+}
+
+void
+bench_server(bench_suite_t * suite)
+{
+    static const size_t reply_sizes[] = {1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024};
+
+    struct server_bench * bench = calloc(1, sizeof(*bench));
+    if (bench == NULL) {
+        suite->num_failed++;
+        return;
+    }
+
+    // Framing alone: the replies are empty
+    bench->batched = false;
+    run_with_client(suite, bench, "server/get_line/64B", CLIENT_STREAM_LINES, 0, LINE_LEN);
+    bench->batched = true;
+    run_with_client(suite, bench, "server/get_lines/64B", CLIENT_STREAM_LINES, 0, LINE_LEN);
+
+    // Round trips of a line answered with the whole file, raw then compressed. Throughputs are
+    // in log bytes, whatever went on the wire
+    bench->batched = false;
+    for (int compressed = 0; compressed <= 1; compressed++) {
+        const char * prefix =
+            compressed ? "server/send_file_content_lz" : "server/send_file_content";
+        enum client_mode mode = compressed ? CLIENT_REQUEST_FRAMES : CLIENT_REQUEST_REPLY;
+        for (size_t i = 0; i < sizeof(reply_sizes) / sizeof(reply_sizes[0]); i++) {
+            char name[64];
+            size_t size = reply_sizes[i];
+            if (size >= 1024 * 1024) {
+                snprintf(name, sizeof(name), "%s/%zuMiB", prefix, size / (1024 * 1024));
+            } else {
+                snprintf(name, sizeof(name), "%s/%zuKiB", prefix, size / 1024);
+            }
+            run_with_client(suite, bench, name, mode, size, size);
+        }
+    }
+
+    // Accepts NULL
+    aesd_server_destroy(bench->server);
+    free(bench);
+}
@@ -0,0 +1,76 @@
+// Copyright (c) 2025 Mateus Menezes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * Process benchmarks: starting /bin/true and waiting for it, with each way systemcalls has to.
+ * The messages do_exec() prints for every command go to /dev/null while they run.
+ */
+
+#include <stdio.h>
+
+#include "systemcalls.h"
+
+#include "bench.h"
+
+static bool
+bench_do_exec(void * arg, uint64_t iterations)
+{
+    set_exec_backend(*(const enum exec_backend *)arg);
+    int saved = bench_silence_stdout();
+    if (saved == -1) {
+        return false;
+    }
+
+    bool success = true;
+    for (uint64_t i = 0; success && i < iterations; i++) {
+        success = do_exec(1, "/bin/true");
+    }
+    bench_restore_stdout(saved);
+    return success;
+}
+
+static bool
+bench_do_system(void * arg, uint64_t iterations)
+{
+    (void)arg;
+    int saved = bench_silence_stdout();
+    if (saved == -1) {
+        return false;
+    }
+
+    bool success = true;
+    for (uint64_t i = 0; success && i < iterations; i++) {
+        success = do_system("true");
+    }
+    bench_restore_stdout(saved);
+    return success;
+}
+
+void
+bench_systemcalls(bench_suite_t * suite)
+{
+    static const enum exec_backend spawn_backend = EXEC_BACKEND_SPAWN;
+    static const enum exec_backend fork_backend = EXEC_BACKEND_FORK;
+
+    bench_run(suite, "spawn/do_exec/posix_spawn", bench_do_exec, (void *)&spawn_backend, 0);
+    bench_run(suite, "spawn/do_exec/fork", bench_do_exec, (void *)&fork_backend, 0);
+    set_exec_backend(EXEC_BACKEND_SPAWN);
+    bench_run(suite, "spawn/do_system", bench_do_system, NULL, 0);
+}
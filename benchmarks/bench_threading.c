@@ -0,0 +1,115 @@
+// Copyright (c) 2025 Mateus Menezes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * Thread benchmarks: what starting one task costs with a thread of its own, as
+ * start_thread_obtaining_mutex() does, and with the thread pool.
+ */
+
+#define _GNU_SOURCE  // PTHREAD_MUTEX_ADAPTIVE_NP in locks.h
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "threading.h"
+
+#include "bench.h"
+
+static void *
+empty_thread(void * arg)
+{
+    return arg;
+}
+
+static bool
+bench_pthread_create_join(void * arg, uint64_t iterations)
+{
+    (void)arg;
+    for (uint64_t i = 0; i < iterations; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, empty_thread, NULL) != 0) {
+            return false;
+        }
+        pthread_join(thread, NULL);
+    }
+    return true;
+}
+
+static bool
+bench_start_thread_obtaining_mutex(void * arg, uint64_t iterations)
+{
+    pthread_mutex_t * mutex = arg;
+    // It prints the ID of every thread
+    int saved = bench_silence_stdout();
+    if (saved == -1) {
+        return false;
+    }
+
+    bool success = true;
+    for (uint64_t i = 0; success && i < iterations; i++) {
+        pthread_t thread;
+        if (!start_thread_obtaining_mutex(&thread, mutex, 0, 0)) {
+            success = false;
+            break;
+        }
+        struct thread_data * data;
+        pthread_join(thread, (void **)&data);
+        success = data != NULL && data->thread_complete_success;
+        free(data);
+    }
+    bench_restore_stdout(saved);
+    return success;
+}
+
+static bool
+bench_pool_task(void * arg, uint64_t iterations)
+{
+    struct thread_pool * pool = arg;
+    static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    for (uint64_t i = 0; i < iterations; i++) {
+        struct thread_future * future = thread_pool_start_obtaining_mutex(pool, &mutex, 0, 0);
+        if (future == NULL || !thread_future_release(future)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+bench_threading(bench_suite_t * suite)
+{
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+    bench_run(suite, "thread/pthread_create_join", bench_pthread_create_join, NULL, 0);
+    bench_run(suite, "thread/start_thread_obtaining_mutex", bench_start_thread_obtaining_mutex,
+        &mutex, 0);
+
+    if (!bench_selected(suite, "thread/pool_task")) {
+        return;
+    }
+    struct thread_pool * pool = thread_pool_create(0);
+    if (pool == NULL) {
+        fprintf(stderr, "%-36s FAILED to create the pool\n", "thread/pool_task");
+        suite->num_failed++;
+        return;
+    }
+    bench_run(suite, "thread/pool_task", bench_pool_task, pool, 0);
+    thread_pool_destroy(pool);
+}
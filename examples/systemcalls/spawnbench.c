@@ -0,0 +1,173 @@
+/**
+ * Spawn latency of the do_exec_redirect() backends and of do_system() as the memory of the
+ * parent grows.
+ *
+ * For every parent size, the parent first allocates and touches that much memory, then runs
+ * /bin/true through each mode and reports the latency of a complete spawn and wait:
+ *   fork    do_exec_redirect() with the fork() + execv() backend
+ *   spawn   do_exec_redirect() with the posix_spawn() backend
+ *   system  system(), which do_system() calls without a zygote
+ *   zygote  do_system() with the zygote, started before the parent grew
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "systemcalls.h"
+
+#define MAX_SIZES 16
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static bool run_fork(void)
+{
+    set_exec_backend(EXEC_BACKEND_FORK);
+    return do_exec_redirect("/dev/null", 1, "/bin/true");
+}
+
+static bool run_spawn(void)
+{
+    set_exec_backend(EXEC_BACKEND_SPAWN);
+    return do_exec_redirect("/dev/null", 1, "/bin/true");
+}
+
+static bool run_system(void)
+{
+    return system("/bin/true") == 0;
+}
+
+static bool run_zygote(void)
+{
+    return do_system("/bin/true");
+}
+
+static void measure(const char *name, bool (*run)(void), size_t rss_mb, int iterations,
+    uint64_t *samples)
+{
+    for (int i = 0; i < iterations; i++)
+    {
+        uint64_t start = now_ns();
+        if (!run())
+        {
+            fprintf(stderr, "Spawning /bin/true failed\n");
+            exit(EXIT_FAILURE);
+        }
+        samples[i] = now_ns() - start;
+    }
+
+    qsort(samples, iterations, sizeof(uint64_t), compare_u64);
+    uint64_t sum = 0;
+    for (int i = 0; i < iterations; i++)
+    {
+        sum += samples[i];
+    }
+
+    printf("%-6s %8zu %10.1f %10.1f %10.1f %10.1f\n", name, rss_mb,
+        sum / 1e3 / iterations, samples[iterations / 2] / 1e3,
+        samples[(size_t)iterations * 99 / 100] / 1e3, samples[iterations - 1] / 1e3);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    long sizes_mb[MAX_SIZES] = {0, 64, 256, 1024};
+    int num_sizes = 4;
+    int iterations = 200;
+
+    if (argc > 1 && (strcmp(argv[1], "-h") == 0 || argc > 3))
+    {
+        fprintf(stderr, "Usage: %s [parent_sizes_mb] [iterations]\n"
+            "  parent_sizes_mb: comma separated, growing (default 0,64,256,1024)\n"
+            "  iterations: spawns per backend and size (default 200)\n", argv[0]);
+        return argc == 2 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (argc > 1)
+    {
+        num_sizes = 0;
+        char *list = argv[1];
+        char *end;
+        do
+        {
+            if (num_sizes == MAX_SIZES)
+            {
+                fprintf(stderr, "At most %d sizes\n", MAX_SIZES);
+                return EXIT_FAILURE;
+            }
+            sizes_mb[num_sizes++] = strtol(list, &end, 10);
+            list = end + 1;
+        } while (*end == ',');
+    }
+    if (argc > 2)
+    {
+        iterations = atoi(argv[2]);
+    }
+    if (iterations <= 0)
+    {
+        fprintf(stderr, "Invalid number of iterations\n");
+        return EXIT_FAILURE;
+    }
+
+    uint64_t *samples = malloc(iterations * sizeof(uint64_t));
+    if (samples == NULL)
+    {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+
+    if (!zygote_start())
+    {
+        return EXIT_FAILURE;
+    }
+
+    printf("%-6s %8s %10s %10s %10s %10s\n", "mode", "rss_mb", "mean_us", "p50_us", "p99_us",
+        "max_us");
+
+    // The parent grows by the difference between consecutive sizes, and never shrinks
+    size_t allocated_mb = 0;
+    for (int s = 0; s < num_sizes; s++)
+    {
+        if (sizes_mb[s] < 0 || (size_t)sizes_mb[s] < allocated_mb)
+        {
+            fprintf(stderr, "Parent sizes must be growing\n");
+            return EXIT_FAILURE;
+        }
+
+        size_t grow = ((size_t)sizes_mb[s] - allocated_mb) << 20;
+        if (grow > 0)
+        {
+            char *ballast = malloc(grow);
+            if (ballast == NULL)
+            {
+                perror("malloc");
+                return EXIT_FAILURE;
+            }
+            // Touch every page, so they are really mapped and fork() has to copy their entries
+            memset(ballast, 1, grow);
+            allocated_mb = sizes_mb[s];
+        }
+
+        measure("fork", run_fork, allocated_mb, iterations, samples);
+        measure("spawn", run_spawn, allocated_mb, iterations, samples);
+        measure("system", run_system, allocated_mb, iterations, samples);
+        measure("zygote", run_zygote, allocated_mb, iterations, samples);
+    }
+
+    zygote_stop();
+    free(samples);
+    return EXIT_SUCCESS;
+}
@@ -1,6 +1,14 @@
+#define _GNU_SOURCE  // pipe2()
+
 #include <errno.h>
+#include <spawn.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
@@ -9,12 +17,455 @@
 
 #include "systemcalls.h"
 
+extern char **environ;
+
+static enum exec_backend exec_backend = EXEC_BACKEND_SPAWN;
+
+void set_exec_backend(enum exec_backend backend)
+{
+    exec_backend = backend;
+}
+
+/**
+ * Starts @param command[0] with the arguments in @param command, its standard output redirected
+ * to @param out_fd unless it is -1.
+ * @return the pid of the child, -1 if it could not be started. With the spawn backend this
+ *   includes a command that cannot be executed, as posix_spawn() reports exec failures.
+ */
+static pid_t start_child(char *const command[], int out_fd)
+{
+    if (exec_backend == EXEC_BACKEND_SPAWN)
+    {
+        posix_spawn_file_actions_t file_actions;
+        posix_spawn_file_actions_t *actions = NULL;
+        pid_t child_pid;
+        int ret;
+
+        if (out_fd != -1 && out_fd != STDOUT_FILENO)
+        {
+            posix_spawn_file_actions_init(&file_actions);
+            posix_spawn_file_actions_adddup2(&file_actions, out_fd, STDOUT_FILENO);
+            posix_spawn_file_actions_addclose(&file_actions, out_fd);
+            actions = &file_actions;
+        }
+
+        ret = posix_spawn(&child_pid, command[0], actions, NULL, command, environ);
+
+        if (actions != NULL)
+        {
+            posix_spawn_file_actions_destroy(actions);
+        }
+
+        if (ret != 0)
+        {
+            fprintf(stderr, "posix_spawn %s: %s\n", command[0], strerror(ret));
+            return -1;
+        }
+
+        return child_pid;
+    }
+
+    // Buffered output would otherwise be written a second time by the child
+    fflush(stdout);
+    pid_t child_pid = fork();
+
+    if (child_pid == -1)
+    {
+        perror("fork");
+        return -1;
+    }
+
+    if (child_pid == 0)
+    {
+        if (out_fd != -1 && out_fd != STDOUT_FILENO)
+        {
+            if (dup2(out_fd, STDOUT_FILENO) < 0)
+            {
+                perror("dup2");
+                _exit(EXIT_FAILURE);
+            }
+            close(out_fd);
+        }
+
+        execv(command[0], command);
+        perror("execv");
+        _exit(EXIT_FAILURE);
+    }
+
+    return child_pid;
+}
+
+/**
+ * Waits for @param child_pid.
+ * @return true if it exited with status 0.
+ */
+static bool wait_child(pid_t child_pid, bool verbose)
+{
+    int status;
+
+    while (waitpid(child_pid, &status, 0) == -1)
+    {
+        if (errno != EINTR)
+        {
+            perror("waitpid");
+            return false;
+        }
+    }
+
+    if (!WIFEXITED(status))
+    {
+        return false;
+    }
+
+    if (verbose)
+    {
+        printf("Child process %d terminated normally with status %d!\n",
+            child_pid, WEXITSTATUS(status));
+    }
+
+    if (WEXITSTATUS(status) != 0)
+    {
+        if (verbose)
+        {
+            printf("Process terminated with non-zero status: %d\n", WEXITSTATUS(status));
+        }
+        return false;
+    }
+
+    return true;
+}
+
+#define CAPTURE_INITIAL_CAPACITY 4096
+
+static bool read_all(int fd, void *buf, size_t len)
+{
+    char *data = buf;
+
+    while (len > 0)
+    {
+        ssize_t ret = read(fd, data, len);
+        if (ret == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (ret <= 0)
+        {
+            return false;
+        }
+        data += ret;
+        len -= ret;
+    }
+
+    return true;
+}
+
+static bool write_all(int fd, const void *buf, size_t len)
+{
+    const char *data = buf;
+
+    while (len > 0)
+    {
+        // A dead peer must not kill us with SIGPIPE
+        ssize_t ret = send(fd, data, len, MSG_NOSIGNAL);
+        if (ret == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (ret == -1)
+        {
+            return false;
+        }
+        data += ret;
+        len -= ret;
+    }
+
+    return true;
+}
+
+/**
+ * Runs @param cmd with /bin/sh -c, as system() does, without blocking any signal.
+ * If @param output is not NULL, the standard output of the command is captured there,
+ * NUL terminated, to free() by the caller.
+ * @return the wait status of the shell, -1 if it could not be started.
+ */
+static int run_shell(const char *cmd, char **output, size_t *output_len)
+{
+    char *const command[] = {"/bin/sh", "-c", (char *)cmd, NULL};
+    int pipe_fds[2] = {-1, -1};
+    size_t capacity = CAPTURE_INITIAL_CAPACITY;
+    int status;
+
+    if (output != NULL)
+    {
+        *output = malloc(capacity);
+        *output_len = 0;
+        if (*output == NULL || pipe2(pipe_fds, O_CLOEXEC) == -1)
+        {
+            perror("run_shell");
+            free(*output);
+            *output = NULL;
+            return -1;
+        }
+        (*output)[0] = '\0';
+    }
+
+    pid_t child_pid = start_child(command, pipe_fds[1]);
+    if (pipe_fds[1] != -1)
+    {
+        close(pipe_fds[1]);
+    }
+
+    while (child_pid != -1 && pipe_fds[0] != -1)
+    {
+        if (*output_len + 1 == capacity)
+        {
+            char *grown = realloc(*output, capacity * 2);
+            if (grown == NULL)
+            {
+                break;  // The shell gets EPIPE on its next write
+            }
+            *output = grown;
+            capacity *= 2;
+        }
+
+        ssize_t len = read(pipe_fds[0], *output + *output_len, capacity - 1 - *output_len);
+        if (len == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (len <= 0)
+        {
+            break;
+        }
+        *output_len += len;
+        (*output)[*output_len] = '\0';
+    }
+
+    if (pipe_fds[0] != -1)
+    {
+        close(pipe_fds[0]);
+    }
+
+    if (child_pid == -1)
+    {
+        return -1;
+    }
+
+    while (waitpid(child_pid, &status, 0) == -1)
+    {
+        if (errno != EINTR)
+        {
+            perror("waitpid");
+            return -1;
+        }
+    }
+
+    return status;
+}
+
+struct zygote_request
+{
+    uint32_t cmd_len;  // Followed by the command, without its NUL
+    uint32_t capture;
+};
+
+struct zygote_reply
+{
+    int32_t status;  // As returned by run_shell()
+    uint32_t reserved;
+    uint64_t output_len;  // Followed by the output if it was captured
+};
+
+static int zygote_fd = -1;
+static pid_t zygote_pid = -1;
+
+/// Main loop of the zygote: runs the commands of @param fd until the parent closes it
+static void zygote_serve(int fd)
+{
+    struct zygote_request request;
+
+    while (read_all(fd, &request, sizeof(request)))
+    {
+        char *cmd = malloc(request.cmd_len + 1);
+        if (cmd == NULL || !read_all(fd, cmd, request.cmd_len))
+        {
+            break;
+        }
+        cmd[request.cmd_len] = '\0';
+
+        char *output = NULL;
+        size_t output_len = 0;
+        struct zygote_reply reply = {0};
+
+        reply.status = run_shell(cmd, request.capture ? &output : NULL, &output_len);
+        reply.output_len = output != NULL ? output_len : 0;
+        free(cmd);
+
+        bool sent = write_all(fd, &reply, sizeof(reply)) &&
+            write_all(fd, output, reply.output_len);
+        free(output);
+        if (!sent)
+        {
+            break;
+        }
+    }
+
+    _exit(EXIT_SUCCESS);
+}
+
+bool zygote_start(void)
+{
+    int fds[2];
+
+    if (zygote_fd != -1)
+    {
+        return true;
+    }
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1)
+    {
+        perror("socketpair");
+        return false;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    if (pid == 0)
+    {
+        close(fds[0]);
+        zygote_serve(fds[1]);
+    }
+
+    close(fds[1]);
+    zygote_fd = fds[0];
+    zygote_pid = pid;
+    return true;
+}
+
+void zygote_stop(void)
+{
+    if (zygote_fd == -1)
+    {
+        return;
+    }
+
+    // EOF on its socket makes the zygote exit
+    close(zygote_fd);
+    zygote_fd = -1;
+    while (waitpid(zygote_pid, NULL, 0) == -1 && errno == EINTR)
+    {
+    }
+    zygote_pid = -1;
+}
+
+/// Reads and drops the next @param len bytes of @param fd
+static bool skip_all(int fd, uint64_t len)
+{
+    char buf[4096];
+
+    while (len > 0)
+    {
+        size_t chunk = len < sizeof(buf) ? (size_t)len : sizeof(buf);
+        if (!read_all(fd, buf, chunk))
+        {
+            return false;
+        }
+        len -= chunk;
+    }
+    return true;
+}
+
+/**
+ * Has the zygote run @param cmd. A zygote that stops answering is stopped, and later commands
+ * run from the caller.
+ * @return false if the request could not be sent to the zygote, so the caller has to run the
+ *   command itself. Once sent, the zygote may have run it already: a reply that cannot be read
+ *   then sets @param status to -1 instead, and output that cannot be stored leaves
+ *   @param output NULL.
+ */
+static bool zygote_run(const char *cmd, char **output, size_t *output_len, int *status)
+{
+    size_t cmd_len = strlen(cmd);
+    struct zygote_request request = {
+        .cmd_len = (uint32_t)cmd_len,
+        .capture = output != NULL,
+    };
+    struct zygote_reply reply;
+
+    if (zygote_fd == -1 || cmd_len > UINT32_MAX)
+    {
+        return false;
+    }
+
+    // A zygote reading a partial request gets EOF once stopped, and runs nothing
+    if (!write_all(zygote_fd, &request, sizeof(request)) ||
+        !write_all(zygote_fd, cmd, cmd_len))
+    {
+        fprintf(stderr, "zygote: not answering, running commands directly from now on\n");
+        zygote_stop();
+        return false;
+    }
+
+    if (output != NULL)
+    {
+        *output = NULL;
+        *output_len = 0;
+    }
+    *status = -1;
+
+    if (!read_all(zygote_fd, &reply, sizeof(reply)))
+    {
+        fprintf(stderr, "zygote: no reply for '%s', running commands directly from now on\n",
+            cmd);
+        zygote_stop();
+        return true;
+    }
+
+    if (output != NULL)
+    {
+        *output = malloc(reply.output_len + 1);
+        if (*output == NULL)
+        {
+            perror("malloc");
+            if (!skip_all(zygote_fd, reply.output_len))
+            {
+                zygote_stop();
+            }
+        }
+        else if (!read_all(zygote_fd, *output, reply.output_len))
+        {
+            fprintf(stderr, "zygote: output of '%s' cut short, running commands directly from "
+                "now on\n", cmd);
+            free(*output);
+            *output = NULL;
+            zygote_stop();
+        }
+        else
+        {
+            (*output)[reply.output_len] = '\0';
+            *output_len = reply.output_len;
+        }
+    }
+
+    *status = reply.status;
+    return true;
+}
+
 /**
  * @param cmd the command to execute with system()
  * @return true if the command in @param cmd was executed
  *   successfully using the system() call, false if an error occurred,
  *   either in invocation of the system() call, or if a non-zero return
  *   value was returned by the command issued in @param cmd.
+ *   The zygote runs it instead when it was started with zygote_start().
 */
 bool do_system(const char *cmd)
 {
@@ -24,11 +475,16 @@ bool do_system(const char *cmd)
         return false;
     }
 
-    int ret = system(cmd);
+    int ret;
 
-    if (ret == -1) 
+    // Failures of the zygote are reported by zygote_run() already
+    if (!zygote_run(cmd, NULL, NULL, &ret))
     {
-        perror("do_system");     
+        ret = system(cmd);
+        if (ret == -1) 
+        {
+            perror("do_system");     
+        }
     }
 
     if (ret != EXIT_SUCCESS)
@@ -39,6 +495,21 @@ bool do_system(const char *cmd)
     return true;
 }
 
+bool do_system_capture(const char *cmd, char **output, size_t *output_len, int *status)
+{
+    if (cmd == NULL)
+    {
+        return false;
+    }
+
+    if (!zygote_run(cmd, output, output_len, status))
+    {
+        *status = run_shell(cmd, output, output_len);
+    }
+
+    return *output != NULL && *status != -1;
+}
+
 /**
 * @param count -The numbers of variables passed to the function. The variables are command to execute.
 *   followed by arguments to pass to the command
@@ -68,46 +539,16 @@ bool do_exec(int count, ...)
 
     printf("\n");
     command[count] = NULL;
+    va_end(args);
 
-    int status;
-    pid_t child_pid;
-
-    child_pid = fork();
+    pid_t child_pid = start_child(command, -1);
 
     if (child_pid == -1)
     {
-        perror("do_exec");
         return false;
     }
 
-    if (child_pid == 0)
-    {
-        execv(command[0], command);        
-        perror("do_exec");
-        exit(EXIT_FAILURE);
-    }
-
-    if (waitpid(child_pid, &status, 0) == -1)
-    {
-        printf("Problem with waitpid");
-        return false;
-    }
-
-    if (WIFEXITED(status))
-    {
-        printf("Child process %d terminated normally with status %d!\n",
-            child_pid, WEXITSTATUS(status));
-        if (WEXITSTATUS(status) != 0)
-        {
-            printf("Process terminated with non-zero status: %d\n", WEXITSTATUS(status));
-            return false;
-        }
-        return true;
-    }
-
-    va_end(args);
-
-    return false;
+    return wait_child(child_pid, true);
 }
 
 /**
@@ -126,9 +567,7 @@ bool do_exec_redirect(const char *outputfile, int count, ...)
         command[i] = va_arg(args, char *);
     }
     command[count] = NULL;
-    // this line is to avoid a compile warning before your implementation is complete
-    // and may be removed
-    command[count] = command[count];
+    va_end(args);
 
     int fd = open(outputfile, O_WRONLY|O_TRUNC|O_CREAT, 0644);
     if (fd < 0)
@@ -137,47 +576,339 @@ bool do_exec_redirect(const char *outputfile, int count, ...)
         return false;
     }
 
-    int status;
-    pid_t child_pid;
-
-    child_pid = fork();
+    pid_t child_pid = start_child(command, fd);
+    close(fd);
 
     if (child_pid == -1)
     {
-        perror("do_exec");
         return false;
     }
 
-    if (child_pid == 0)
+    return wait_child(child_pid, false);
+}
+
+#define BATCH_OUTPUT_INITIAL_CAPACITY 4096
+#define BATCH_MAX_EVENTS 64
+
+/**
+ * A running job of do_exec_batch(). Its pidfd and output pipe are registered in the epoll set
+ * with the index of the slot, shifted left, and the lowest bit telling which of the two it is.
+ */
+struct batch_slot
+{
+    struct exec_job *job;
+    pid_t pid;  // -1 once the child was reaped
+    int pidfd;  // -1 once the child exited, or if pidfds are not available
+    int pipe_fd;  // Read end of the output pipe, -1 once it reached EOF or if not capturing
+    size_t capacity;
+};
+
+static int open_pidfd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/**
+ * Removes *@param fd from the epoll set before closing it. Closing alone is not enough: a child
+ * forked by another job holds a copy of it until its execv(), keeping the registration alive.
+ */
+static void batch_unwatch(int epoll_fd, int *fd)
+{
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, *fd, NULL);
+    close(*fd);
+    *fd = -1;
+}
+
+static void batch_collect(struct batch_slot *slot)
+{
+    int status;
+
+    while (waitpid(slot->pid, &status, 0) == -1)
     {
-        if (dup2(fd, STDOUT_FILENO) < 0)
+        if (errno != EINTR)
         {
-            perror("dup2");
-            exit(EXIT_FAILURE);
+            perror("waitpid");
+            slot->job->status = -1;
+            slot->pid = -1;
+            return;
         }
-        close(fd);
+    }
 
-        execv(command[0], command);
+    slot->job->status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    slot->pid = -1;
+}
+
+/// @return true if the output pipe of @param slot is done, at EOF or failed
+static bool batch_read(struct batch_slot *slot)
+{
+    struct exec_job *job = slot->job;
+
+    while (true)
+    {
+        if (job->output_len + 1 == slot->capacity)
+        {
+            char *grown = realloc(job->output, slot->capacity * 2);
+            if (grown == NULL)
+            {
+                perror("realloc");
+                return true;  // Keep what we have, the child gets EPIPE on its next write
+            }
+            job->output = grown;
+            slot->capacity *= 2;
+        }
+
+        ssize_t len = read(slot->pipe_fd, job->output + job->output_len,
+            slot->capacity - 1 - job->output_len);
+        if (len > 0)
+        {
+            job->output_len += len;
+            job->output[job->output_len] = '\0';
+            continue;
+        }
 
-        perror("do_exec");
-        exit(EXIT_FAILURE);
+        if (len == -1 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (len == -1 && errno == EAGAIN)
+        {
+            return false;
+        }
+
+        if (len == -1)
+        {
+            perror("read");
+        }
+        return true;
     }
+}
 
-    if (waitpid(child_pid, &status, 0) == -1)
+static bool batch_start(int epoll_fd, struct batch_slot *slot, size_t slot_index,
+    struct exec_job *job)
+{
+    int out_fd;
+    int pipe_fds[2] = {-1, -1};
+
+    slot->job = job;
+    slot->pidfd = -1;
+    slot->pipe_fd = -1;
+    job->output = NULL;
+    job->output_len = 0;
+    job->status = -1;
+
+    if (job->outputfile != NULL)
+    {
+        out_fd = open(job->outputfile, O_WRONLY|O_TRUNC|O_CREAT|O_CLOEXEC, 0644);
+        if (out_fd < 0)
+        {
+            perror("open");
+            return false;
+        }
+    }
+    else
+    {
+        job->output = malloc(BATCH_OUTPUT_INITIAL_CAPACITY);
+        if (job->output == NULL || pipe2(pipe_fds, O_CLOEXEC) == -1)
+        {
+            perror("do_exec_batch");
+            free(job->output);
+            job->output = NULL;
+            return false;
+        }
+        job->output[0] = '\0';
+        slot->capacity = BATCH_OUTPUT_INITIAL_CAPACITY;
+        out_fd = pipe_fds[1];
+    }
+
+    slot->pid = start_child(job->argv, out_fd);
+    close(out_fd);
+    if (slot->pid == -1)
     {
+        if (pipe_fds[0] != -1)
+        {
+            close(pipe_fds[0]);
+        }
         return false;
     }
 
-    if (WIFEXITED(status))
+    struct epoll_event event = {.events = EPOLLIN};
+
+    if (pipe_fds[0] != -1)
     {
-        if (WEXITSTATUS(status) != 0)
+        slot->pipe_fd = pipe_fds[0];
+        fcntl(slot->pipe_fd, F_SETFL, O_NONBLOCK);
+        event.data.u64 = slot_index << 1;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, slot->pipe_fd, &event) == -1)
         {
-            return false;
+            perror("epoll_ctl");
+            close(slot->pipe_fd);
+            slot->pipe_fd = -1;
+        }
+    }
+
+    // Without pidfds (before Linux 5.3) the child is reaped with a blocking waitpid() once its
+    // output reaches EOF, which is usually when it exits
+    slot->pidfd = open_pidfd(slot->pid);
+    if (slot->pidfd != -1)
+    {
+        event.data.u64 = (slot_index << 1) | 1;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, slot->pidfd, &event) == -1)
+        {
+            perror("epoll_ctl");
+            close(slot->pidfd);
+            slot->pidfd = -1;
         }
+    }
+
+    if (slot->pidfd == -1 && slot->pipe_fd == -1)
+    {
+        batch_collect(slot);
+    }
+
+    return true;
+}
+
+bool do_exec_batch(struct exec_job *jobs, size_t num_jobs, size_t max_parallel)
+{
+    if (max_parallel == 0 || max_parallel > num_jobs)
+    {
+        max_parallel = num_jobs;
+    }
+    if (num_jobs == 0)
+    {
         return true;
     }
 
-    va_end(args);
+    struct batch_slot *slots = calloc(max_parallel, sizeof(struct batch_slot));
+    size_t *free_slots = malloc(max_parallel * sizeof(size_t));
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (slots == NULL || free_slots == NULL || epoll_fd == -1)
+    {
+        perror("do_exec_batch");
+        free(slots);
+        free(free_slots);
+        if (epoll_fd != -1)
+        {
+            close(epoll_fd);
+        }
+        return false;
+    }
+
+    size_t num_free = max_parallel;
+    for (size_t i = 0; i < max_parallel; i++)
+    {
+        free_slots[i] = max_parallel - 1 - i;
+        slots[i].pid = -1;
+        slots[i].pidfd = -1;
+        slots[i].pipe_fd = -1;
+    }
+
+    size_t next_job = 0;
+    size_t running = 0;
+    bool success = true;
+
+    while (next_job < num_jobs || running > 0)
+    {
+        while (next_job < num_jobs && num_free > 0)
+        {
+            size_t slot_index = free_slots[--num_free];
+            struct batch_slot *slot = &slots[slot_index];
+
+            if (!batch_start(epoll_fd, slot, slot_index, &jobs[next_job++]))
+            {
+                success = false;
+                free_slots[num_free++] = slot_index;
+            }
+            else if (slot->pidfd == -1 && slot->pipe_fd == -1)
+            {
+                // Already reaped: nothing left to watch
+                success &= slot->job->status == 0;
+                free_slots[num_free++] = slot_index;
+            }
+            else
+            {
+                running++;
+            }
+        }
+
+        if (running == 0)
+        {
+            continue;
+        }
+
+        struct epoll_event events[BATCH_MAX_EVENTS];
+        int num_events = epoll_wait(epoll_fd, events, BATCH_MAX_EVENTS, -1);
+        if (num_events == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < num_events; i++)
+        {
+            size_t slot_index = events[i].data.u64 >> 1;
+            struct batch_slot *slot = &slots[slot_index];
+
+            if (events[i].data.u64 & 1)
+            {
+                batch_collect(slot);
+                batch_unwatch(epoll_fd, &slot->pidfd);
+            }
+            else if (batch_read(slot))
+            {
+                batch_unwatch(epoll_fd, &slot->pipe_fd);
+                if (slot->pidfd == -1 && slot->pid != -1)
+                {
+                    // No pidfd to tell us: the output is done, so the child most likely is
+                    batch_collect(slot);
+                }
+            }
+
+            // A child may exit before its output is read out, the job ends with both
+            if (slot->pidfd == -1 && slot->pipe_fd == -1)
+            {
+                success &= slot->job->status == 0;
+                free_slots[num_free++] = slot_index;
+                running--;
+            }
+        }
+    }
+
+    if (running > 0)
+    {
+        // Only after an epoll_wait() failure: reap what is left, without its output, whether
+        // a pidfd watched it or not. Closing the pipe first makes a child still writing exit
+        success = false;
+        for (size_t i = 0; i < max_parallel; i++)
+        {
+            if (slots[i].pipe_fd != -1)
+            {
+                close(slots[i].pipe_fd);
+            }
+            if (slots[i].pidfd != -1)
+            {
+                close(slots[i].pidfd);
+            }
+            if (slots[i].pid != -1)
+            {
+                batch_collect(&slots[i]);
+            }
+        }
+    }
 
-    return false;
+    close(epoll_fd);
+    free(free_slots);
+    free(slots);
+    return success;
 }
@@ -2,8 +2,72 @@
 #include <stdbool.h>
 #include <stdarg.h>
 
+/**
+ * How do_exec() and do_exec_redirect() start their child.
+ */
+enum exec_backend
+{
+    /// posix_spawn(), which glibc runs with clone(CLONE_VM | CLONE_VFORK): no page table copy,
+    /// so its cost does not grow with the memory of the parent. The default
+    EXEC_BACKEND_SPAWN,
+    /// fork() then execv()
+    EXEC_BACKEND_FORK,
+};
+
+void set_exec_backend(enum exec_backend backend);
+
 bool do_system(const char *command);
 
+/**
+ * Forks a helper process, the zygote, which runs the commands of do_system() and
+ * do_system_capture() from then on. Call it early, while the process is still small and has a
+ * single thread: every later command is then started from the zygote's small address space
+ * instead of the caller's, with posix_spawn(). Commands still run through /bin/sh -c, with the
+ * environment and working directory the caller had when the zygote was started.
+ * These functions are not thread safe.
+ * @return false if the zygote could not be started. The commands then run from the caller.
+ */
+bool zygote_start(void);
+
+/**
+ * Stops the zygote, if any. Later commands run from the caller again.
+ */
+void zygote_stop(void);
+
+/**
+ * Runs @param command like do_system(), capturing its standard output in @param output,
+ * NUL terminated, to free() by the caller. @param status receives its wait status.
+ * @return false if the command could not be run at all, or the zygote running it went away.
+ */
+bool do_system_capture(const char *command, char **output, size_t *output_len, int *status);
+
 bool do_exec(int count, ...);
 
 bool do_exec_redirect(const char *outputfile, int count, ...);
+
+/**
+ * A command of do_exec_batch().
+ */
+struct exec_job
+{
+    /// Full path of the command then its arguments, NULL terminated, as for execv()
+    char *const *argv;
+    /// Where the standard output of the command goes. The file is handed to the command
+    /// itself, so its output is never copied. NULL captures it in output instead
+    const char *outputfile;
+
+    /// Set by do_exec_batch(). The captured output, NUL terminated, to free() by the caller
+    char *output;
+    size_t output_len;
+    /// Exit status of the command, -1 if it could not be started or did not exit normally
+    int status;
+};
+
+/**
+ * Runs the commands of @param jobs, at most @param max_parallel at a time (0 for no limit),
+ * and waits for all of them. Children are watched through pidfds and their output pipes in a
+ * single epoll set, so the batch takes about as long as its slowest command when the limit
+ * allows it. Uses the backend of set_exec_backend() to start them.
+ * @return true if every command exited with status 0.
+ */
+bool do_exec_batch(struct exec_job *jobs, size_t num_jobs, size_t max_parallel);
@@ -0,0 +1,279 @@
+/**
+ * Contention benchmark of the lock types of locks.h.
+ *
+ * For every lock type, thread count and hold time, the threads acquire one shared lock in a loop
+ * for a fixed duration: measure the wait, hold the lock for the hold time, release it, then work
+ * outside of it for a while. Reports acquisitions per second, how evenly they were spread over
+ * the threads, and percentiles of the time spent waiting for the lock.
+ */
+#define _GNU_SOURCE  // PTHREAD_MUTEX_ADAPTIVE_NP in locks.h
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "histogram.h"
+#include "locks.h"
+
+#define MAX_RUN_VALUES 16
+
+struct bench {
+    struct lock lock;
+    uint64_t hold_ns;
+    uint64_t outside_ns;
+    pthread_barrier_t start_barrier;
+    int stop;
+    uint64_t shared_counter;  // Incremented without atomics under the lock, to catch broken locks
+};
+
+struct bench_thread {
+    pthread_t thread;
+    struct bench *bench;
+    struct histogram wait;
+} __attribute__((aligned(64)));
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static void busy_wait_ns(uint64_t ns)
+{
+    if (ns == 0) {
+        return;
+    }
+
+    uint64_t start = now_ns();
+    while (now_ns() - start < ns) {
+    }
+}
+
+static void * bench_thread(void *thread_param)
+{
+    struct bench_thread *self = (struct bench_thread *) thread_param;
+    struct bench *bench = self->bench;
+    struct lock_node node;
+
+    pthread_barrier_wait(&bench->start_barrier);
+
+    while (!__atomic_load_n(&bench->stop, __ATOMIC_RELAXED)) {
+        uint64_t start = now_ns();
+        lock_acquire(&bench->lock, &node);
+        uint64_t acquired = now_ns();
+
+        bench->shared_counter++;
+        busy_wait_ns(bench->hold_ns);
+        lock_release(&bench->lock, &node);
+
+        histogram_add(&self->wait, acquired - start);
+        busy_wait_ns(bench->outside_ns);
+    }
+
+    return NULL;
+}
+
+static bool run(enum lock_type type, int num_threads, uint64_t hold_ns, uint64_t outside_ns,
+    int duration_ms)
+{
+    struct bench bench = {
+        .hold_ns = hold_ns,
+        .outside_ns = outside_ns,
+    };
+    int init_ret = lock_init(&bench.lock, type);
+    if (init_ret != 0) {
+        fprintf(stderr, "Error on initializing a %s lock: %s\n", lock_type_name(type),
+            strerror(init_ret));
+        return false;
+    }
+
+    struct bench_thread *threads = aligned_alloc(64, num_threads * sizeof(struct bench_thread));
+    if (threads == NULL) {
+        perror("aligned_alloc");
+        lock_destroy(&bench.lock);
+        return false;
+    }
+    memset(threads, 0, num_threads * sizeof(struct bench_thread));
+    pthread_barrier_init(&bench.start_barrier, NULL, num_threads + 1);
+
+    int started = 0;
+    for (; started < num_threads; started++) {
+        threads[started].bench = &bench;
+        int create_ret = pthread_create(&threads[started].thread, NULL, bench_thread,
+            &threads[started]);
+        if (create_ret != 0) {
+            fprintf(stderr, "Error on starting thread %d: %s\n", started, strerror(create_ret));
+            exit(EXIT_FAILURE);  // The others are stuck on the barrier
+        }
+    }
+
+    pthread_barrier_wait(&bench.start_barrier);
+    uint64_t start = now_ns();
+    struct timespec duration = {
+        .tv_sec = duration_ms / 1000,
+        .tv_nsec = (duration_ms % 1000) * 1000000l,
+    };
+    nanosleep(&duration, NULL);
+    __atomic_store_n(&bench.stop, 1, __ATOMIC_RELAXED);
+
+    struct histogram wait;
+    histogram_init(&wait);
+    uint64_t total = 0;
+    uint64_t min_count = UINT64_MAX;
+    uint64_t max_count = 0;
+    double sum_squares = 0;
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i].thread, NULL);
+        uint64_t count = threads[i].wait.count;
+        total += count;
+        sum_squares += (double)count * count;
+        min_count = count < min_count ? count : min_count;
+        max_count = count > max_count ? count : max_count;
+        histogram_merge(&wait, &threads[i].wait);
+    }
+    double elapsed = (double)(now_ns() - start) / 1e9;
+
+    // Jain's fairness index: 1 when every thread got the same share, 1/n when one got them all
+    double fairness = sum_squares > 0 ? (double)total * total / (num_threads * sum_squares) : 0;
+    printf("%-8s %7d %8" PRIu64 " %12.0f %8.3f %8.3f %9" PRIu64 " %9" PRIu64 " %9" PRIu64
+        " %9" PRIu64 " %10" PRIu64 "%s\n",
+        lock_type_name(type), num_threads, hold_ns, total / elapsed, fairness,
+        max_count > 0 ? (double)min_count / max_count : 0,
+        histogram_percentile(&wait, 50), histogram_percentile(&wait, 90),
+        histogram_percentile(&wait, 99), histogram_percentile(&wait, 99.9), wait.max,
+        bench.shared_counter != total ? "  BROKEN: lost updates" : "");
+    fflush(stdout);
+
+    pthread_barrier_destroy(&bench.start_barrier);
+    free(threads);
+    lock_destroy(&bench.lock);
+    return bench.shared_counter == total;
+}
+
+/// Parses a comma separated list of numbers into @param values
+static int parse_list(const char *list, long *values)
+{
+    int count = 0;
+    char *end;
+
+    do {
+        if (count == MAX_RUN_VALUES) {
+            return -1;
+        }
+        values[count++] = strtol(list, &end, 10);
+        if (end == list || values[count - 1] < 0) {
+            return -1;
+        }
+        list = end + 1;
+    } while (*end == ',');
+
+    return *end == '\0' ? count : -1;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+        "Usage: %s [-l locks] [-t threads] [-H hold_ns] [-o outside_ns] [-d duration_ms]\n"
+        "  -l  comma separated lock types: pthread,adaptive,ticket,mcs,futex (default all)\n"
+        "  -t  comma separated thread counts (default 1,2,4,8)\n"
+        "  -H  comma separated times the lock is held, in ns (default 0,100,1000)\n"
+        "  -o  time spent outside of the lock between acquisitions, in ns (default 200)\n"
+        "  -d  duration of each run, in ms (default 1000)\n",
+        program);
+}
+
+int main(int argc, char **argv)
+{
+    bool use_type[LOCK_TYPE_COUNT];
+    long threads[MAX_RUN_VALUES] = {1, 2, 4, 8};
+    int num_threads = 4;
+    long holds[MAX_RUN_VALUES] = {0, 100, 1000};
+    int num_holds = 3;
+    long outside_ns = 200;
+    long duration_ms = 1000;
+
+    for (int i = 0; i < LOCK_TYPE_COUNT; i++) {
+        use_type[i] = true;
+    }
+
+    int opt;
+    while ((opt = getopt(argc, argv, "l:t:H:o:d:h")) != -1) {
+        switch (opt) {
+        case 'l': {
+            memset(use_type, 0, sizeof(use_type));
+            char *names = strdup(optarg);
+            char *save;
+            for (char *name = strtok_r(names, ",", &save); name != NULL;
+                name = strtok_r(NULL, ",", &save))
+            {
+                enum lock_type type;
+                if (!lock_type_from_name(name, &type)) {
+                    fprintf(stderr, "Unknown lock type %s\n", name);
+                    return EXIT_FAILURE;
+                }
+                use_type[type] = true;
+            }
+            free(names);
+            break;
+        }
+        case 't':
+            num_threads = parse_list(optarg, threads);
+            break;
+        case 'H':
+            num_holds = parse_list(optarg, holds);
+            break;
+        case 'o':
+            outside_ns = strtol(optarg, NULL, 10);
+            break;
+        case 'd':
+            duration_ms = strtol(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (num_threads <= 0 || num_holds <= 0 || outside_ns < 0 || duration_ms <= 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < num_threads; i++) {
+        if (threads[i] == 0) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("# %ld online CPUs, %ld ns outside of the lock, %ld ms per run, waits in ns\n",
+        sysconf(_SC_NPROCESSORS_ONLN), outside_ns, duration_ms);
+    printf("%-8s %7s %8s %12s %8s %8s %9s %9s %9s %9s %10s\n", "lock", "threads", "hold_ns",
+        "acq/s", "fairness", "min/max", "p50", "p90", "p99", "p99.9", "max");
+
+    bool all_ok = true;
+    for (int type = 0; type < LOCK_TYPE_COUNT; type++) {
+        if (!use_type[type]) {
+            continue;
+        }
+        struct lock probe;
+        int probe_ret = lock_init(&probe, (enum lock_type)type);
+        if (probe_ret == ENOTSUP) {
+            printf("# %s locks are not supported here, skipped\n", lock_type_name(type));
+            continue;
+        }
+        if (probe_ret == 0) {
+            lock_destroy(&probe);
+        }
+        for (int t = 0; t < num_threads; t++) {
+            for (int h = 0; h < num_holds; h++) {
+                all_ok &= run((enum lock_type)type, (int)threads[t], (uint64_t)holds[h],
+                    (uint64_t)outside_ns, (int)duration_ms);
+            }
+        }
+    }
+
+    return all_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,293 @@
+#ifndef LOCKS_H
+#define LOCKS_H
+
+/**
+ * Interchangeable lock implementations behind a single interface, so the same task or benchmark
+ * can run against each of them. Header only: threading.c keeps building as a single translation
+ * unit, and the benchmark gets the fast paths inlined as a real user of the lock would.
+ *
+ * Every call takes a struct lock_node owned by the caller. Only the MCS lock uses it, as the
+ * queue entry of the caller, so it must stay valid and untouched from the acquire to the release.
+ *
+ * LOCK_ADAPTIVE needs the glibc PTHREAD_MUTEX_ADAPTIVE_NP type, so includers define _GNU_SOURCE
+ * before their first include. Without it lock_init() refuses the type with ENOTSUP rather than
+ * silently handing out a default mutex.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+enum lock_type {
+    LOCK_PTHREAD,   // Default pthread mutex
+    LOCK_ADAPTIVE,  // pthread mutex spinning a little before sleeping, glibc with _GNU_SOURCE
+    LOCK_TICKET,    // FIFO spinlock
+    LOCK_MCS,       // FIFO spinlock, each waiter spinning on its own node
+    LOCK_FUTEX,     // Three state futex mutex (unlocked, locked, locked with sleepers)
+    LOCK_TYPE_COUNT,
+};
+
+struct lock_node {
+    struct lock_node *next;
+    int locked;
+};
+
+struct lock {
+    enum lock_type type;
+    union {
+        pthread_mutex_t mutex;
+        struct {
+            uint32_t next;
+            uint32_t owner;
+        } ticket;
+        struct lock_node *mcs_tail;
+        uint32_t futex;
+    };
+};
+
+/// Spins before a spinning waiter starts yielding its CPU. Keeps spinlocks usable with more
+/// threads than CPUs, where the holder may be waiting for the waiter's CPU
+#define LOCK_SPINS_BEFORE_YIELD 1024
+
+static inline void lock_cpu_relax(unsigned *spins)
+{
+    if (++*spins >= LOCK_SPINS_BEFORE_YIELD) {
+        *spins = 0;
+        sched_yield();
+        return;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
+static inline const char *lock_type_name(enum lock_type type)
+{
+    static const char *const names[LOCK_TYPE_COUNT] = {
+        [LOCK_PTHREAD] = "pthread",
+        [LOCK_ADAPTIVE] = "adaptive",
+        [LOCK_TICKET] = "ticket",
+        [LOCK_MCS] = "mcs",
+        [LOCK_FUTEX] = "futex",
+    };
+
+    return type < LOCK_TYPE_COUNT ? names[type] : "unknown";
+}
+
+/// @return true if @param name is one of the names of lock_type_name(), stored in @param type
+static inline bool lock_type_from_name(const char *name, enum lock_type *type)
+{
+    for (int i = 0; i < LOCK_TYPE_COUNT; i++) {
+        if (strcmp(name, lock_type_name((enum lock_type)i)) == 0) {
+            *type = (enum lock_type)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+* Initializes @param lock, unlocked.
+* @return 0 on success, an errno value otherwise.
+*/
+static inline int lock_init(struct lock *lock, enum lock_type type)
+{
+    memset(lock, 0, sizeof(*lock));
+    lock->type = type;
+
+    switch (type) {
+    case LOCK_PTHREAD:
+        return pthread_mutex_init(&lock->mutex, NULL);
+
+    case LOCK_ADAPTIVE: {
+#if defined(__GLIBC__) && defined(__USE_GNU)
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        int init_ret = pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ADAPTIVE_NP);
+        if (init_ret == 0) {
+            init_ret = pthread_mutex_init(&lock->mutex, &attr);
+        }
+        pthread_mutexattr_destroy(&attr);
+        return init_ret;
+#else
+        return ENOTSUP;
+#endif
+    }
+
+    case LOCK_TICKET:
+    case LOCK_MCS:
+    case LOCK_FUTEX:
+        return 0;
+
+    default:
+        return EINVAL;
+    }
+}
+
+static inline void lock_destroy(struct lock *lock)
+{
+    if (lock->type == LOCK_PTHREAD || lock->type == LOCK_ADAPTIVE) {
+        pthread_mutex_destroy(&lock->mutex);
+    }
+}
+
+static inline long lock_futex(uint32_t *word, int op, uint32_t value)
+{
+    return syscall(SYS_futex, word, op, value, NULL, NULL, 0);
+}
+
+/**
+* Blocks until @param lock is held by the caller.
+* @return 0 on success, an errno value otherwise.
+*/
+static inline int lock_acquire(struct lock *lock, struct lock_node *node)
+{
+    unsigned spins = 0;
+
+    switch (lock->type) {
+    case LOCK_PTHREAD:
+    case LOCK_ADAPTIVE:
+        return pthread_mutex_lock(&lock->mutex);
+
+    case LOCK_TICKET: {
+        uint32_t ticket = __atomic_fetch_add(&lock->ticket.next, 1, __ATOMIC_RELAXED);
+        while (__atomic_load_n(&lock->ticket.owner, __ATOMIC_ACQUIRE) != ticket) {
+            lock_cpu_relax(&spins);
+        }
+        return 0;
+    }
+
+    case LOCK_MCS: {
+        node->next = NULL;
+        node->locked = 1;
+        struct lock_node *prev = __atomic_exchange_n(&lock->mcs_tail, node, __ATOMIC_ACQ_REL);
+        if (prev == NULL) {
+            return 0;
+        }
+
+        __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+        while (__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE)) {
+            lock_cpu_relax(&spins);
+        }
+        return 0;
+    }
+
+    case LOCK_FUTEX: {
+        uint32_t state = 0;
+        if (__atomic_compare_exchange_n(&lock->futex, &state, 1, false, __ATOMIC_ACQUIRE,
+            __ATOMIC_RELAXED))
+        {
+            return 0;
+        }
+
+        // Contended: mark the lock as having sleepers, so the release knows to wake one
+        if (state != 2) {
+            state = __atomic_exchange_n(&lock->futex, 2, __ATOMIC_ACQUIRE);
+        }
+        while (state != 0) {
+            lock_futex(&lock->futex, FUTEX_WAIT_PRIVATE, 2);
+            state = __atomic_exchange_n(&lock->futex, 2, __ATOMIC_ACQUIRE);
+        }
+        return 0;
+    }
+
+    default:
+        return EINVAL;
+    }
+}
+
+/**
+* Takes @param lock if it is free, without blocking.
+* @return 0 if the caller now holds it, EBUSY if it is held, another errno value on errors.
+*/
+static inline int lock_try_acquire(struct lock *lock, struct lock_node *node)
+{
+    switch (lock->type) {
+    case LOCK_PTHREAD:
+    case LOCK_ADAPTIVE:
+        return pthread_mutex_trylock(&lock->mutex);
+
+    case LOCK_TICKET: {
+        uint32_t owner = __atomic_load_n(&lock->ticket.owner, __ATOMIC_RELAXED);
+        uint32_t ticket = owner;
+        return __atomic_compare_exchange_n(&lock->ticket.next, &ticket, owner + 1, false,
+            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) ? 0 : EBUSY;
+    }
+
+    case LOCK_MCS: {
+        node->next = NULL;
+        node->locked = 0;
+        struct lock_node *tail = NULL;
+        return __atomic_compare_exchange_n(&lock->mcs_tail, &tail, node, false,
+            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) ? 0 : EBUSY;
+    }
+
+    case LOCK_FUTEX: {
+        uint32_t state = 0;
+        return __atomic_compare_exchange_n(&lock->futex, &state, 1, false,
+            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) ? 0 : EBUSY;
+    }
+
+    default:
+        return EINVAL;
+    }
+}
+
+/**
+* Releases @param lock, acquired with the same @param node.
+* @return 0 on success, an errno value otherwise.
+*/
+static inline int lock_release(struct lock *lock, struct lock_node *node)
+{
+    unsigned spins = 0;
+
+    switch (lock->type) {
+    case LOCK_PTHREAD:
+    case LOCK_ADAPTIVE:
+        return pthread_mutex_unlock(&lock->mutex);
+
+    case LOCK_TICKET:
+        // Only the holder writes owner
+        __atomic_store_n(&lock->ticket.owner, lock->ticket.owner + 1, __ATOMIC_RELEASE);
+        return 0;
+
+    case LOCK_MCS: {
+        struct lock_node *next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+        if (next == NULL) {
+            struct lock_node *tail = node;
+            if (__atomic_compare_exchange_n(&lock->mcs_tail, &tail, NULL, false,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            {
+                return 0;
+            }
+
+            // A waiter swapped the tail but did not link itself behind us yet
+            while ((next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)) == NULL) {
+                lock_cpu_relax(&spins);
+            }
+        }
+        __atomic_store_n(&next->locked, 0, __ATOMIC_RELEASE);
+        return 0;
+    }
+
+    case LOCK_FUTEX:
+        if (__atomic_exchange_n(&lock->futex, 0, __ATOMIC_RELEASE) == 2) {
+            lock_futex(&lock->futex, FUTEX_WAKE_PRIVATE, 1);
+        }
+        return 0;
+
+    default:
+        return EINVAL;
+    }
+}
+
+#endif /* LOCKS_H */
@@ -1,8 +1,12 @@
+#define _GNU_SOURCE  // PTHREAD_MUTEX_ADAPTIVE_NP in locks.h
 #include "threading.h"
 
 #include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 // Optional: use these functions to add debug or error prints to your application
@@ -10,59 +14,291 @@
 //#define DEBUG_LOG(msg,...) printf("threading: " msg "\n" , ##__VA_ARGS__)
 #define ERROR_LOG(msg,...) printf("threading ERROR: " msg "\n" , ##__VA_ARGS__)
 
-void * threadfunc(void* thread_param)
+/// usleep(0) still costs a syscall and the timer slack, so zero waits are skipped
+static void sleep_ms(int ms)
 {
+    if (ms > 0) {
+        usleep(ms * 1000);
+    }
+}
 
-    // TODO: wait, obtain mutex, wait, release mutex as described by thread_data structure
-    // hint: use a cast like the one below to obtain thread arguments from your parameter
-    //struct thread_data* thread_func_args = (struct thread_data *) thread_param;
-    struct thread_data* args = (struct thread_data *) thread_param;
+static uint64_t monotonic_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+/// The task takes data->lock when set, data->mutex otherwise
+static int data_lock(struct thread_data *data)
+{
+    if (data->lock != NULL) {
+        return lock_acquire(data->lock, &data->lock_node);
+    }
+    return pthread_mutex_lock(data->mutex);
+}
+
+static int data_trylock(struct thread_data *data)
+{
+    if (data->lock != NULL) {
+        return lock_try_acquire(data->lock, &data->lock_node);
+    }
+    return pthread_mutex_trylock(data->mutex);
+}
+
+static int data_unlock(struct thread_data *data)
+{
+    if (data->lock != NULL) {
+        return lock_release(data->lock, &data->lock_node);
+    }
+    return pthread_mutex_unlock(data->mutex);
+}
+
+/// Identifies the lock of @param data, whichever kind it is
+static const void *data_lock_key(const struct thread_data *data)
+{
+    return data->lock != NULL ? (const void *)data->lock : (const void *)data->mutex;
+}
+
+/// Buckets of the table of profiled locks. A power of two
+#define PROFILE_TABLE_BUCKETS 256
+/// Locks a pool worker accumulates samples for before merging them. A power of two
+#define LOCAL_PROFILE_SLOTS 32
+/// Longest a busy pool worker keeps its samples to itself
+#define PROFILE_FLUSH_INTERVAL_NS (100 * 1000000ull)
+
+struct lock_profile_entry {
+    const void *lock;  // data_lock_key() of the tasks, NULL for a free local slot
+    struct histogram wait;
+    struct histogram hold;
+    struct lock_profile_entry *next;  // In its bucket
+};
+
+/**
+ * Samples of a pool worker not merged yet. Tasks of dedicated threads take a single sample, so
+ * they merge it right away instead.
+ */
+struct local_profile {
+    struct lock_profile_entry slots[LOCAL_PROFILE_SLOTS];
+    size_t num_samples;
+};
+
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct lock_profile_entry *profile_table[PROFILE_TABLE_BUCKETS];
+static __thread struct local_profile *local_profile;
+
+static size_t lock_hash(const void *lock, size_t num_buckets)
+{
+    uintptr_t hash = (uintptr_t)lock * 0x9e3779b97f4a7c15ull;
+    return (hash >> 32) & (num_buckets - 1);
+}
+
+/// @return the global entry of @param lock, created if needed. Needs profile_lock
+static struct lock_profile_entry *profile_entry(const void *lock)
+{
+    struct lock_profile_entry **bucket = &profile_table[lock_hash(lock, PROFILE_TABLE_BUCKETS)];
+    struct lock_profile_entry *entry = *bucket;
+    while (entry != NULL && entry->lock != lock) {
+        entry = entry->next;
+    }
+
+    if (entry == NULL) {
+        entry = malloc(sizeof(struct lock_profile_entry));
+        if (entry == NULL) {
+            return NULL;  // The samples are lost, the task is not
+        }
+        entry->lock = lock;
+        histogram_init(&entry->wait);
+        histogram_init(&entry->hold);
+        entry->next = *bucket;
+        *bucket = entry;
+    }
+
+    return entry;
+}
+
+static void profile_flush_local(void)
+{
+    if (local_profile == NULL || local_profile->num_samples == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&profile_lock);
+    for (size_t i = 0; i < LOCAL_PROFILE_SLOTS; i++) {
+        struct lock_profile_entry *slot = &local_profile->slots[i];
+        if (slot->lock == NULL) {
+            continue;
+        }
+
+        struct lock_profile_entry *entry = profile_entry(slot->lock);
+        if (entry != NULL) {
+            histogram_merge(&entry->wait, &slot->wait);
+            histogram_merge(&entry->hold, &slot->hold);
+        }
+        slot->lock = NULL;
+    }
+    pthread_mutex_unlock(&profile_lock);
+
+    local_profile->num_samples = 0;
+}
+
+static void profile_add(const void *lock, uint64_t wait_ns, uint64_t hold_ns)
+{
+    pthread_mutex_lock(&profile_lock);
+    struct lock_profile_entry *entry = profile_entry(lock);
+    if (entry != NULL) {
+        histogram_add(&entry->wait, wait_ns);
+        histogram_add(&entry->hold, hold_ns);
+    }
+    pthread_mutex_unlock(&profile_lock);
+}
+
+/// Records the wait and hold times of @param data, which just released its lock
+static void profile_record(const struct thread_data *data)
+{
+    const void *lock = data_lock_key(data);
+    uint64_t wait_ns = data->lock_acquired_ns - data->lock_requested_ns;
+    uint64_t hold_ns = data->lock_released_ns - data->lock_acquired_ns;
+
+    if (local_profile == NULL) {
+        profile_add(lock, wait_ns, hold_ns);
+        return;
+    }
+
+    struct lock_profile_entry *slot = &local_profile->slots[lock_hash(lock, LOCAL_PROFILE_SLOTS)];
+    if (slot->lock != lock && slot->lock != NULL) {
+        // Taken by another lock until the next merge. Merging it now would cost more than this
+        profile_add(lock, wait_ns, hold_ns);
+        return;
+    }
+
+    if (slot->lock == NULL) {
+        slot->lock = lock;
+        histogram_init(&slot->wait);
+        histogram_init(&slot->hold);
+    }
+    histogram_add(&slot->wait, wait_ns);
+    histogram_add(&slot->hold, hold_ns);
+    local_profile->num_samples++;
+}
+
+bool lock_profile_get(const void *lock, struct histogram *wait, struct histogram *hold)
+{
+    pthread_mutex_lock(&profile_lock);
+    struct lock_profile_entry *entry = profile_table[lock_hash(lock, PROFILE_TABLE_BUCKETS)];
+    while (entry != NULL && entry->lock != lock) {
+        entry = entry->next;
+    }
+    if (entry != NULL) {
+        *wait = entry->wait;
+        *hold = entry->hold;
+    }
+    pthread_mutex_unlock(&profile_lock);
+
+    return entry != NULL;
+}
+
+void lock_profile_for_each(lock_profile_callback_t callback, void *arg)
+{
+    pthread_mutex_lock(&profile_lock);
+    for (size_t i = 0; i < PROFILE_TABLE_BUCKETS; i++) {
+        for (struct lock_profile_entry *entry = profile_table[i]; entry != NULL;
+            entry = entry->next)
+        {
+            callback(entry->lock, &entry->wait, &entry->hold, arg);
+        }
+    }
+    pthread_mutex_unlock(&profile_lock);
+}
+
+void lock_profile_reset(void)
+{
+    pthread_mutex_lock(&profile_lock);
+    for (size_t i = 0; i < PROFILE_TABLE_BUCKETS; i++) {
+        while (profile_table[i] != NULL) {
+            struct lock_profile_entry *entry = profile_table[i];
+            profile_table[i] = entry->next;
+            free(entry);
+        }
+    }
+    pthread_mutex_unlock(&profile_lock);
+}
 
-    usleep(args->wait_to_obtain_mutex_in_ms * 1000);
+/**
+ * Task shared by the threads of start_thread_obtaining_mutex() and the workers of a thread_pool:
+ * wait, obtain the mutex, hold it, release it, as described by @param args.
+ * Sets and returns thread_complete_success.
+ */
+static bool obtain_and_release_mutex(struct thread_data *args)
+{
+    sleep_ms(args->wait_to_obtain_mutex_in_ms);
 
-    int pthread_mutex_lock_ret = pthread_mutex_lock(args->mutex);
+    args->lock_requested_ns = monotonic_ns();
+    int pthread_mutex_lock_ret = data_lock(args);
     if (pthread_mutex_lock_ret != 0) {
         printf("pthread_mutex_lock failed with %d\n", pthread_mutex_lock_ret);
         args->thread_complete_success = false;
-        pthread_exit((void *)args);
+        return false;
     }
 
-    usleep(args->wait_to_release_mutex_in_ms * 1000);
+    args->lock_acquired_ns = monotonic_ns();
+
+    sleep_ms(args->wait_to_release_mutex_in_ms);
 
-    int pthread_mutex_unlock_ret = pthread_mutex_unlock(args->mutex);
+    int pthread_mutex_unlock_ret = data_unlock(args);
     if (pthread_mutex_unlock_ret != 0) {
-        printf("pthread_mutex_lock failed with %d\n", pthread_mutex_unlock_ret);
+        printf("pthread_mutex_unlock failed with %d\n", pthread_mutex_unlock_ret);
         args->thread_complete_success = false;
-        pthread_exit((void *)args);
+        return false;
     }
+    args->lock_released_ns = monotonic_ns();
+    profile_record(args);
+
+    sleep_ms(args->wait_to_release_mutex_in_ms);
 
-    usleep(args->wait_to_release_mutex_in_ms * 1000);
-    
     args->thread_complete_success = true;
+    return true;
+}
+
+void * threadfunc(void* thread_param)
+{
+    struct thread_data* args = (struct thread_data *) thread_param;
+
+    obtain_and_release_mutex(args);
 
     return (void *)args;
 }
 
-bool start_thread_obtaining_mutex(pthread_t *thread, pthread_mutex_t *mutex,int wait_to_obtain_ms, int wait_to_release_ms)
+static void init_thread_data(struct thread_data *data, pthread_mutex_t *mutex, struct lock *lock,
+    int wait_to_obtain_ms, int wait_to_release_ms)
 {
-    /**
-     * TODO: allocate memory for thread_data, setup mutex and wait arguments, pass thread_data to created thread
-     * using threadfunc() as entry point.
-     *
-     * return true if successful.
-     *
-     * See implementation details in threading.h file comment block
-     */
-    struct thread_data * data = (struct thread_data *)malloc(sizeof(struct thread_data));
     data->wait_to_obtain_mutex_in_ms = wait_to_obtain_ms;
     data->wait_to_release_mutex_in_ms = wait_to_release_ms;
-
     data->mutex = mutex;
+    data->lock = lock;
+    data->lock_requested_ns = 0;
+    data->lock_acquired_ns = 0;
+    data->lock_released_ns = 0;
+    data->thread_complete_success = false;
+}
+
+static bool start_thread(pthread_t *thread, pthread_mutex_t *mutex, struct lock *lock,
+    int wait_to_obtain_ms, int wait_to_release_ms)
+{
+    // The caller joins @param thread and frees the thread_data it returns, so this entry point
+    // keeps a dedicated thread. Use thread_pool_start_obtaining_mutex() to avoid that cost
+    struct thread_data * data = (struct thread_data *)malloc(sizeof(struct thread_data));
+    if (data == NULL) {
+        ERROR_LOG("malloc: %s", strerror(errno));
+        return false;
+    }
+    init_thread_data(data, mutex, lock, wait_to_obtain_ms, wait_to_release_ms);
 
     int pthread_create_ret = pthread_create(thread, NULL, threadfunc, (void *) data);
     if (pthread_create_ret != 0) {
         errno = pthread_create_ret;
         perror("pthread_create");
+        free(data);
         return false;
     }
 
@@ -70,3 +306,664 @@ bool start_thread_obtaining_mutex(pthread_t *thread, pthread_mutex_t *mutex,int
 
     return true;
 }
+
+bool start_thread_obtaining_mutex(pthread_t *thread, pthread_mutex_t *mutex,int wait_to_obtain_ms, int wait_to_release_ms)
+{
+    return start_thread(thread, mutex, NULL, wait_to_obtain_ms, wait_to_release_ms);
+}
+
+bool start_thread_obtaining_lock(pthread_t *thread, struct lock *lock, int wait_to_obtain_ms,
+    int wait_to_release_ms)
+{
+    return start_thread(thread, NULL, lock, wait_to_obtain_ms, wait_to_release_ms);
+}
+
+/// Polling delays of the first task waiting for a mutex held by a thread outside the pool.
+/// Holders inside the pool hand the mutex over as soon as they release it
+#define RETRY_MIN_NS (50 * 1000)
+#define RETRY_MAX_NS (1000 * 1000)
+/// Buckets of the table of contended mutexes. A power of two
+#define WAIT_TABLE_BUCKETS 1024
+#define NOT_IN_HEAP SIZE_MAX
+
+enum task_state {
+    TASK_NEW,
+    TASK_WAIT_TO_OBTAIN,
+    TASK_BLOCKED,  // Queued behind other tasks for a busy mutex
+    TASK_HOLDING,
+    TASK_WAIT_AFTER_RELEASE,
+};
+
+struct thread_future {
+    struct thread_data data;
+    struct thread_pool *pool;
+    struct pool_worker *worker;  // Runs every step of the task
+    bool done;
+    bool retrying;  // First of its queue and retrying the mutex. Protected by wait_lock
+    bool retry_again;  // The mutex was released during that retry. Protected by wait_lock
+    enum task_state state;
+    uint64_t deadline_ns;
+    uint64_t retry_ns;
+    size_t heap_index;  // Position in the timer heap of its worker, NOT_IN_HEAP if none
+    struct thread_future *next;  // Inbox of its worker, or free list
+    struct thread_future *wait_next;  // Queue of the mutex it is blocked on
+};
+
+/// Tasks queued for one busy mutex or lock, oldest first. Exists while the queue is not empty
+struct mutex_waiters {
+    const void *lock;  // data_lock_key() of the tasks
+    struct thread_future *head;
+    struct thread_future *tail;
+    struct mutex_waiters *next;  // In its bucket
+};
+
+/**
+ * A worker runs the tasks assigned to it from start to end, so the thread that locks a mutex is
+ * always the one that unlocks it, as pthread mutexes require. All the waits are deadlines in the
+ * timer heap of the worker: no thread sleeps on behalf of a single task.
+ */
+struct pool_worker {
+    struct thread_pool *pool;
+    pthread_t thread;
+    pthread_mutex_t lock;  // Protects inbox and stopping
+    pthread_cond_t wake_cond;
+    struct thread_future *inbox_head;  // New tasks, and blocked tasks to retry their mutex
+    struct thread_future *inbox_tail;
+    bool stopping;
+
+    // Owned by the worker thread
+    struct thread_future **heap;
+    size_t heap_len;
+    size_t heap_cap;
+    size_t num_blocked;
+};
+
+struct thread_pool {
+    pthread_mutex_t lock;  // Protects the free list and the done flag of the futures
+    pthread_cond_t done_cond;
+    size_t num_waiters;  // Threads in thread_future_wait(). Completions only signal if any
+    struct thread_future *free_list;
+    size_t next_worker;
+    pthread_mutex_t wait_lock;  // Protects wait_table and the queues in it
+    struct mutex_waiters *wait_table[WAIT_TABLE_BUCKETS];
+    size_t num_workers;
+    struct pool_worker workers[];
+};
+
+static void heap_set(struct pool_worker *worker, size_t index, struct thread_future *task)
+{
+    worker->heap[index] = task;
+    task->heap_index = index;
+}
+
+static void heap_sift_up(struct pool_worker *worker, size_t index)
+{
+    struct thread_future *task = worker->heap[index];
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (worker->heap[parent]->deadline_ns <= task->deadline_ns) {
+            break;
+        }
+        heap_set(worker, index, worker->heap[parent]);
+        index = parent;
+    }
+    heap_set(worker, index, task);
+}
+
+static void heap_sift_down(struct pool_worker *worker, size_t index)
+{
+    struct thread_future *task = worker->heap[index];
+    while (true) {
+        size_t child = 2 * index + 1;
+        if (child >= worker->heap_len) {
+            break;
+        }
+        if (child + 1 < worker->heap_len &&
+            worker->heap[child + 1]->deadline_ns < worker->heap[child]->deadline_ns) {
+            child++;
+        }
+        if (task->deadline_ns <= worker->heap[child]->deadline_ns) {
+            break;
+        }
+        heap_set(worker, index, worker->heap[child]);
+        index = child;
+    }
+    heap_set(worker, index, task);
+}
+
+static bool heap_push(struct pool_worker *worker, struct thread_future *task, uint64_t deadline_ns)
+{
+    if (worker->heap_len == worker->heap_cap) {
+        size_t new_cap = worker->heap_cap ? worker->heap_cap * 2 : 64;
+        struct thread_future **new_heap = realloc(worker->heap, new_cap * sizeof(*new_heap));
+        if (new_heap == NULL) {
+            return false;
+        }
+        worker->heap = new_heap;
+        worker->heap_cap = new_cap;
+    }
+
+    task->deadline_ns = deadline_ns;
+    worker->heap[worker->heap_len] = task;
+    heap_sift_up(worker, worker->heap_len++);
+    return true;
+}
+
+static void heap_remove(struct pool_worker *worker, struct thread_future *task)
+{
+    size_t index = task->heap_index;
+    struct thread_future *last = worker->heap[--worker->heap_len];
+    task->heap_index = NOT_IN_HEAP;
+    if (index == worker->heap_len) {
+        return;
+    }
+
+    heap_set(worker, index, last);
+    heap_sift_up(worker, index);
+    heap_sift_down(worker, last->heap_index);
+}
+
+static struct mutex_waiters **wait_bucket(struct thread_pool *pool, const void *lock)
+{
+    uintptr_t hash = (uintptr_t)lock * 0x9e3779b97f4a7c15ull;
+    return &pool->wait_table[(hash >> 32) & (WAIT_TABLE_BUCKETS - 1)];
+}
+
+static struct mutex_waiters *wait_find(struct thread_pool *pool, const void *lock)
+{
+    struct mutex_waiters *waiters = *wait_bucket(pool, lock);
+    while (waiters != NULL && waiters->lock != lock) {
+        waiters = waiters->next;
+    }
+
+    return waiters;
+}
+
+static void task_complete(struct thread_future *task, bool success)
+{
+    struct thread_pool *pool = task->pool;
+
+    task->data.thread_complete_success = success;
+
+    pthread_mutex_lock(&pool->lock);
+    task->done = true;
+    if (pool->num_waiters > 0) {
+        pthread_cond_broadcast(&pool->done_cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void worker_post(struct pool_worker *worker, struct thread_future *task)
+{
+    task->next = NULL;
+
+    pthread_mutex_lock(&worker->lock);
+    if (worker->inbox_tail != NULL) {
+        worker->inbox_tail->next = task;
+    } else {
+        worker->inbox_head = task;
+        // A worker only needs waking for the first message of a batch
+        pthread_cond_signal(&worker->wake_cond);
+    }
+    worker->inbox_tail = task;
+    pthread_mutex_unlock(&worker->lock);
+}
+
+/**
+ * Sends the oldest task blocked on @param lock, just released, back to its worker to retry.
+ * If that task is already retrying, it is told to try once more instead
+ */
+static void wake_waiter(struct thread_pool *pool, const void *lock)
+{
+    pthread_mutex_lock(&pool->wait_lock);
+    struct mutex_waiters *waiters = wait_find(pool, lock);
+    struct thread_future *head = waiters != NULL ? waiters->head : NULL;
+    if (head != NULL && head->retrying) {
+        head->retry_again = true;
+        head = NULL;
+    } else if (head != NULL) {
+        head->retrying = true;
+    }
+    pthread_mutex_unlock(&pool->wait_lock);
+
+    if (head != NULL) {
+        worker_post(head->worker, head);
+    }
+}
+
+/**
+ * Queues @param task behind the other tasks blocked on its mutex.
+ * @return true if it is the first of the queue, which must poll in case the holder is not a task
+ */
+static bool wait_enqueue(struct thread_pool *pool, struct thread_future *task)
+{
+    pthread_mutex_lock(&pool->wait_lock);
+    const void *lock = data_lock_key(&task->data);
+    struct mutex_waiters *waiters = wait_find(pool, lock);
+    if (waiters == NULL) {
+        waiters = calloc(1, sizeof(struct mutex_waiters));
+        if (waiters == NULL) {
+            pthread_mutex_unlock(&pool->wait_lock);
+            return true;  // Not queued. Polling alone still gets the mutex eventually
+        }
+        struct mutex_waiters **bucket = wait_bucket(pool, lock);
+        waiters->lock = lock;
+        waiters->next = *bucket;
+        *bucket = waiters;
+    }
+
+    task->wait_next = NULL;
+    if (waiters->tail != NULL) {
+        waiters->tail->wait_next = task;
+    } else {
+        waiters->head = task;
+    }
+    waiters->tail = task;
+    bool first = waiters->head == task;
+    pthread_mutex_unlock(&pool->wait_lock);
+
+    return first;
+}
+
+/// Removes @param task, which stopped waiting, from the front of the queue. Needs wait_lock
+static void wait_dequeue(struct thread_pool *pool, struct thread_future *task)
+{
+    const void *lock = data_lock_key(&task->data);
+    struct mutex_waiters **link = wait_bucket(pool, lock);
+    while (*link != NULL && (*link)->lock != lock) {
+        link = &(*link)->next;
+    }
+
+    struct mutex_waiters *waiters = *link;
+    if (waiters != NULL && waiters->head == task) {
+        waiters->head = task->wait_next;
+        if (waiters->head == NULL) {
+            *link = waiters->next;
+            free(waiters);
+        }
+    }
+}
+
+static uint64_t ms_to_ns(int ms)
+{
+    return ms > 0 ? (uint64_t)ms * 1000000ull : 0;
+}
+
+/// Arms the next deadline of @param task, or fails it when the heap cannot grow
+static void task_wait(struct pool_worker *worker, struct thread_future *task,
+    enum task_state state, uint64_t deadline_ns)
+{
+    task->state = state;
+    if (!heap_push(worker, task, deadline_ns)) {
+        ERROR_LOG("Out of memory for the timer of a task");
+        if (state == TASK_HOLDING) {
+            data_unlock(&task->data);
+            wake_waiter(task->pool, data_lock_key(&task->data));
+        }
+        task_complete(task, false);
+    }
+}
+
+static void task_obtained(struct pool_worker *worker, struct thread_future *task, int trylock_ret,
+    uint64_t now_ns)
+{
+    if (trylock_ret != 0) {
+        printf("pthread_mutex_trylock failed with %d\n", trylock_ret);
+        task_complete(task, false);
+        return;
+    }
+
+    task->data.lock_acquired_ns = monotonic_ns();
+    task_wait(worker, task, TASK_HOLDING,
+        now_ns + ms_to_ns(task->data.wait_to_release_mutex_in_ms));
+}
+
+static void task_try_obtain(struct pool_worker *worker, struct thread_future *task, uint64_t now_ns)
+{
+    task->data.lock_requested_ns = monotonic_ns();
+    int trylock_ret = data_trylock(&task->data);
+    if (trylock_ret != EBUSY) {
+        task_obtained(worker, task, trylock_ret, now_ns);
+        return;
+    }
+
+    task->state = TASK_BLOCKED;
+    task->retry_ns = RETRY_MIN_NS;
+    task->retrying = false;
+    task->retry_again = false;
+    worker->num_blocked++;
+    if (wait_enqueue(task->pool, task)) {
+        task_wait(worker, task, TASK_BLOCKED, now_ns + task->retry_ns);
+    }
+}
+
+/**
+ * Tries the mutex again for @param task, the first of its queue. Either its polling timer
+ * expired, or @param woken if the holder released the mutex and sent the task back
+ */
+static void task_retry(struct pool_worker *worker, struct thread_future *task, bool woken,
+    uint64_t now_ns)
+{
+    struct thread_pool *pool = task->pool;
+
+    pthread_mutex_lock(&pool->wait_lock);
+    if (!woken && task->retrying) {
+        // The task is in the inbox already, it retries from there
+        pthread_mutex_unlock(&pool->wait_lock);
+        return;
+    }
+    task->retrying = true;
+    task->retry_again = false;
+    pthread_mutex_unlock(&pool->wait_lock);
+
+    int trylock_ret;
+    while (true) {
+        trylock_ret = data_trylock(&task->data);
+
+        pthread_mutex_lock(&pool->wait_lock);
+        if (trylock_ret == EBUSY && task->retry_again) {
+            // Released again while we tried. The new holder may be gone already
+            task->retry_again = false;
+            pthread_mutex_unlock(&pool->wait_lock);
+            continue;
+        }
+
+        task->retrying = false;
+        if (trylock_ret != EBUSY) {
+            wait_dequeue(pool, task);
+        }
+        pthread_mutex_unlock(&pool->wait_lock);
+        break;
+    }
+
+    if (trylock_ret == EBUSY) {
+        if (task->retry_ns < RETRY_MAX_NS) {
+            task->retry_ns *= 2;
+        }
+        task_wait(worker, task, TASK_BLOCKED, now_ns + task->retry_ns);
+        return;
+    }
+
+    worker->num_blocked--;
+    if (trylock_ret != 0) {
+        // Let the next task in the queue find out for itself
+        wake_waiter(pool, data_lock_key(&task->data));
+    }
+    task_obtained(worker, task, trylock_ret, now_ns);
+}
+
+static void task_run(struct pool_worker *worker, struct thread_future *task, uint64_t now_ns)
+{
+    switch (task->state) {
+    case TASK_NEW:
+        task_wait(worker, task, TASK_WAIT_TO_OBTAIN,
+            now_ns + ms_to_ns(task->data.wait_to_obtain_mutex_in_ms));
+        break;
+
+    case TASK_WAIT_TO_OBTAIN:
+        task_try_obtain(worker, task, now_ns);
+        break;
+
+    case TASK_BLOCKED:
+        task_retry(worker, task, false, now_ns);
+        break;
+
+    case TASK_HOLDING: {
+        // The task may complete, and be reused by its owner, as soon as its next wait is armed
+        const void *lock = data_lock_key(&task->data);
+        int unlock_ret = data_unlock(&task->data);
+        if (unlock_ret != 0) {
+            printf("pthread_mutex_unlock failed with %d\n", unlock_ret);
+            task_complete(task, false);
+        } else {
+            task->data.lock_released_ns = monotonic_ns();
+            profile_record(&task->data);
+            task_wait(worker, task, TASK_WAIT_AFTER_RELEASE,
+                now_ns + ms_to_ns(task->data.wait_to_release_mutex_in_ms));
+        }
+        wake_waiter(worker->pool, lock);
+        break;
+    }
+
+    case TASK_WAIT_AFTER_RELEASE:
+        task_complete(task, true);
+        break;
+    }
+}
+
+static void * pool_worker(void *worker_param)
+{
+    struct pool_worker *worker = (struct pool_worker *) worker_param;
+
+    // Without it, samples are merged one at a time
+    local_profile = calloc(1, sizeof(struct local_profile));
+    uint64_t last_flush_ns = monotonic_ns();
+
+    pthread_mutex_lock(&worker->lock);
+    while (true) {
+        struct thread_future *inbox = worker->inbox_head;
+        worker->inbox_head = NULL;
+        worker->inbox_tail = NULL;
+        pthread_mutex_unlock(&worker->lock);
+
+        uint64_t now_ns = monotonic_ns();
+        while (inbox != NULL) {
+            struct thread_future *task = inbox;
+            inbox = task->next;
+            if (task->state == TASK_NEW) {
+                task_run(worker, task, now_ns);
+                continue;
+            }
+
+            // A blocked task sent back to retry may still have its polling timer armed
+            if (task->heap_index != NOT_IN_HEAP) {
+                heap_remove(worker, task);
+            }
+            task_retry(worker, task, true, now_ns);
+        }
+
+        while (worker->heap_len > 0 && worker->heap[0]->deadline_ns <= now_ns) {
+            struct thread_future *task = worker->heap[0];
+            heap_remove(worker, task);
+            task_run(worker, task, now_ns);
+            now_ns = monotonic_ns();
+        }
+
+        // Merge when idle, so the samples of an idle pool are all visible, and now and then
+        // while busy so they do not lag behind for long
+        if (worker->heap_len == 0 || now_ns - last_flush_ns >= PROFILE_FLUSH_INTERVAL_NS) {
+            profile_flush_local();
+            last_flush_ns = now_ns;
+        }
+
+        pthread_mutex_lock(&worker->lock);
+        if (worker->inbox_head != NULL) {
+            continue;
+        }
+        if (worker->heap_len == 0) {
+            // Stopping only takes effect once every task of this worker completed. Read under the
+            // lock, or a stop signalled while the tasks ran would be lost and the worker never wake
+            if (worker->stopping && worker->num_blocked == 0) {
+                break;
+            }
+            pthread_cond_wait(&worker->wake_cond, &worker->lock);
+        } else {
+            uint64_t deadline_ns = worker->heap[0]->deadline_ns;
+            struct timespec deadline = {
+                .tv_sec = deadline_ns / 1000000000ull,
+                .tv_nsec = deadline_ns % 1000000000ull,
+            };
+            pthread_cond_timedwait(&worker->wake_cond, &worker->lock, &deadline);
+        }
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    profile_flush_local();
+    free(local_profile);
+    local_profile = NULL;
+    free(worker->heap);
+    return NULL;
+}
+
+static void stop_workers(struct thread_pool *pool)
+{
+    for (size_t i = 0; i < pool->num_workers; i++) {
+        struct pool_worker *worker = &pool->workers[i];
+        pthread_mutex_lock(&worker->lock);
+        worker->stopping = true;
+        pthread_cond_signal(&worker->wake_cond);
+        pthread_mutex_unlock(&worker->lock);
+    }
+
+    for (size_t i = 0; i < pool->num_workers; i++) {
+        struct pool_worker *worker = &pool->workers[i];
+        pthread_join(worker->thread, NULL);
+        pthread_cond_destroy(&worker->wake_cond);
+        pthread_mutex_destroy(&worker->lock);
+    }
+}
+
+struct thread_pool *thread_pool_create(size_t num_workers)
+{
+    if (num_workers == 0) {
+        long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_workers = num_cpus > 0 ? (size_t)num_cpus : 1;
+    }
+
+    struct thread_pool *pool = calloc(1, sizeof(struct thread_pool) +
+        num_workers * sizeof(struct pool_worker));
+    if (pool == NULL) {
+        ERROR_LOG("calloc: %s", strerror(errno));
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_mutex_init(&pool->wait_lock, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    // The deadlines are CLOCK_MONOTONIC, so changing the wall clock cannot stretch them
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+
+    for (; pool->num_workers < num_workers; pool->num_workers++) {
+        struct pool_worker *worker = &pool->workers[pool->num_workers];
+        worker->pool = pool;
+        pthread_mutex_init(&worker->lock, NULL);
+        pthread_cond_init(&worker->wake_cond, &cond_attr);
+
+        int pthread_create_ret = pthread_create(&worker->thread, NULL, pool_worker, worker);
+        if (pthread_create_ret != 0) {
+            ERROR_LOG("pthread_create: %s", strerror(pthread_create_ret));
+            pthread_cond_destroy(&worker->wake_cond);
+            pthread_mutex_destroy(&worker->lock);
+            pthread_condattr_destroy(&cond_attr);
+            thread_pool_destroy(pool);
+            return NULL;
+        }
+    }
+    pthread_condattr_destroy(&cond_attr);
+
+    DEBUG_LOG("Thread pool with %zu workers created", num_workers);
+    return pool;
+}
+
+void thread_pool_destroy(struct thread_pool *pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+
+    stop_workers(pool);
+
+    while (pool->free_list != NULL) {
+        struct thread_future *future = pool->free_list;
+        pool->free_list = future->next;
+        free(future);
+    }
+
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_mutex_destroy(&pool->wait_lock);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+static struct thread_future *pool_start(struct thread_pool *pool, pthread_mutex_t *mutex,
+    struct lock *lock, int wait_to_obtain_ms, int wait_to_release_ms)
+{
+    pthread_mutex_lock(&pool->lock);
+    struct thread_future *future = pool->free_list;
+    if (future != NULL) {
+        pool->free_list = future->next;
+    }
+    size_t worker_index = pool->next_worker++ % pool->num_workers;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (future == NULL) {
+        future = malloc(sizeof(struct thread_future));
+        if (future == NULL) {
+            ERROR_LOG("malloc: %s", strerror(errno));
+            return NULL;
+        }
+        future->pool = pool;
+    }
+
+    init_thread_data(&future->data, mutex, lock, wait_to_obtain_ms, wait_to_release_ms);
+    future->worker = &pool->workers[worker_index];
+    future->done = false;
+    future->state = TASK_NEW;
+    future->heap_index = NOT_IN_HEAP;
+
+    worker_post(future->worker, future);
+    return future;
+}
+
+struct thread_future *thread_pool_start_obtaining_mutex(struct thread_pool *pool,
+    pthread_mutex_t *mutex, int wait_to_obtain_ms, int wait_to_release_ms)
+{
+    return pool_start(pool, mutex, NULL, wait_to_obtain_ms, wait_to_release_ms);
+}
+
+struct thread_future *thread_pool_start_obtaining_lock(struct thread_pool *pool,
+    struct lock *lock, int wait_to_obtain_ms, int wait_to_release_ms)
+{
+    return pool_start(pool, NULL, lock, wait_to_obtain_ms, wait_to_release_ms);
+}
+
+bool thread_future_done(struct thread_future *future)
+{
+    pthread_mutex_lock(&future->pool->lock);
+    bool done = future->done;
+    pthread_mutex_unlock(&future->pool->lock);
+
+    return done;
+}
+
+struct thread_data *thread_future_wait(struct thread_future *future)
+{
+    struct thread_pool *pool = future->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    if (!future->done) {
+        pool->num_waiters++;
+        while (!future->done) {
+            pthread_cond_wait(&pool->done_cond, &pool->lock);
+        }
+        pool->num_waiters--;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return &future->data;
+}
+
+bool thread_future_release(struct thread_future *future)
+{
+    struct thread_pool *pool = future->pool;
+    bool success = thread_future_wait(future)->thread_complete_success;
+
+    pthread_mutex_lock(&pool->lock);
+    future->next = pool->free_list;
+    pool->free_list = future;
+    pthread_mutex_unlock(&pool->lock);
+
+    return success;
+}
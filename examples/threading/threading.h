@@ -1,6 +1,11 @@
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <pthread.h>
 
+#include "histogram.h"
+#include "locks.h"
+
 /**
  * This structure should be dynamically allocated and passed as
  * an argument to your thread using pthread_create.
@@ -18,6 +23,19 @@ struct thread_data{
     int wait_to_obtain_mutex_in_ms;
     int wait_to_release_mutex_in_ms;
     pthread_mutex_t * mutex;
+    /**
+     * Taken instead of mutex when not NULL, with lock_node as the node of the caller.
+     */
+    struct lock * lock;
+    struct lock_node lock_node;
+
+    /**
+     * CLOCK_MONOTONIC times, in ns, at which the task asked for the lock, got it and released
+     * it. 0 for the steps it did not reach.
+     */
+    uint64_t lock_requested_ns;
+    uint64_t lock_acquired_ns;
+    uint64_t lock_released_ns;
 
 
     /**
@@ -43,3 +61,102 @@ struct thread_data{
 * @return true if the thread could be started, false if a failure occurred.
 */
 bool start_thread_obtaining_mutex(pthread_t *thread, pthread_mutex_t *mutex,int wait_to_obtain_ms, int wait_to_release_ms);
+
+/**
+* Same as start_thread_obtaining_mutex() with any of the lock types of locks.h.
+*/
+bool start_thread_obtaining_lock(pthread_t *thread, struct lock *lock, int wait_to_obtain_ms,
+    int wait_to_release_ms);
+
+
+/**
+ * Pool of pre-spawned worker threads running the same task as start_thread_obtaining_mutex().
+ * Starting a task costs a queue push instead of a pthread_create(), and the thread_data of
+ * finished tasks is recycled instead of being freed, so harnesses starting tens of thousands
+ * of tasks no longer spend their time creating threads.
+ *
+ * The waits are not sleeps: each worker keeps the deadlines of its tasks in a timer heap and
+ * only wakes up to lock or unlock when one expires, so a handful of workers can have millions
+ * of tasks in flight. A task runs on a single worker from start to end, which keeps the
+ * unlocking thread the same as the locking one. A task finding its mutex busy queues behind the
+ * other tasks waiting for it, and the task releasing the mutex sends the oldest one back to its
+ * worker. The first of the queue also polls with pthread_mutex_trylock(), from 50 us doubling
+ * up to 1 ms, in case the holder is a thread outside the pool.
+ * Recursive mutexes are not supported.
+ */
+struct thread_pool;
+
+/**
+ * Completion handle of a task started on a thread_pool. It owns the thread_data of the task
+ * until it is handed back with thread_future_release().
+ */
+struct thread_future;
+
+/**
+* Spawns @param num_workers workers. 0 picks one per online CPU.
+* @return NULL if the pool could not be created.
+*/
+struct thread_pool *thread_pool_create(size_t num_workers);
+
+/**
+* Waits for every task already started to complete, then stops the workers and frees the pool.
+* Every future must have been released before.
+*/
+void thread_pool_destroy(struct thread_pool *pool);
+
+/**
+* Pooled counterpart of start_thread_obtaining_mutex(). Queues the task on the next worker,
+* round robin, and returns at once.
+* @return the completion handle, NULL if no memory was available.
+*/
+struct thread_future *thread_pool_start_obtaining_mutex(struct thread_pool *pool,
+    pthread_mutex_t *mutex, int wait_to_obtain_ms, int wait_to_release_ms);
+
+/**
+* Same as thread_pool_start_obtaining_mutex() with any of the lock types of locks.h. The pool only
+* ever tries the lock, so spinlocks never make a worker spin.
+*/
+struct thread_future *thread_pool_start_obtaining_lock(struct thread_pool *pool,
+    struct lock *lock, int wait_to_obtain_ms, int wait_to_release_ms);
+
+/**
+* @return true once the task completed, without blocking.
+*/
+bool thread_future_done(struct thread_future *future);
+
+/**
+* Blocks until the task completed.
+* @return its thread_data, valid until the future is released.
+*/
+struct thread_data *thread_future_wait(struct thread_future *future);
+
+/**
+* Waits for the task if needed and hands its thread_data back to the pool for reuse.
+* @return the thread_complete_success of the task.
+*/
+bool thread_future_release(struct thread_future *future);
+
+/**
+ * Wait (requested to acquired) and hold (acquired to released) times of every task, aggregated
+ * per mutex or struct lock. Each pool worker accumulates its samples in thread-local histograms
+ * and merges them before it sleeps and when it stops, a dedicated thread merges its single sample
+ * before it exits. So once a thread is joined, or a pool is idle or destroyed, its samples are in.
+ */
+typedef void (*lock_profile_callback_t)(const void *lock, const struct histogram *wait,
+    const struct histogram *hold, void *arg);
+
+/**
+* Copies the histograms of @param lock, a pthread_mutex_t or a struct lock.
+* @return false if no task released it yet.
+*/
+bool lock_profile_get(const void *lock, struct histogram *wait, struct histogram *hold);
+
+/**
+* Calls @param callback for every profiled lock. It must not call the other lock_profile functions.
+*/
+void lock_profile_for_each(lock_profile_callback_t callback, void *arg);
+
+/**
+* Drops every merged sample.
+*/
+void lock_profile_reset(void);
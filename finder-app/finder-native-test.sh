@@ -0,0 +1,100 @@
+#!/bin/sh
+# Checks the native finder against find and grep on a fixture tree: every search kernel and
+# the index must report the file and matching line counts of
+#   find DIR -type f | wc -l
+#   grep -rwiF STRING DIR | wc -l
+
+set -e
+set -u
+
+# The finder folds case and finds word boundaries as grep does in the C locale
+export LC_ALL=C
+
+cd "$(dirname "$0")"
+make finder > /dev/null
+
+fixture=$(mktemp -d)
+trap 'rm -rf "$fixture" "${fixture}.index"' EXIT
+
+# Word boundaries and case
+mkdir -p "$fixture/words/nested/deeper"
+printf 'needle\nneedles\n_needle\nneedle_x\nneedle2\nhaystack-needle-x\na needle.\n' \
+	> "$fixture/words/boundaries.txt"
+printf 'Needle\nNEEDLE in a haystack\nnEeDlE\n' > "$fixture/words/case.txt"
+printf 'needle at the end without newline' > "$fixture/words/nested/no-newline.txt"
+printf 'two needle needle on one line\n' > "$fixture/words/nested/deeper/twice.txt"
+: > "$fixture/words/empty.txt"
+
+# Binary files: lines are only counted before the first NUL byte, as grep does
+mkdir -p "$fixture/binary"
+printf 'needle\n\000needle\nneedle\n' > "$fixture/binary/nul.bin"
+printf '\000\001\002needle' > "$fixture/binary/leading-nul.bin"
+
+# Symlinks are not followed, neither to files nor to directories
+mkdir -p "$fixture/links"
+ln -s ../words/boundaries.txt "$fixture/links/file-link"
+ln -s ../words "$fixture/links/dir-link"
+ln -s missing "$fixture/links/dangling"
+
+# Files of 1 MiB and more are mmap'd instead of read in chunks
+mkdir -p "$fixture/large"
+awk 'BEGIN {
+	for (i = 0; i < 40000; i++) {
+		if (i % 997 == 0) print "line " i " has a needle in it";
+		else if (i % 991 == 0) print "line " i " has NEEDLES only";
+		else print "line " i " of the haystack, nothing to see here";
+	}
+	printf "last needle";
+}' > "$fixture/large/large.txt"
+size=$(wc -c < "$fixture/large/large.txt")
+if [ "$size" -lt 1048576 ]; then
+	echo "large.txt is only ${size} bytes, not covering the mmap path"
+	exit 1
+fi
+
+failed=0
+
+check() {
+	label=$1
+	expected=$2
+	shift 2
+	actual=$("$@") || actual="exit status $?"
+	if [ "$actual" != "$expected" ]; then
+		echo "FAIL ${label}: expected '${expected}', got '${actual}'"
+		failed=1
+	fi
+}
+
+files=$(find "$fixture" -type f | wc -l)
+for string in needle NEEDLE haystack-needle "a needle" "needle in" NEEDLES missing; do
+	lines=$(grep -rwiF "$string" "$fixture" 2> /dev/null | wc -l)
+	expected="The number of files are ${files} and the number of matching lines are ${lines}"
+
+	for kernel in scalar sse2 avx2; do
+		if [ "$kernel" = avx2 ] && ! grep -qw avx2 /proc/cpuinfo; then
+			continue
+		fi
+		check "-k ${kernel} '${string}'" "$expected" ./finder -k "$kernel" "$fixture" "$string"
+	done
+	check "-j 1 '${string}'" "$expected" ./finder -j 1 "$fixture" "$string"
+
+	# The index is kept out of the tree it indexes
+	check "-i '${string}'" "$expected" ./finder -i "${fixture}.index" "$fixture" "$string"
+	check "-n -i '${string}'" "$expected" ./finder -n -i "${fixture}.index" "$fixture" "$string"
+done
+
+# A refresh picks up changed, added and removed files
+printf 'needle\n' >> "$fixture/words/case.txt"
+printf 'needle\n' > "$fixture/words/added.txt"
+rm "$fixture/words/empty.txt"
+files=$(find "$fixture" -type f | wc -l)
+lines=$(grep -rwiF needle "$fixture" 2> /dev/null | wc -l)
+check "-i after changes" \
+	"The number of files are ${files} and the number of matching lines are ${lines}" \
+	./finder -i "${fixture}.index" "$fixture" needle
+rm -f "${fixture}.index"
+
+if [ "$failed" -ne 0 ]; then
+	exit 1
+fi
+echo "success"
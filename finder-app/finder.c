@@ -0,0 +1,392 @@
+/*
+ * Native counterpart of finder.sh: counts the regular files under a directory and the lines
+ * matching a string in them, as `find DIR -type f | wc -l` and `grep -rwi STRING DIR | wc -l`
+ * would, in a single parallel walk.
+ *
+ * Each thread owns a deque of directories still to be listed: it pushes the subdirectories it
+ * finds and pops from the same end, so it walks depth first and keeps its working set small,
+ * while idle threads steal from the other end, where the oldest and usually biggest subtrees
+ * are. Files are searched by the thread that finds them.
+ *
+ * Lines are matched and counted by search.c. As grep, symbolic links found during the walk are
+ * not followed.
+ *
+ * With -i, single word queries are answered from the index of index.c instead. The walk then
+ * only refreshes the index, reading the files that changed since it was written, and -n skips
+ * even that for when the tree is known not to have changed.
+ */
+#define _GNU_SOURCE  // O_DIRECTORY, O_NOFOLLOW
+
+#include "index.h"
+#include "search.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAX_THREADS 256
+/// Failed steal rounds before an idle thread starts sleeping between them
+#define IDLE_SPINS 64
+#define IDLE_SLEEP_US 100
+
+struct deque {
+  pthread_mutex_t lock;
+  char **dirs;  // dirs[head..tail) are queued. The owner works at tail, thieves at head
+  size_t head;
+  size_t tail;
+  size_t capacity;
+};
+
+struct worker {
+  pthread_t thread;
+  size_t index;
+  struct deque deque;
+  struct search_buffer buffer;
+  uint64_t files;
+  uint64_t matching_lines;
+} __attribute__((aligned(64)));
+
+static struct worker *workers;
+static size_t num_workers;
+/// Directories queued or being listed. The walk is over when it drops to 0
+static size_t pending_dirs;
+
+static struct search search;
+
+/// Refreshing an index rather than searching the files
+static bool indexing;
+static const struct index *old_index;
+static struct index_builder *builders;
+static size_t root_len;
+
+static bool deque_push(struct deque *deque, char *dir) {
+  pthread_mutex_lock(&deque->lock);
+  if (deque->tail == deque->capacity) {
+    if (deque->head > 0) {
+      // Reclaim the room left by thieves before growing
+      memmove(deque->dirs, deque->dirs + deque->head,
+              (deque->tail - deque->head) * sizeof(char *));
+      deque->tail -= deque->head;
+      deque->head = 0;
+    } else {
+      size_t capacity = deque->capacity ? deque->capacity * 2 : 64;
+      char **dirs = realloc(deque->dirs, capacity * sizeof(char *));
+      if (dirs == NULL) {
+        pthread_mutex_unlock(&deque->lock);
+        return false;
+      }
+      deque->dirs = dirs;
+      deque->capacity = capacity;
+    }
+  }
+  deque->dirs[deque->tail++] = dir;
+  pthread_mutex_unlock(&deque->lock);
+  return true;
+}
+
+static char *deque_pop(struct deque *deque) {
+  char *dir = NULL;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->tail > deque->head) {
+    dir = deque->dirs[--deque->tail];
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return dir;
+}
+
+static char *deque_steal(struct deque *deque) {
+  char *dir = NULL;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->tail > deque->head) {
+    dir = deque->dirs[deque->head++];
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return dir;
+}
+
+static void search_file(struct worker *self, int dir_fd, const char *name, const char *dir) {
+  int fd = openat(dir_fd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd == -1 || search_count_fd(&search, fd, &self->buffer, &self->matching_lines) == -1) {
+    fprintf(stderr, "finder: %s/%s: %s\n", dir, name, strerror(errno));
+  }
+  if (fd != -1) {
+    close(fd);
+  }
+}
+
+static char *join_path(const char *dir, const char *name) {
+  size_t dir_len = strlen(dir);
+  size_t name_len = strlen(name);
+  char *path = malloc(dir_len + name_len + 2);
+  if (path != NULL) {
+    memcpy(path, dir, dir_len);
+    path[dir_len] = '/';
+    memcpy(path + dir_len + 1, name, name_len + 1);
+  }
+  return path;
+}
+
+static void list_dir(struct worker *self, const char *dir) {
+  const char *relative_dir = dir + root_len;
+  while (*relative_dir == '/') {
+    relative_dir++;
+  }
+
+  int dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  DIR *stream = dir_fd != -1 ? fdopendir(dir_fd) : NULL;
+  if (stream == NULL) {
+    fprintf(stderr, "finder: %s: %s\n", dir, strerror(errno));
+    if (dir_fd != -1) {
+      close(dir_fd);
+    }
+    return;
+  }
+
+  struct dirent *entry;
+  while ((entry = readdir(stream)) != NULL) {
+    const char *name = entry->d_name;
+    if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+      continue;
+    }
+
+    unsigned char type = entry->d_type;
+    if (type == DT_UNKNOWN) {
+      struct stat st;
+      if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+        continue;
+      }
+      type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+    }
+
+    if (type == DT_REG) {
+      self->files++;
+      if (!indexing) {
+        search_file(self, dir_fd, name, dir);
+      } else if (index_builder_add(&builders[self->index], old_index, dir_fd, name, relative_dir,
+                                   &self->buffer) == -1) {
+        fprintf(stderr, "finder: %s/%s: %s\n", dir, name, strerror(errno));
+      }
+    } else if (type == DT_DIR) {
+      char *path = join_path(dir, name);
+      __atomic_add_fetch(&pending_dirs, 1, __ATOMIC_RELAXED);
+      if (path == NULL || !deque_push(&self->deque, path)) {
+        // No memory to queue it: walk it right away instead
+        if (path != NULL) {
+          list_dir(self, path);
+          free(path);
+        }
+        __atomic_sub_fetch(&pending_dirs, 1, __ATOMIC_RELEASE);
+      }
+    }
+  }
+
+  closedir(stream);
+}
+
+static char *find_work(struct worker *self) {
+  char *dir = deque_pop(&self->deque);
+  for (size_t i = 1; dir == NULL && i < num_workers; i++) {
+    dir = deque_steal(&workers[(self->index + i) % num_workers].deque);
+  }
+  return dir;
+}
+
+static void *walk(void *arg) {
+  struct worker *self = arg;
+  unsigned idle = 0;
+
+  while (true) {
+    char *dir = find_work(self);
+    if (dir != NULL) {
+      idle = 0;
+      list_dir(self, dir);
+      free(dir);
+      __atomic_sub_fetch(&pending_dirs, 1, __ATOMIC_RELEASE);
+      continue;
+    }
+
+    if (__atomic_load_n(&pending_dirs, __ATOMIC_ACQUIRE) == 0) {
+      return NULL;
+    }
+    if (++idle < IDLE_SPINS) {
+      sched_yield();
+    } else {
+      usleep(IDLE_SLEEP_US);
+    }
+  }
+}
+
+static void usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [-j threads] [-k kernel] [-i index [-n]] DIRECTORY STRING\n"
+          "  -k  search kernel: auto, scalar, sse2 or avx2 (default auto)\n"
+          "  -i  answer single word queries from this index of DIRECTORY, refreshed first\n"
+          "  -n  use the index as it is, without refreshing it\n",
+          program);
+}
+
+/// Walks the tree from @param root with the workers, which must be initialized
+static void walk_tree(const char *root) {
+  char *root_copy = strdup(root);
+  pending_dirs = 1;
+  if (root_copy == NULL || !deque_push(&workers[0].deque, root_copy)) {
+    perror("finder");
+    exit(1);
+  }
+
+  size_t started = 1;
+  for (; started < num_workers; started++) {
+    if (pthread_create(&workers[started].thread, NULL, walk, &workers[started]) != 0) {
+      break;  // Fewer threads only make the walk slower
+    }
+  }
+  num_workers = started;
+  walk(&workers[0]);
+
+  for (size_t i = 1; i < num_workers; i++) {
+    pthread_join(workers[i].thread, NULL);
+  }
+}
+
+/// Answers the query for @param word from the index at @param index_path, refreshed first
+static int run_indexed(const char *root, const char *word, const char *index_path, bool refresh) {
+  char *canonical_root = realpath(root, NULL);
+  if (canonical_root == NULL) {
+    fprintf(stderr, "finder: %s: %s\n", root, strerror(errno));
+    return 1;
+  }
+
+  struct index index;
+  if (index_open(&index, index_path, canonical_root) == -1) {
+    if (errno == EEXIST) {
+      fprintf(stderr, "finder: %s is the index of another directory than %s\n", index_path, root);
+    } else {
+      fprintf(stderr, "finder: %s: %s\n", index_path, strerror(errno));
+    }
+    return 1;
+  }
+
+  if (refresh) {
+    builders = calloc(num_workers, sizeof(struct index_builder));
+    if (builders == NULL) {
+      perror("finder");
+      return 1;
+    }
+    indexing = true;
+    old_index = &index;
+    walk_tree(root);
+
+    if (!index_builders_unchanged(&index, builders, num_workers)) {
+      if (index_write(index_path, canonical_root, &index, builders, num_workers) == -1) {
+        fprintf(stderr, "finder: %s: %s\n", index_path, strerror(errno));
+        return 1;
+      }
+      index_close(&index);
+      if (index_open(&index, index_path, canonical_root) == -1) {
+        fprintf(stderr, "finder: %s: %s\n", index_path, strerror(errno));
+        return 1;
+      }
+    }
+  } else if (index.map == NULL) {
+    fprintf(stderr, "finder: %s is not an index of %s\n", index_path, root);
+    return 1;
+  }
+
+  printf("The number of files are %llu and the number of matching lines are %llu\n",
+         (unsigned long long)index_num_files(&index),
+         (unsigned long long)index_count_lines(&index, word));
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  enum search_kernel kernel = SEARCH_KERNEL_AUTO;
+  const char *index_path = NULL;
+  bool refresh = true;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "j:k:i:nh")) != -1) {
+    switch (opt) {
+      case 'j':
+        num_threads = strtol(optarg, NULL, 10);
+        break;
+      case 'k':
+        if (!search_kernel_from_name(optarg, &kernel)) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'i':
+        index_path = optarg;
+        break;
+      case 'n':
+        refresh = false;
+        break;
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (argc - optind != 2 || num_threads <= 0 || (!refresh && index_path == NULL)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  const char *root = argv[optind];
+  const char *string = argv[optind + 1];
+  root_len = strlen(root);
+  if (!search_init(&search, string, kernel)) {
+    fprintf(stderr,
+            "finder: the string must have between 1 and %d bytes and no newline, "
+            "and the %s kernel must be supported by this CPU\n",
+            SEARCH_MAX_NEEDLE, search_kernel_name(kernel));
+    return 1;
+  }
+
+  struct stat root_stat;
+  if (stat(root, &root_stat) == -1 || !S_ISDIR(root_stat.st_mode)) {
+    fprintf(stderr, "%s is not a directory!\n", root);
+    return 1;
+  }
+
+  num_workers = num_threads > MAX_THREADS ? MAX_THREADS : (size_t)num_threads;
+  workers = aligned_alloc(64, num_workers * sizeof(struct worker));
+  if (workers == NULL) {
+    perror("finder");
+    return 1;
+  }
+  memset(workers, 0, num_workers * sizeof(struct worker));
+
+  for (size_t i = 0; i < num_workers; i++) {
+    workers[i].index = i;
+    pthread_mutex_init(&workers[i].deque.lock, NULL);
+  }
+
+  // Strings that are not a single word can only be found by searching the files
+  if (index_path != NULL && index_can_answer(string)) {
+    return run_indexed(root, string, index_path, refresh);
+  }
+
+  walk_tree(root);
+
+  uint64_t files = 0;
+  uint64_t matching_lines = 0;
+  for (size_t i = 0; i < num_workers; i++) {
+    files += workers[i].files;
+    matching_lines += workers[i].matching_lines;
+  }
+
+  printf("The number of files are %llu and the number of matching lines are %llu\n",
+         (unsigned long long)files, (unsigned long long)matching_lines);
+  return 0;
+}
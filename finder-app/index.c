@@ -0,0 +1,820 @@
+#define _GNU_SOURCE  // qsort_r
+
+#include "index.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define INDEX_MAGIC "FNDIDX01"
+#define NONE UINT32_MAX
+/// The file could not be read in full: read it again at the next refresh
+#define INDEX_FILE_INCOMPLETE 1
+
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+/*
+ * File layout, every section aligned on 8 bytes:
+ *   struct index_header
+ *   struct index_file[num_files], sorted by path
+ *   struct index_word[num_words], sorted by word
+ *   struct index_posting[num_postings], grouped by word
+ *   strings: the root, then the paths and words, each followed by a NUL byte
+ */
+struct index_header {
+  char magic[8];
+  uint64_t size;  // Of the whole file, to reject truncated ones
+  uint32_t num_files;
+  uint32_t num_words;
+  uint64_t num_postings;
+  uint64_t files_offset;
+  uint64_t words_offset;
+  uint64_t postings_offset;
+  uint64_t strings_offset;
+  uint64_t strings_size;
+  uint64_t root_len;  // The root is at the start of the strings
+};
+
+struct index_file {
+  uint64_t mtime_ns;
+  uint64_t ctime_ns;
+  uint64_t size;
+  uint64_t ino;
+  uint64_t path_offset;  // In the strings
+  uint32_t path_len;
+  uint32_t flags;
+};
+
+struct index_word {
+  uint64_t string_offset;
+  uint64_t postings_offset;  // Index of its first posting
+  uint32_t len;
+  uint32_t num_postings;
+};
+
+struct index_posting {
+  uint32_t file;
+  uint32_t lines;  // Holding the word
+};
+
+struct index_builder_file {
+  char *path;
+  uint64_t mtime_ns;
+  uint64_t ctime_ns;
+  uint64_t size;
+  uint64_t ino;
+  uint32_t flags;
+  uint32_t old_id;  // Its index in the previous index if reused, NONE if read
+};
+
+struct index_builder_word {
+  uint64_t string_offset;  // In the builder strings, not NUL terminated
+  uint32_t len;
+  uint32_t hash;
+  uint32_t file;  // Last file the word was found in
+  uint32_t lines;  // Lines of that file holding it
+  uint64_t line;  // Last line of that file holding it
+};
+
+struct index_builder_posting {
+  uint32_t word;
+  uint32_t file;
+  uint32_t lines;
+};
+
+/// Grows @param array to hold at least @param needed elements of @param size bytes
+static bool reserve(void **array, size_t *capacity, size_t needed, size_t size) {
+  if (needed <= *capacity) {
+    return true;
+  }
+
+  size_t grown_capacity = *capacity ? *capacity : 64;
+  while (grown_capacity < needed) {
+    grown_capacity *= 2;
+  }
+  void *grown = realloc(*array, grown_capacity * size);
+  if (grown == NULL) {
+    return false;
+  }
+  *array = grown;
+  *capacity = grown_capacity;
+  return true;
+}
+
+#define RESERVE(array, capacity, needed) \
+  reserve((void **)&(array), &(capacity), (needed), sizeof(*(array)))
+
+static uint32_t hash_word(const char *word, size_t len) {
+  uint32_t hash = FNV_OFFSET;
+  for (size_t i = 0; i < len; i++) {
+    hash = (hash ^ (unsigned char)word[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+static uint64_t timespec_ns(const struct timespec *time) {
+  return (uint64_t)time->tv_sec * 1000000000ull + (uint64_t)time->tv_nsec;
+}
+
+bool index_can_answer(const char *string) {
+  size_t len = strlen(string);
+  if (len == 0 || len > INDEX_MAX_WORD) {
+    return false;
+  }
+  for (size_t i = 0; i < len; i++) {
+    if (!search_is_word((unsigned char)string[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool index_valid(const struct index *index) {
+  const struct index_header *header = index->header;
+  size_t size = index->size;
+
+  if (memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0 || header->size != size ||
+      header->files_offset > size ||
+      (size - header->files_offset) / sizeof(struct index_file) < header->num_files ||
+      header->words_offset > size ||
+      (size - header->words_offset) / sizeof(struct index_word) < header->num_words ||
+      header->postings_offset > size ||
+      (size - header->postings_offset) / sizeof(struct index_posting) < header->num_postings ||
+      header->strings_offset > size || size - header->strings_offset < header->strings_size ||
+      header->files_offset % 8 != 0 || header->words_offset % 8 != 0 ||
+      header->postings_offset % 8 != 0) {
+    return false;
+  }
+
+  uint64_t strings_size = header->strings_size;
+  if (header->root_len >= strings_size) {
+    return false;
+  }
+  for (uint32_t i = 0; i < header->num_files; i++) {
+    const struct index_file *file = &index->files[i];
+    if (file->path_offset >= strings_size || strings_size - file->path_offset <= file->path_len ||
+        index->strings[file->path_offset + file->path_len] != '\0') {
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < header->num_words; i++) {
+    const struct index_word *word = &index->words[i];
+    if (word->string_offset >= strings_size || strings_size - word->string_offset < word->len ||
+        word->postings_offset > header->num_postings ||
+        header->num_postings - word->postings_offset < word->num_postings) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int index_open(struct index *index, const char *path, const char *root) {
+  memset(index, 0, sizeof(*index));
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return errno == ENOENT ? 0 : -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return -1;
+  }
+  if ((uint64_t)st.st_size < sizeof(struct index_header) || (uint64_t)st.st_size > SIZE_MAX) {
+    close(fd);
+    return 0;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return -1;
+  }
+
+  index->map = map;
+  index->size = st.st_size;
+  index->header = map;
+  index->files = (const void *)((const char *)map + index->header->files_offset);
+  index->words = (const void *)((const char *)map + index->header->words_offset);
+  index->postings = (const void *)((const char *)map + index->header->postings_offset);
+  index->strings = (const char *)map + index->header->strings_offset;
+  if (!index_valid(index)) {
+    index_close(index);
+    return 0;
+  }
+  // Refreshing would replace the index of another directory with one of this directory
+  if (index->header->root_len != strlen(root) ||
+      memcmp(index->strings, root, index->header->root_len) != 0) {
+    index_close(index);
+    errno = EEXIST;
+    return -1;
+  }
+  return 0;
+}
+
+void index_close(struct index *index) {
+  if (index->map != NULL) {
+    munmap(index->map, index->size);
+  }
+  memset(index, 0, sizeof(*index));
+}
+
+uint64_t index_num_files(const struct index *index) {
+  return index->header != NULL ? index->header->num_files : 0;
+}
+
+static int compare_word(const char *a, size_t a_len, const char *b, size_t b_len) {
+  int cmp = memcmp(a, b, a_len < b_len ? a_len : b_len);
+  return cmp != 0 ? cmp : (a_len > b_len) - (a_len < b_len);
+}
+
+uint64_t index_count_lines(const struct index *index, const char *word) {
+  if (index->header == NULL) {
+    return 0;
+  }
+
+  char folded[INDEX_MAX_WORD];
+  size_t len = strlen(word);
+  for (size_t i = 0; i < len; i++) {
+    folded[i] = search_fold((unsigned char)word[i]);
+  }
+
+  size_t low = 0;
+  size_t high = index->header->num_words;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    const struct index_word *candidate = &index->words[middle];
+    int cmp = compare_word(index->strings + candidate->string_offset, candidate->len, folded, len);
+    if (cmp < 0) {
+      low = middle + 1;
+    } else if (cmp > 0) {
+      high = middle;
+    } else {
+      uint64_t lines = 0;
+      const struct index_posting *postings = &index->postings[candidate->postings_offset];
+      for (uint32_t i = 0; i < candidate->num_postings; i++) {
+        lines += postings[i].lines;
+      }
+      return lines;
+    }
+  }
+  return 0;
+}
+
+/// @return the index in @param index of the file at @param path, NONE if there is none
+static uint32_t index_find_file(const struct index *index, const char *path) {
+  size_t low = 0;
+  size_t high = index_num_files(index);
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    int cmp = strcmp(index->strings + index->files[middle].path_offset, path);
+    if (cmp < 0) {
+      low = middle + 1;
+    } else if (cmp > 0) {
+      high = middle;
+    } else {
+      return middle;
+    }
+  }
+  return NONE;
+}
+
+void index_builder_init(struct index_builder *builder) {
+  memset(builder, 0, sizeof(*builder));
+}
+
+void index_builder_free(struct index_builder *builder) {
+  for (size_t i = 0; i < builder->num_files; i++) {
+    free(builder->files[i].path);
+  }
+  free(builder->files);
+  free(builder->words);
+  free(builder->word_slots);
+  free(builder->strings);
+  free(builder->postings);
+  free(builder->touched);
+  free(builder->path);
+  index_builder_init(builder);
+}
+
+static bool builder_grow_slots(struct index_builder *builder) {
+  size_t num_slots = builder->word_slots ? (builder->word_slots_mask + 1) * 2 : 1024;
+  uint32_t *slots = calloc(num_slots, sizeof(uint32_t));
+  if (slots == NULL) {
+    return false;
+  }
+
+  for (size_t i = 0; i < builder->num_words; i++) {
+    size_t slot = builder->words[i].hash & (num_slots - 1);
+    while (slots[slot] != 0) {
+      slot = (slot + 1) & (num_slots - 1);
+    }
+    slots[slot] = i + 1;
+  }
+  free(builder->word_slots);
+  builder->word_slots = slots;
+  builder->word_slots_mask = num_slots - 1;
+  return true;
+}
+
+/// @return the id of @param word in @param builder, added if needed, NONE if out of memory
+static uint32_t builder_intern(struct index_builder *builder, const char *word, size_t len,
+                               uint32_t hash) {
+  if ((builder->word_slots == NULL || (builder->num_words + 1) * 2 > builder->word_slots_mask) &&
+      !builder_grow_slots(builder)) {
+    return NONE;
+  }
+
+  size_t slot = hash & builder->word_slots_mask;
+  while (builder->word_slots[slot] != 0) {
+    uint32_t id = builder->word_slots[slot] - 1;
+    const struct index_builder_word *candidate = &builder->words[id];
+    if (candidate->hash == hash && candidate->len == len &&
+        memcmp(builder->strings + candidate->string_offset, word, len) == 0) {
+      return id;
+    }
+    slot = (slot + 1) & builder->word_slots_mask;
+  }
+
+  if (builder->num_words >= NONE - 1 ||
+      !RESERVE(builder->words, builder->words_capacity, builder->num_words + 1) ||
+      !RESERVE(builder->strings, builder->strings_capacity, builder->strings_len + len)) {
+    return NONE;
+  }
+  memcpy(builder->strings + builder->strings_len, word, len);
+  builder->words[builder->num_words] = (struct index_builder_word){
+    .string_offset = builder->strings_len,
+    .len = len,
+    .hash = hash,
+    .file = NONE,
+  };
+  builder->strings_len += len;
+  builder->word_slots[slot] = builder->num_words + 1;
+  return builder->num_words++;
+}
+
+static bool builder_add_posting(struct index_builder *builder, uint32_t word, uint32_t file,
+                                uint32_t lines) {
+  if (!RESERVE(builder->postings, builder->postings_capacity, builder->num_postings + 1)) {
+    return false;
+  }
+  builder->postings[builder->num_postings++] = (struct index_builder_posting){
+    .word = word,
+    .file = file,
+    .lines = lines,
+  };
+  return true;
+}
+
+static void builder_found_word(struct index_builder *builder, const char *word, size_t len,
+                               uint32_t hash) {
+  uint32_t id = builder_intern(builder, word, len, hash);
+  if (id == NONE) {
+    builder->failed = true;
+    return;
+  }
+
+  struct index_builder_word *found = &builder->words[id];
+  uint32_t file = builder->num_files - 1;
+  if (found->file != file) {
+    if (!RESERVE(builder->touched, builder->touched_capacity, builder->num_touched + 1)) {
+      builder->failed = true;
+      return;
+    }
+    builder->touched[builder->num_touched++] = id;
+    found->file = file;
+    found->lines = 1;
+    found->line = builder->line;
+  } else if (found->line != builder->line) {
+    found->lines++;
+    found->line = builder->line;
+  }
+}
+
+static void builder_add_lines(void *arg, const unsigned char *lines, size_t len) {
+  struct index_builder *builder = arg;
+  char word[INDEX_MAX_WORD];
+
+  size_t i = 0;
+  while (i < len) {
+    if (!search_is_word(lines[i])) {
+      if (lines[i] == '\n') {
+        builder->line++;
+      }
+      i++;
+      continue;
+    }
+
+    size_t start = i;
+    uint32_t hash = FNV_OFFSET;
+    for (; i < len && search_is_word(lines[i]); i++) {
+      if (i - start < INDEX_MAX_WORD) {
+        word[i - start] = search_fold(lines[i]);
+        hash = (hash ^ (unsigned char)word[i - start]) * FNV_PRIME;
+      }
+    }
+    if (i - start <= INDEX_MAX_WORD) {
+      builder_found_word(builder, word, i - start, hash);
+    }
+  }
+}
+
+static void set_file_stat(struct index_builder_file *file, const struct stat *st) {
+  file->mtime_ns = timespec_ns(&st->st_mtim);
+  file->ctime_ns = timespec_ns(&st->st_ctim);
+  file->size = st->st_size;
+  file->ino = st->st_ino;
+}
+
+int index_builder_add(struct index_builder *builder, const struct index *old, int dir_fd,
+                      const char *name, const char *relative_dir, struct search_buffer *buffer) {
+  size_t dir_len = strlen(relative_dir);
+  size_t name_len = strlen(name);
+  if (!RESERVE(builder->path, builder->path_capacity, dir_len + name_len + 2) ||
+      !RESERVE(builder->files, builder->files_capacity, builder->num_files + 1) ||
+      builder->num_files >= NONE - 1) {
+    builder->failed = true;
+    errno = ENOMEM;
+    return -1;
+  }
+  char *path = builder->path;
+  if (dir_len > 0) {
+    memcpy(path, relative_dir, dir_len);
+    path[dir_len++] = '/';
+  }
+  memcpy(path + dir_len, name, name_len + 1);
+
+  struct index_builder_file *file = &builder->files[builder->num_files];
+  memset(file, 0, sizeof(*file));
+  file->old_id = NONE;
+
+  // Unchanged files are only stat'ed
+  struct stat st;
+  if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+    set_file_stat(file, &st);
+    uint32_t old_id = index_find_file(old, path);
+    if (old_id != NONE) {
+      const struct index_file *old_file = &old->files[old_id];
+      if (old_file->flags == 0 && old_file->mtime_ns == file->mtime_ns &&
+          old_file->ctime_ns == file->ctime_ns && old_file->size == file->size &&
+          old_file->ino == file->ino) {
+        file->old_id = old_id;
+      }
+    }
+  }
+
+  file->path = strdup(path);
+  if (file->path == NULL) {
+    builder->failed = true;
+    errno = ENOMEM;
+    return -1;
+  }
+  builder->num_files++;
+  if (file->old_id != NONE) {
+    builder->num_reused++;
+    return 0;
+  }
+
+  int ret = -1;
+  int fd = openat(dir_fd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd != -1 && fstat(fd, &st) == 0) {
+    // What was read matches this metadata, or a later refresh sees it changed
+    set_file_stat(file, &st);
+    builder->line = 0;
+    ret = search_scan_fd(fd, buffer, builder_add_lines, builder);
+  }
+  int scan_errno = errno;
+  if (fd != -1) {
+    close(fd);
+  }
+
+  for (size_t i = 0; i < builder->num_touched; i++) {
+    uint32_t id = builder->touched[i];
+    if (!builder_add_posting(builder, id, builder->num_files - 1, builder->words[id].lines)) {
+      builder->failed = true;
+    }
+  }
+  builder->num_touched = 0;
+
+  if (ret == -1) {
+    file->flags |= INDEX_FILE_INCOMPLETE;
+    errno = scan_errno;
+  }
+  return ret;
+}
+
+bool index_builders_unchanged(const struct index *old, const struct index_builder *builders,
+                              size_t num_builders) {
+  for (size_t i = 0; i < num_builders; i++) {
+    if (builders[i].num_reused != builders[i].num_files) {
+      return false;
+    }
+  }
+
+  // Every file found was in the index: none was removed if as many were found
+  size_t num_files = 0;
+  for (size_t i = 0; i < num_builders; i++) {
+    num_files += builders[i].num_files;
+  }
+  return old->header != NULL && num_files == old->header->num_files;
+}
+
+struct file_ref {
+  const struct index_builder_file *file;
+  uint32_t builder;
+  uint32_t id;  // In its builder
+};
+
+static int compare_file_refs(const void *a, const void *b) {
+  return strcmp(((const struct file_ref *)a)->file->path, ((const struct file_ref *)b)->file->path);
+}
+
+static int compare_word_ids(const void *a, const void *b, void *arg) {
+  const struct index_builder *words = arg;
+  const struct index_builder_word *word_a = &words->words[*(const uint32_t *)a];
+  const struct index_builder_word *word_b = &words->words[*(const uint32_t *)b];
+  return compare_word(words->strings + word_a->string_offset, word_a->len,
+                      words->strings + word_b->string_offset, word_b->len);
+}
+
+static uint64_t align8(uint64_t offset) {
+  return (offset + 7) & ~(uint64_t)7;
+}
+
+static bool write_padding(FILE *stream, uint64_t *offset) {
+  static const char zeros[8];
+  uint64_t aligned = align8(*offset);
+  if (fwrite(zeros, 1, aligned - *offset, stream) != aligned - *offset) {
+    return false;
+  }
+  *offset = aligned;
+  return true;
+}
+
+/// Writes the index gathered in @param files and @param merged (whose postings use ids of files)
+static int write_file(const char *path, const char *root, const struct file_ref *files,
+                      size_t num_files, const struct index_builder *merged) {
+  int ret = -1;
+  size_t num_words = merged->num_words;
+  uint32_t *order = malloc((num_words + 1) * sizeof(uint32_t));
+  uint32_t *rank = malloc((num_words + 1) * sizeof(uint32_t));
+  uint64_t *first_posting = calloc(num_words + 1, sizeof(uint64_t));
+  struct index_posting *postings = malloc((merged->num_postings + 1) * sizeof(*postings));
+  char *tmp_path = malloc(strlen(path) + 32);
+  FILE *stream = NULL;
+  if (order == NULL || rank == NULL || first_posting == NULL || postings == NULL ||
+      tmp_path == NULL) {
+    errno = ENOMEM;
+    goto out;
+  }
+
+  // Words sorted, and their postings grouped in that order
+  for (size_t i = 0; i < num_words; i++) {
+    order[i] = i;
+  }
+  qsort_r(order, num_words, sizeof(uint32_t), compare_word_ids, (void *)merged);
+  for (size_t i = 0; i < num_words; i++) {
+    rank[order[i]] = i;
+  }
+  for (size_t i = 0; i < merged->num_postings; i++) {
+    first_posting[rank[merged->postings[i].word] + 1]++;
+  }
+  for (size_t i = 0; i < num_words; i++) {
+    first_posting[i + 1] += first_posting[i];
+  }
+  uint64_t *next_posting = calloc(num_words + 1, sizeof(uint64_t));
+  if (next_posting == NULL) {
+    errno = ENOMEM;
+    goto out;
+  }
+  memcpy(next_posting, first_posting, (num_words + 1) * sizeof(uint64_t));
+  for (size_t i = 0; i < merged->num_postings; i++) {
+    const struct index_builder_posting *posting = &merged->postings[i];
+    postings[next_posting[rank[posting->word]]++] = (struct index_posting){
+      .file = posting->file,
+      .lines = posting->lines,
+    };
+  }
+  free(next_posting);
+
+  struct index_header header = {
+    .num_files = num_files,
+    .num_words = num_words,
+    .num_postings = merged->num_postings,
+    .root_len = strlen(root),
+  };
+  memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+  header.files_offset = align8(sizeof(header));
+  header.words_offset = align8(header.files_offset + num_files * sizeof(struct index_file));
+  header.postings_offset = align8(header.words_offset + num_words * sizeof(struct index_word));
+  header.strings_offset =
+      align8(header.postings_offset + merged->num_postings * sizeof(struct index_posting));
+  uint64_t strings_size = header.root_len + 1;
+  for (size_t i = 0; i < num_files; i++) {
+    strings_size += strlen(files[i].file->path) + 1;
+  }
+  for (size_t i = 0; i < num_words; i++) {
+    strings_size += merged->words[i].len + 1;
+  }
+  header.strings_size = strings_size;
+  header.size = header.strings_offset + strings_size;
+
+  sprintf(tmp_path, "%s.%d.tmp", path, (int)getpid());
+  stream = fopen(tmp_path, "we");
+  if (stream == NULL) {
+    goto out;
+  }
+
+  bool ok = fwrite(&header, sizeof(header), 1, stream) == 1;
+  uint64_t offset = sizeof(header);
+  ok = ok && write_padding(stream, &offset);
+  uint64_t string_offset = header.root_len + 1;
+  for (size_t i = 0; ok && i < num_files; i++) {
+    const struct index_builder_file *file = files[i].file;
+    struct index_file entry = {
+      .mtime_ns = file->mtime_ns,
+      .ctime_ns = file->ctime_ns,
+      .size = file->size,
+      .ino = file->ino,
+      .path_offset = string_offset,
+      .path_len = strlen(file->path),
+      .flags = file->flags,
+    };
+    string_offset += entry.path_len + 1;
+    ok = fwrite(&entry, sizeof(entry), 1, stream) == 1;
+  }
+  offset = header.files_offset + num_files * sizeof(struct index_file);
+  ok = ok && write_padding(stream, &offset);
+  for (size_t i = 0; ok && i < num_words; i++) {
+    const struct index_builder_word *word = &merged->words[order[i]];
+    struct index_word entry = {
+      .string_offset = string_offset,
+      .postings_offset = first_posting[i],
+      .len = word->len,
+      .num_postings = first_posting[i + 1] - first_posting[i],
+    };
+    string_offset += word->len + 1;
+    ok = fwrite(&entry, sizeof(entry), 1, stream) == 1;
+  }
+  offset = header.words_offset + num_words * sizeof(struct index_word);
+  ok = ok && write_padding(stream, &offset);
+  ok = ok && fwrite(postings, sizeof(*postings), merged->num_postings, stream) ==
+                 merged->num_postings;
+  offset = header.postings_offset + merged->num_postings * sizeof(struct index_posting);
+  ok = ok && write_padding(stream, &offset);
+
+  ok = ok && fwrite(root, 1, header.root_len + 1, stream) == header.root_len + 1;
+  for (size_t i = 0; ok && i < num_files; i++) {
+    const char *file_path = files[i].file->path;
+    ok = fwrite(file_path, 1, strlen(file_path) + 1, stream) == strlen(file_path) + 1;
+  }
+  for (size_t i = 0; ok && i < num_words; i++) {
+    const struct index_builder_word *word = &merged->words[order[i]];
+    ok = fwrite(merged->strings + word->string_offset, 1, word->len, stream) == word->len &&
+         fputc('\0', stream) != EOF;
+  }
+
+  int close_ret = fclose(stream);
+  stream = NULL;
+  if (!ok || close_ret != 0 || rename(tmp_path, path) == -1) {
+    int saved_errno = errno;
+    unlink(tmp_path);
+    errno = saved_errno;
+    goto out;
+  }
+  ret = 0;
+
+out:
+  if (stream != NULL) {
+    fclose(stream);
+    unlink(tmp_path);
+  }
+  free(order);
+  free(rank);
+  free(first_posting);
+  free(postings);
+  free(tmp_path);
+  return ret;
+}
+
+int index_write(const char *path, const char *root, const struct index *old,
+                struct index_builder *builders, size_t num_builders) {
+  size_t num_files = 0;
+  for (size_t i = 0; i < num_builders; i++) {
+    if (builders[i].failed) {
+      errno = ENOMEM;
+      return -1;
+    }
+    num_files += builders[i].num_files;
+  }
+  if (num_files >= NONE) {
+    errno = EFBIG;
+    return -1;
+  }
+
+  int ret = -1;
+  size_t num_old_files = index_num_files(old);
+  struct file_ref *files = malloc((num_files + 1) * sizeof(*files));
+  uint32_t **new_ids = calloc(num_builders, sizeof(uint32_t *));
+  uint32_t *old_to_new = malloc((num_old_files + 1) * sizeof(uint32_t));
+  uint32_t *word_ids = NULL;
+  struct index_builder merged;
+  index_builder_init(&merged);
+  if (files == NULL || new_ids == NULL || old_to_new == NULL) {
+    goto out_of_memory;
+  }
+
+  // Files sorted by path, and where each one of the builders and of the old index went
+  size_t next = 0;
+  for (size_t i = 0; i < num_builders; i++) {
+    new_ids[i] = malloc((builders[i].num_files + 1) * sizeof(uint32_t));
+    if (new_ids[i] == NULL) {
+      goto out_of_memory;
+    }
+    for (size_t j = 0; j < builders[i].num_files; j++) {
+      files[next++] = (struct file_ref){
+        .file = &builders[i].files[j],
+        .builder = i,
+        .id = j,
+      };
+    }
+  }
+  qsort(files, num_files, sizeof(*files), compare_file_refs);
+  for (size_t i = 0; i < num_old_files; i++) {
+    old_to_new[i] = NONE;
+  }
+  for (size_t i = 0; i < num_files; i++) {
+    new_ids[files[i].builder][files[i].id] = i;
+    if (files[i].file->old_id != NONE) {
+      old_to_new[files[i].file->old_id] = i;
+    }
+  }
+
+  // Postings of the unchanged files, from the old index
+  for (uint32_t i = 0; old->header != NULL && i < old->header->num_words; i++) {
+    const struct index_word *word = &old->words[i];
+    const struct index_posting *postings = &old->postings[word->postings_offset];
+    uint32_t id = NONE;
+    for (uint32_t j = 0; j < word->num_postings; j++) {
+      if (postings[j].file >= num_old_files || old_to_new[postings[j].file] == NONE) {
+        continue;
+      }
+      if (id == NONE) {
+        const char *string = old->strings + word->string_offset;
+        id = builder_intern(&merged, string, word->len, hash_word(string, word->len));
+      }
+      if (id == NONE || !builder_add_posting(&merged, id, old_to_new[postings[j].file],
+                                             postings[j].lines)) {
+        goto out_of_memory;
+      }
+    }
+  }
+
+  // Postings of the files read
+  for (size_t i = 0; i < num_builders; i++) {
+    const struct index_builder *builder = &builders[i];
+    free(word_ids);
+    word_ids = malloc((builder->num_words + 1) * sizeof(uint32_t));
+    if (word_ids == NULL) {
+      goto out_of_memory;
+    }
+    for (size_t j = 0; j < builder->num_words; j++) {
+      const struct index_builder_word *word = &builder->words[j];
+      word_ids[j] = builder_intern(&merged, builder->strings + word->string_offset, word->len,
+                                   word->hash);
+      if (word_ids[j] == NONE) {
+        goto out_of_memory;
+      }
+    }
+    for (size_t j = 0; j < builder->num_postings; j++) {
+      const struct index_builder_posting *posting = &builder->postings[j];
+      if (!builder_add_posting(&merged, word_ids[posting->word], new_ids[i][posting->file],
+                               posting->lines)) {
+        goto out_of_memory;
+      }
+    }
+  }
+
+  ret = write_file(path, root, files, num_files, &merged);
+  goto out;
+
+out_of_memory:
+  errno = ENOMEM;
+out:
+  for (size_t i = 0; new_ids != NULL && i < num_builders; i++) {
+    free(new_ids[i]);
+  }
+  free(new_ids);
+  free(files);
+  free(old_to_new);
+  free(word_ids);
+  index_builder_free(&merged);
+  return ret;
+}
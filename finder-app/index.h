@@ -0,0 +1,110 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+/*
+ * On-disk inverted index of a directory: for every word of its files, the files holding it and
+ * how many of their lines do, so whole word queries are answered without reading any file.
+ *
+ * The index file is memory mapped as is. It holds the indexed files sorted by path, with the
+ * mtime, ctime, size and inode they had when they were read, then the words sorted, each with
+ * its (file, lines) postings. Refreshing it only reads the files whose metadata changed since,
+ * and takes the postings of the others from the previous index.
+ *
+ * Words are what search_is_word() keeps together, folded to ASCII lower case, and counted from
+ * the content search_scan_fd() passes, so a query counts the lines grep -wi would.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "search.h"
+
+/// Longer words are not indexed, and queries for them have to scan the files
+#define INDEX_MAX_WORD 64
+
+struct index_header;
+struct index_file;
+struct index_word;
+struct index_posting;
+
+/// Mapped index file. Empty, with every count at 0, when there was no usable index
+struct index {
+  void *map;
+  size_t size;
+  const struct index_header *header;
+  const struct index_file *files;
+  const struct index_word *words;
+  const struct index_posting *postings;
+  const char *strings;
+};
+
+/// Files and postings gathered by one thread while refreshing an index
+struct index_builder {
+  struct index_builder_file *files;
+  size_t num_files;
+  size_t files_capacity;
+  size_t num_reused;  // Files unchanged since the previous index
+
+  struct index_builder_word *words;
+  size_t num_words;
+  size_t words_capacity;
+  uint32_t *word_slots;  // Hash table of words, 1 + index in words or 0
+  size_t word_slots_mask;
+  char *strings;
+  size_t strings_len;
+  size_t strings_capacity;
+
+  struct index_builder_posting *postings;
+  size_t num_postings;
+  size_t postings_capacity;
+
+  uint32_t *touched;  // Words found in the file being read
+  size_t num_touched;
+  size_t touched_capacity;
+  uint64_t line;  // Line being read
+  char *path;  // Scratch relative path
+  size_t path_capacity;
+  bool failed;  // Ran out of memory: the builder cannot be written
+};
+
+/// @return true if @param string is a single word the index can answer queries for
+bool index_can_answer(const char *string);
+
+/**
+ * Maps the index at @param path if it was built for the directory @param root (canonical path).
+ * A missing or corrupted index leaves @param index empty, to be rebuilt.
+ * @return 0 on success, -1 with errno set otherwise, EEXIST if it is the index of another root.
+ */
+int index_open(struct index *index, const char *path, const char *root);
+void index_close(struct index *index);
+
+uint64_t index_num_files(const struct index *index);
+/// @return the number of lines of the indexed files holding @param word, index_can_answer()
+uint64_t index_count_lines(const struct index *index, const char *word);
+
+void index_builder_init(struct index_builder *builder);
+void index_builder_free(struct index_builder *builder);
+
+/**
+ * Adds the regular file @param name of the directory open at @param dir_fd, at @param relative
+ * path from the indexed directory, reusing its postings from @param old if it did not change.
+ * @return 0 on success, -1 with errno set if it could not be read, in which case it is indexed
+ * with what could be read and read again at the next refresh.
+ */
+int index_builder_add(struct index_builder *builder, const struct index *old, int dir_fd,
+                      const char *name, const char *relative_dir, struct search_buffer *buffer);
+
+/// @return true if @param builders found the same files as @param old, all unchanged
+bool index_builders_unchanged(const struct index *old, const struct index_builder *builders,
+                              size_t num_builders);
+
+/**
+ * Writes at @param path the index of @param root made of the files of @param builders, replacing
+ * the previous one atomically.
+ * @return 0 on success, -1 with errno set otherwise.
+ */
+int index_write(const char *path, const char *root, const struct index *old,
+                struct index_builder *builders, size_t num_builders);
+
+#endif /* INDEX_H */
@@ -0,0 +1,326 @@
+#define _GNU_SOURCE  // memrchr
+
+#include "search.h"
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SEARCH_HAVE_X86 1
+#endif
+
+/// Bytes checked for NUL bytes, and read from unmapped files, at once. The buffer size of GNU
+/// grep, so binary files stop being counted where grep stops printing their lines
+#define SEARCH_CHUNK (96 * 1024)
+/// Smaller files are read: mapping costs page faults, and unmapping flushes the TLB of every
+/// CPU running one of our threads
+#define SEARCH_MMAP_MIN_SIZE (1024 * 1024)
+
+static inline unsigned char other_case(unsigned char c) {
+  return (unsigned char)(c - 'a') < 26 ? c & ~0x20 : c;
+}
+
+/// @return true if a whole word match of the needle starts at buf[pos], pos + needle_len <= len
+static inline bool match_at(const struct search *search, const unsigned char *buf, size_t pos,
+                            size_t len) {
+  size_t n = search->needle_len;
+  for (size_t k = 1; k + 1 < n; k++) {
+    if (search_fold(buf[pos + k]) != search->needle[k]) {
+      return false;
+    }
+  }
+  return (pos == 0 || !search_is_word(buf[pos - 1])) &&
+         (pos + n == len || !search_is_word(buf[pos + n]));
+}
+
+/// @return the position after the newline ending the line of buf[pos], len if it is the last
+static inline size_t next_line(const unsigned char *buf, size_t pos, size_t len) {
+  const unsigned char *newline = memchr(buf + pos, '\n', len - pos);
+  return newline != NULL ? (size_t)(newline - buf) + 1 : len;
+}
+
+/// Scalar scan of buf[from..len), buf[from] being a line start or a position not matched yet
+static uint64_t count_scalar_from(const struct search *search, const unsigned char *buf,
+                                  size_t from, size_t len) {
+  size_t n = search->needle_len;
+  unsigned char first = search->needle[0];
+  unsigned char last = search->needle[n - 1];
+  uint64_t lines = 0;
+
+  size_t i = from;
+  while (i + n <= len) {
+    if (search_fold(buf[i]) == first && search_fold(buf[i + n - 1]) == last &&
+        match_at(search, buf, i, len)) {
+      lines++;
+      i = next_line(buf, i + n, len);
+    } else {
+      i++;
+    }
+  }
+
+  return lines;
+}
+
+static uint64_t count_scalar(const struct search *search, const unsigned char *buf, size_t len) {
+  return count_scalar_from(search, buf, 0, len);
+}
+
+#ifdef SEARCH_HAVE_X86
+
+__attribute__((target("sse2")))
+static uint64_t count_sse2(const struct search *search, const unsigned char *buf, size_t len) {
+  size_t n = search->needle_len;
+  const __m128i first_lower = _mm_set1_epi8((char)search->needle[0]);
+  const __m128i first_upper = _mm_set1_epi8((char)other_case(search->needle[0]));
+  const __m128i last_lower = _mm_set1_epi8((char)search->needle[n - 1]);
+  const __m128i last_upper = _mm_set1_epi8((char)other_case(search->needle[n - 1]));
+  uint64_t lines = 0;
+
+  size_t i = 0;
+  while (i + n - 1 + 16 <= len) {
+    __m128i block_first = _mm_loadu_si128((const __m128i *)(buf + i));
+    __m128i block_last = _mm_loadu_si128((const __m128i *)(buf + i + n - 1));
+    __m128i eq_first = _mm_or_si128(_mm_cmpeq_epi8(block_first, first_lower),
+                                    _mm_cmpeq_epi8(block_first, first_upper));
+    __m128i eq_last = _mm_or_si128(_mm_cmpeq_epi8(block_last, last_lower),
+                                   _mm_cmpeq_epi8(block_last, last_upper));
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(eq_first, eq_last));
+
+    size_t next = i + 16;
+    while (mask != 0) {
+      size_t pos = i + __builtin_ctz(mask);
+      if (match_at(search, buf, pos, len)) {
+        lines++;
+        next = next_line(buf, pos + n, len);
+        break;
+      }
+      mask &= mask - 1;
+    }
+    i = next;
+  }
+
+  return lines + count_scalar_from(search, buf, i, len);
+}
+
+__attribute__((target("avx2")))
+static uint64_t count_avx2(const struct search *search, const unsigned char *buf, size_t len) {
+  size_t n = search->needle_len;
+  const __m256i first_lower = _mm256_set1_epi8((char)search->needle[0]);
+  const __m256i first_upper = _mm256_set1_epi8((char)other_case(search->needle[0]));
+  const __m256i last_lower = _mm256_set1_epi8((char)search->needle[n - 1]);
+  const __m256i last_upper = _mm256_set1_epi8((char)other_case(search->needle[n - 1]));
+  uint64_t lines = 0;
+
+  size_t i = 0;
+  while (i + n - 1 + 32 <= len) {
+    __m256i block_first = _mm256_loadu_si256((const __m256i *)(buf + i));
+    __m256i block_last = _mm256_loadu_si256((const __m256i *)(buf + i + n - 1));
+    __m256i eq_first = _mm256_or_si256(_mm256_cmpeq_epi8(block_first, first_lower),
+                                       _mm256_cmpeq_epi8(block_first, first_upper));
+    __m256i eq_last = _mm256_or_si256(_mm256_cmpeq_epi8(block_last, last_lower),
+                                      _mm256_cmpeq_epi8(block_last, last_upper));
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(eq_first, eq_last));
+
+    size_t next = i + 32;
+    while (mask != 0) {
+      size_t pos = i + __builtin_ctz(mask);
+      if (match_at(search, buf, pos, len)) {
+        lines++;
+        next = next_line(buf, pos + n, len);
+        break;
+      }
+      mask &= mask - 1;
+    }
+    i = next;
+  }
+
+  return lines + count_scalar_from(search, buf, i, len);
+}
+
+#endif /* SEARCH_HAVE_X86 */
+
+static const char *const kernel_names[] = {
+  [SEARCH_KERNEL_AUTO] = "auto",
+  [SEARCH_KERNEL_SCALAR] = "scalar",
+  [SEARCH_KERNEL_SSE2] = "sse2",
+  [SEARCH_KERNEL_AVX2] = "avx2",
+};
+
+const char *search_kernel_name(enum search_kernel kernel) {
+  return (size_t)kernel < sizeof(kernel_names) / sizeof(kernel_names[0])
+             ? kernel_names[kernel]
+             : "unknown";
+}
+
+bool search_kernel_from_name(const char *name, enum search_kernel *kernel) {
+  for (size_t i = 0; i < sizeof(kernel_names) / sizeof(kernel_names[0]); i++) {
+    if (strcmp(name, kernel_names[i]) == 0) {
+      *kernel = (enum search_kernel)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool search_init(struct search *search, const char *needle, enum search_kernel kernel) {
+  size_t len = strlen(needle);
+  if (len == 0 || len > SEARCH_MAX_NEEDLE || memchr(needle, '\n', len) != NULL) {
+    return false;
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    search->needle[i] = search_fold((unsigned char)needle[i]);
+  }
+  search->needle_len = len;
+
+#ifdef SEARCH_HAVE_X86
+  __builtin_cpu_init();
+  if (kernel == SEARCH_KERNEL_AUTO) {
+    kernel = __builtin_cpu_supports("avx2")   ? SEARCH_KERNEL_AVX2
+             : __builtin_cpu_supports("sse2") ? SEARCH_KERNEL_SSE2
+                                              : SEARCH_KERNEL_SCALAR;
+  }
+  if ((kernel == SEARCH_KERNEL_AVX2 && !__builtin_cpu_supports("avx2")) ||
+      (kernel == SEARCH_KERNEL_SSE2 && !__builtin_cpu_supports("sse2"))) {
+    return false;
+  }
+#else
+  if (kernel == SEARCH_KERNEL_AUTO) {
+    kernel = SEARCH_KERNEL_SCALAR;
+  }
+  if (kernel != SEARCH_KERNEL_SCALAR) {
+    return false;
+  }
+#endif
+
+  search->kernel = kernel;
+  switch (kernel) {
+#ifdef SEARCH_HAVE_X86
+    case SEARCH_KERNEL_AVX2:
+      search->count = count_avx2;
+      break;
+    case SEARCH_KERNEL_SSE2:
+      search->count = count_sse2;
+      break;
+#endif
+    default:
+      search->count = count_scalar;
+      break;
+  }
+  return true;
+}
+
+static int scan_mapped(int fd, size_t size, search_lines_callback_t callback, void *arg) {
+  const unsigned char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    return -1;
+  }
+  madvise((void *)data, size, MADV_SEQUENTIAL);
+
+  // Chunk by chunk, so the NUL check and the callback share the cache
+  size_t line_start = 0;
+  size_t pos = 0;
+  while (pos < size) {
+    size_t chunk = size - pos < SEARCH_CHUNK ? size - pos : SEARCH_CHUNK;
+    if (memchr(data + pos, '\0', chunk) != NULL) {
+      break;  // Binary from here on
+    }
+    pos += chunk;
+
+    size_t complete = pos;
+    if (pos < size) {
+      const unsigned char *newline = memrchr(data + line_start, '\n', pos - line_start);
+      complete = newline != NULL ? (size_t)(newline - data) + 1 : line_start;
+    }
+    if (complete > line_start) {
+      callback(arg, data + line_start, complete - line_start);
+    }
+    line_start = complete;
+  }
+
+  munmap((void *)data, size);
+  return 0;
+}
+
+static int scan_read(int fd, struct search_buffer *buffer, search_lines_callback_t callback,
+                     void *arg) {
+  // data[0..kept) is the start of a line that continues in the next chunk
+  size_t kept = 0;
+  while (true) {
+    if (buffer->capacity - kept < SEARCH_CHUNK) {
+      size_t capacity = buffer->capacity ? buffer->capacity * 2 : 2 * SEARCH_CHUNK;
+      unsigned char *grown = realloc(buffer->data, capacity);
+      if (grown == NULL) {
+        return -1;
+      }
+      buffer->data = grown;
+      buffer->capacity = capacity;
+    }
+
+    // Whole chunks keep the reads aligned on chunk boundaries, as in scan_mapped()
+    ssize_t len = read(fd, buffer->data + kept, SEARCH_CHUNK);
+    if (len == -1 && errno == EINTR) {
+      continue;
+    }
+    if (len == -1) {
+      return -1;
+    }
+    if (len == 0) {
+      if (kept > 0) {
+        callback(arg, buffer->data, kept);
+      }
+      return 0;
+    }
+    if (memchr(buffer->data + kept, '\0', len) != NULL) {
+      return 0;  // Binary from here on
+    }
+
+    size_t end = kept + len;
+    const unsigned char *newline = memrchr(buffer->data, '\n', end);
+    size_t complete = newline != NULL ? (size_t)(newline - buffer->data) + 1 : 0;
+    if (complete > 0) {
+      callback(arg, buffer->data, complete);
+    }
+    kept = end - complete;
+    memmove(buffer->data, buffer->data + complete, kept);
+  }
+}
+
+int search_scan_fd(int fd, struct search_buffer *buffer, search_lines_callback_t callback,
+                   void *arg) {
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    return -1;
+  }
+
+  // Files whose size is not known up front, as most of /proc and /sys, have to be read
+  if (S_ISREG(st.st_mode) && st.st_size >= SEARCH_MMAP_MIN_SIZE &&
+      (uint64_t)st.st_size <= SIZE_MAX && scan_mapped(fd, st.st_size, callback, arg) == 0) {
+    return 0;
+  }
+  return scan_read(fd, buffer, callback, arg);
+}
+
+struct count_arg {
+  const struct search *search;
+  uint64_t *lines;
+};
+
+static void count_callback(void *arg, const unsigned char *lines, size_t len) {
+  struct count_arg *count = arg;
+  *count->lines += search_count_lines(count->search, lines, len);
+}
+
+int search_count_fd(const struct search *search, int fd, struct search_buffer *buffer,
+                    uint64_t *lines) {
+  struct count_arg arg = {
+    .search = search,
+    .lines = lines,
+  };
+  return search_scan_fd(fd, buffer, count_callback, &arg);
+}
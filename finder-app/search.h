@@ -0,0 +1,86 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+/*
+ * Counting of the lines holding a whole word, case-insensitive match of a fixed string, as
+ * `grep -wi STRING FILE | wc -l` would count them.
+ *
+ * Candidates are found by comparing, many bytes at a time, the bytes where the first and the last
+ * byte of the string would be against both of their cases, so only positions agreeing on both
+ * ends get checked in full. Case folding is ASCII only, and a word is made of letters, digits and
+ * underscores. Every kernel counts the same lines; the scalar one is the reference.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SEARCH_MAX_NEEDLE 4096
+
+enum search_kernel {
+  SEARCH_KERNEL_AUTO,  // The fastest one the CPU supports
+  SEARCH_KERNEL_SCALAR,
+  SEARCH_KERNEL_SSE2,
+  SEARCH_KERNEL_AVX2,
+};
+
+struct search {
+  unsigned char needle[SEARCH_MAX_NEEDLE];  // Folded to lower case
+  size_t needle_len;
+  enum search_kernel kernel;
+  uint64_t (*count)(const struct search *search, const unsigned char *buf, size_t len);
+};
+
+/// ASCII lower case of @param c
+static inline unsigned char search_fold(unsigned char c) {
+  return (unsigned char)(c - 'A') < 26 ? c | 0x20 : c;
+}
+
+/// @return true if @param c can be part of a word: a letter, a digit or an underscore
+static inline bool search_is_word(unsigned char c) {
+  return (unsigned char)((c | 0x20) - 'a') < 26 || (unsigned char)(c - '0') < 10 || c == '_';
+}
+
+/// Read buffer of a thread, for the files that are not worth mapping
+struct search_buffer {
+  unsigned char *data;
+  size_t capacity;
+};
+
+/**
+ * Prepares @param search to look for @param needle with @param kernel.
+ * @return false if the needle is empty, too long or holds a newline, or if the CPU lacks the
+ * kernel.
+ */
+bool search_init(struct search *search, const char *needle, enum search_kernel kernel);
+
+/// @return true if @param name is one of auto, scalar, sse2 or avx2, stored in @param kernel
+bool search_kernel_from_name(const char *name, enum search_kernel *kernel);
+const char *search_kernel_name(enum search_kernel kernel);
+
+/// @return the number of matching lines of buf[0..len), which must start at a line start
+static inline uint64_t search_count_lines(const struct search *search, const unsigned char *buf,
+                                          size_t len) {
+  return search->count(search, buf, len);
+}
+
+/// Called with whole lines of a file, the last one possibly missing its newline
+typedef void (*search_lines_callback_t)(void *arg, const unsigned char *lines, size_t len);
+
+/**
+ * Passes the content of the file open at @param fd to @param callback, mapping the file when it
+ * is large enough and reading it through @param buffer otherwise. As grep, the content stops at
+ * the first chunk holding a NUL byte, as the file is binary from there on.
+ * @return 0 on success, -1 with errno set otherwise, the content until the error being passed.
+ */
+int search_scan_fd(int fd, struct search_buffer *buffer, search_lines_callback_t callback,
+                   void *arg);
+
+/**
+ * Counts the matching lines of the file open at @param fd into @param lines.
+ * @return 0 on success, -1 with errno set otherwise, with the lines counted until the error.
+ */
+int search_count_fd(const struct search *search, int fd, struct search_buffer *buffer,
+                    uint64_t *lines);
+
+#endif /* SEARCH_H */
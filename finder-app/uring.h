@@ -0,0 +1,61 @@
+#ifndef URING_H
+#define URING_H
+
+/*
+ * Minimal io_uring ring on top of the raw system calls, for the few operations writer needs,
+ * without depending on liburing. Kernels without io_uring, or with it disabled, make
+ * uring_init() fail, and the callers fall back to plain system calls.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+struct uring {
+  int fd;
+  unsigned entries;
+
+  void *sq_map;
+  size_t sq_map_size;
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  struct io_uring_sqe *sqes;
+  size_t sqes_size;
+  unsigned sq_pending;  // Queued since the last submission
+
+  void *cq_map;  // Same as sq_map when the kernel maps both rings at once
+  size_t cq_map_size;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  struct io_uring_cqe *cqes;
+};
+
+/**
+ * Sets up @param ring with room for @param entries operations in flight.
+ * @return 0 on success, -1 with errno set otherwise.
+ */
+int uring_init(struct uring *ring, unsigned entries);
+void uring_exit(struct uring *ring);
+
+/// @return true if the kernel of @param ring supports every operation of @param ops
+bool uring_supports(struct uring *ring, const uint8_t *ops, unsigned num_ops);
+
+/// @return a cleared submission entry to fill, NULL if the submission queue is full
+struct io_uring_sqe *uring_get_sqe(struct uring *ring);
+
+/**
+ * Submits the queued entries and waits for @param wait_nr completions.
+ * @return the number of entries submitted, -1 with errno set otherwise.
+ */
+int uring_submit_and_wait(struct uring *ring, unsigned wait_nr);
+
+/// @return the oldest completion not consumed yet, NULL if there is none
+struct io_uring_cqe *uring_peek_cqe(struct uring *ring);
+/// Consumes the completion returned by uring_peek_cqe()
+void uring_cqe_seen(struct uring *ring);
+
+#endif /* URING_H */
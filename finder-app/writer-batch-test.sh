@@ -0,0 +1,85 @@
+#!/bin/sh
+# Checks the batch mode of writer against one writer run per file, and reports how long each
+# took: writer -b -0 through plain system calls, writer -b -0 -u through io_uring, and writer -b
+# from a tab separated manifest must all leave the same files as the per-file loop.
+# Usage: writer-batch-test.sh [NUMFILES]
+
+set -e
+set -u
+
+NUMFILES=${1:-200}
+
+cd "$(dirname "$0")"
+make writer > /dev/null
+
+outdir=$(mktemp -d)
+trap 'rm -rf "$outdir"' EXIT
+
+# Contents of every few sizes, from empty to past the 4 KiB from which space is fallocate'd
+content() {
+	case $(($1 % 4)) in
+		0) printf '' ;;
+		1) printf 'AELD_IS_FUN %s' "$1" ;;
+		2) printf 'line one of %s\nline two\n' "$1" ;;
+		3) head -c 6000 /dev/zero | tr '\0' "$(($1 % 10))" ;;
+	esac
+}
+
+elapsed_ms() {
+	echo $((($(date +%s%N) - $1) / 1000000))
+}
+
+mkdir "$outdir/loop"
+start=$(date +%s%N)
+for i in $(seq 1 "$NUMFILES")
+do
+	./writer "$outdir/loop/file$i.txt" "$(content "$i")"
+done
+echo "per-file loop:        $(elapsed_ms "$start") ms for ${NUMFILES} files"
+
+failed=0
+
+check() {
+	label=$1
+	if ! diff -r "$outdir/loop" "$outdir/$label" > /dev/null; then
+		echo "FAIL ${label}: the files differ from the per-file loop"
+		failed=1
+	fi
+}
+
+for mode in syscalls uring; do
+	mkdir "$outdir/$mode"
+	for i in $(seq 1 "$NUMFILES")
+	do
+		printf '%s\0%s\0' "$outdir/$mode/file$i.txt" "$(content "$i")"
+	done > "$outdir/$mode.manifest"
+
+	flags=-0
+	if [ "$mode" = uring ]; then
+		flags="-0 -u"
+	fi
+	start=$(date +%s%N)
+	./writer -b $flags "$outdir/$mode.manifest"
+	echo "writer -b $flags: $(elapsed_ms "$start") ms"
+	rm "$outdir/$mode.manifest"
+	check "$mode"
+done
+
+# Tab separated manifests only carry single line contents
+mkdir "$outdir/manifest" "$outdir/loop-single"
+for i in $(seq 1 "$NUMFILES")
+do
+	if [ $((i % 4)) -ne 2 ]; then
+		printf '%s\t%s\n' "$outdir/manifest/file$i.txt" "$(content "$i")"
+		cp "$outdir/loop/file$i.txt" "$outdir/loop-single/"
+	fi
+done | ./writer -b
+if ! diff -r "$outdir/loop-single" "$outdir/manifest" > /dev/null; then
+	echo "FAIL manifest: the files differ from the per-file loop"
+	failed=1
+fi
+
+if [ "$failed" -ne 0 ]; then
+	exit 1
+fi
+echo "success"
@@ -1,21 +1,396 @@
+#define _GNU_SOURCE  // fallocate
+
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <syslog.h>
 #include <unistd.h>
 
+#include "uring.h"
+
+/// Files opened, written and closed together in batch mode
+#define BATCH_SIZE 256
+/// Smaller files fit in a single block, so reserving their space up front gains nothing
+#define FALLOCATE_MIN_SIZE 4096
+
+struct job {
+  char *path;
+  char *content;
+  size_t len;
+  size_t written;
+  int fd;
+  int error;  // errno of the first failure, 0 if none
+};
+
+/// Writes the whole of @param buf, resuming after short writes. @return 0, or -1 with errno set
+static int write_all(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t written = write(fd, buf, len);
+    if (written == -1 && errno == EINTR) {
+      continue;
+    }
+    if (written == -1) {
+      return -1;
+    }
+    buf += written;
+    len -= written;
+  }
+  return 0;
+}
+
+static void fail_job(struct job *job, int error) {
+  if (job->error == 0) {
+    job->error = error;
+  }
+}
+
+static bool fallocate_failed(int error) {
+  // Not every file system can reserve space: the write then allocates it as usual
+  return error != EOPNOTSUPP && error != ENOSYS && error != EINVAL;
+}
+
+static void write_job_sync(struct job *job) {
+  job->fd = open(job->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (job->fd == -1) {
+    fail_job(job, errno);
+    return;
+  }
+
+  if (job->len >= FALLOCATE_MIN_SIZE && fallocate(job->fd, 0, 0, job->len) == -1 &&
+      fallocate_failed(errno)) {
+    fail_job(job, errno);
+  } else if (write_all(job->fd, job->content, job->len) == -1) {
+    fail_job(job, errno);
+  }
+
+  if (close(job->fd) == -1) {
+    fail_job(job, errno);
+  }
+  job->fd = -1;
+}
+
+/// Queues the operation of a round for @param job. @return false if it has none in this round
+typedef bool (*prepare_fn)(struct job *job, struct io_uring_sqe *sqe);
+/// Handles the result @param res of the operation queued for @param job
+typedef void (*complete_fn)(struct job *job, int res);
+
+/**
+ * Queues an operation for each of @param jobs that needs one, submits them all at once and
+ * waits for their completions.
+ * @return the number of operations completed, -1 with errno set if the ring failed.
+ */
+static int uring_round(struct uring *ring, struct job *jobs, size_t num_jobs, prepare_fn prepare,
+                       complete_fn complete) {
+  unsigned queued = 0;
+  for (size_t i = 0; i < num_jobs; i++) {
+    struct io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    if (prepare(&jobs[i], &sqe)) {
+      sqe.user_data = i;
+      *uring_get_sqe(ring) = sqe;  // num_jobs never exceeds the ring size
+      queued++;
+    }
+  }
+
+  unsigned reaped = 0;
+  while (reaped < queued) {
+    if (uring_submit_and_wait(ring, queued - reaped) == -1) {
+      return -1;
+    }
+    struct io_uring_cqe *cqe;
+    while ((cqe = uring_peek_cqe(ring)) != NULL) {
+      complete(&jobs[cqe->user_data], cqe->res);
+      uring_cqe_seen(ring);
+      reaped++;
+    }
+  }
+  return queued;
+}
+
+static bool prepare_open(struct job *job, struct io_uring_sqe *sqe) {
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = (uintptr_t)job->path;
+  sqe->len = 0644;
+  sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+  return true;
+}
+
+static void complete_open(struct job *job, int res) {
+  if (res < 0) {
+    fail_job(job, -res);
+  } else {
+    job->fd = res;
+  }
+}
+
+static bool prepare_fallocate(struct job *job, struct io_uring_sqe *sqe) {
+  if (job->fd == -1 || job->len < FALLOCATE_MIN_SIZE) {
+    return false;
+  }
+  sqe->opcode = IORING_OP_FALLOCATE;
+  sqe->fd = job->fd;
+  sqe->off = 0;
+  sqe->addr = job->len;  // The length, the mode being in len
+  return true;
+}
+
+static void complete_fallocate(struct job *job, int res) {
+  if (res < 0 && fallocate_failed(-res)) {
+    fail_job(job, -res);
+  }
+}
+
+static bool prepare_write(struct job *job, struct io_uring_sqe *sqe) {
+  if (job->fd == -1 || job->error != 0 || job->written == job->len) {
+    return false;
+  }
+  size_t left = job->len - job->written;
+  sqe->opcode = IORING_OP_WRITE;
+  sqe->fd = job->fd;
+  sqe->addr = (uintptr_t)(job->content + job->written);
+  sqe->len = left > INT_MAX ? INT_MAX : left;
+  sqe->off = job->written;
+  return true;
+}
+
+static void complete_write(struct job *job, int res) {
+  if (res == -EINTR || res == -EAGAIN) {
+    return;  // Retried in the next round
+  }
+  if (res < 0) {
+    fail_job(job, -res);
+  } else if (res == 0) {
+    fail_job(job, EIO);
+  } else {
+    job->written += res;  // Short writes go on from there in the next round
+  }
+}
+
+static bool prepare_close(struct job *job, struct io_uring_sqe *sqe) {
+  if (job->fd == -1) {
+    return false;
+  }
+  sqe->opcode = IORING_OP_CLOSE;
+  sqe->fd = job->fd;
+  return true;
+}
+
+static void complete_close(struct job *job, int res) {
+  job->fd = -1;
+  if (res < 0) {
+    fail_job(job, -res);
+  }
+}
+
+/// Writes @param jobs through @param ring: all opens, then all fallocates, writes and closes
+static int write_jobs_uring(struct uring *ring, struct job *jobs, size_t num_jobs) {
+  if (uring_round(ring, jobs, num_jobs, prepare_open, complete_open) == -1 ||
+      uring_round(ring, jobs, num_jobs, prepare_fallocate, complete_fallocate) == -1) {
+    return -1;
+  }
+
+  int written;
+  do {
+    written = uring_round(ring, jobs, num_jobs, prepare_write, complete_write);
+  } while (written > 0);
+
+  if (uring_round(ring, jobs, num_jobs, prepare_close, complete_close) == -1 || written == -1) {
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Reads the next (path, content) pair of @param manifest into @param job: a path, a tab and the
+ * content up to the end of the line, or with @param nul_separated a path and a content each
+ * ended by a NUL byte, so they can hold any byte.
+ * @return 1 if a job was read, 0 at the end of the manifest, -1 on a malformed entry.
+ */
+static int read_job(FILE *manifest, bool nul_separated, struct job *job) {
+  char delimiter = nul_separated ? '\0' : '\n';
+  char *line = NULL;
+  size_t capacity = 0;
+  ssize_t len;
+  do {
+    len = getdelim(&line, &capacity, delimiter, manifest);
+    if (len == -1) {
+      free(line);
+      return 0;
+    }
+    if (len > 0 && line[len - 1] == delimiter) {
+      line[--len] = '\0';
+    }
+  } while (len == 0 && !nul_separated);  // Blank lines are skipped
+
+  memset(job, 0, sizeof(*job));
+  job->fd = -1;
+  if (!nul_separated) {
+    char *tab = strchr(line, '\t');
+    if (tab == NULL || tab == line) {
+      free(line);
+      return -1;
+    }
+    *tab = '\0';
+    job->path = line;
+    job->content = strdup(tab + 1);
+    job->len = line + len - (tab + 1);
+    return job->content != NULL ? 1 : -1;
+  }
+
+  job->path = line;
+  job->content = NULL;
+  capacity = 0;
+  len = getdelim(&job->content, &capacity, '\0', manifest);
+  if (len == -1 || line[0] == '\0') {
+    free(job->path);
+    free(job->content);
+    return -1;
+  }
+  if (len > 0 && job->content[len - 1] == '\0') {
+    len--;
+  }
+  job->len = len;
+  return 1;
+}
+
+/// Writes every entry of @param manifest_path, stdin if NULL or "-". @return the exit status
+static int run_batch(const char *manifest_path, bool nul_separated, bool use_uring) {
+  FILE *manifest = stdin;
+  if (manifest_path != NULL && strcmp(manifest_path, "-") != 0) {
+    manifest = fopen(manifest_path, "re");
+    if (manifest == NULL) {
+      syslog(LOG_ERR, "Error while trying to open the manifest '%s'", manifest_path);
+      return 1;
+    }
+  }
+
+  struct uring ring;
+  static const uint8_t ops[] = {
+    IORING_OP_OPENAT, IORING_OP_FALLOCATE, IORING_OP_WRITE, IORING_OP_CLOSE,
+  };
+  if (use_uring && uring_init(&ring, BATCH_SIZE) == 0) {
+    if (!uring_supports(&ring, ops, sizeof(ops))) {
+      uring_exit(&ring);
+      use_uring = false;
+    }
+  } else {
+    use_uring = false;
+  }
+  syslog(LOG_DEBUG, "Writing the files with %s", use_uring ? "io_uring" : "system calls");
+
+  struct job jobs[BATCH_SIZE];
+  size_t num_jobs = 0;
+  size_t total = 0;
+  size_t failed = 0;
+  unsigned long entry = 0;
+  bool end = false;
+  while (!end) {
+    int read_ret = read_job(manifest, nul_separated, &jobs[num_jobs]);
+    entry++;
+    if (read_ret == -1) {
+      syslog(LOG_ERR, "Malformed manifest entry %lu", entry);
+      failed++;
+      continue;
+    }
+    if (read_ret == 1) {
+      num_jobs++;
+    } else {
+      end = true;
+    }
+    if (num_jobs < BATCH_SIZE && !end) {
+      continue;
+    }
+
+    if (use_uring && write_jobs_uring(&ring, jobs, num_jobs) == -1) {
+      syslog(LOG_ERR, "io_uring failed, going on with system calls: %s", strerror(errno));
+      uring_exit(&ring);
+      use_uring = false;
+      // Start the batch over: files are truncated when opened again
+      for (size_t i = 0; i < num_jobs; i++) {
+        if (jobs[i].fd != -1) {
+          close(jobs[i].fd);
+        }
+        jobs[i].fd = -1;
+        jobs[i].written = 0;
+        jobs[i].error = 0;
+      }
+    }
+    for (size_t i = 0; i < num_jobs; i++) {
+      if (!use_uring) {
+        write_job_sync(&jobs[i]);
+      }
+      if (jobs[i].error != 0) {
+        syslog(LOG_ERR, "Error while trying to write the file '%s': %s", jobs[i].path,
+               strerror(jobs[i].error));
+        failed++;
+      }
+      free(jobs[i].path);
+      free(jobs[i].content);
+    }
+    total += num_jobs;
+    num_jobs = 0;
+  }
+
+  if (ferror(manifest)) {
+    syslog(LOG_ERR, "Error while reading the manifest: %s", strerror(errno));
+    failed++;
+  }
+  if (manifest != stdin) {
+    fclose(manifest);
+  }
+  if (use_uring) {
+    uring_exit(&ring);
+  }
+
+  syslog(LOG_DEBUG, "Wrote %zu files, %zu failures", total - failed, failed);
+  return failed > 0 ? 1 : 0;
+}
+
 int main(int argc, char *argv[]) {
   setlogmask(LOG_UPTO (LOG_DEBUG));
   openlog("writer", LOG_CONS | LOG_PID | LOG_NDELAY, LOG_USER);
 
 	if ((argc == 2) && (strcmp(argv[1], "-h") == 0)) {
-		printf("Usage: writer [FILE_PATH] [STRING_TO_WRITE_TO]");
+		printf("Usage: writer [FILE_PATH] [STRING_TO_WRITE_TO]\n"
+		       "       writer -b [-0] [-s | -u] [MANIFEST]\n"
+		       "  -b  write every file of MANIFEST (stdin if absent or -), one PATH<tab>CONTENT per line\n"
+		       "  -0  the manifest is PATH<NUL>CONTENT<NUL> pairs, for contents with any byte\n"
+		       "  -s  use plain system calls, the default\n"
+		       "  -u  use io_uring where available. Slower than system calls on small files\n");
     return 0;
 	}
 
+  if ((argc >= 2) && (strcmp(argv[1], "-b") == 0)) {
+    bool nul_separated = false;
+    bool use_uring = false;
+    int arg = 2;
+    for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+      if (strcmp(argv[arg], "-0") == 0) {
+        nul_separated = true;
+      } else if (strcmp(argv[arg], "-s") == 0) {
+        use_uring = false;
+      } else if (strcmp(argv[arg], "-u") == 0) {
+        use_uring = true;
+      } else {
+        syslog(LOG_ERR, "Unknown option %s. Run the app with -h for arguments suggestions",
+               argv[arg]);
+        return 1;
+      }
+    }
+
+    int batch_ret = run_batch(arg < argc ? argv[arg] : NULL, nul_separated, use_uring);
+    closelog();
+    return batch_ret;
+  }
+
   if (argc < 3) {
 		syslog(
 			LOG_ERR,
@@ -37,7 +412,7 @@ int main(int argc, char *argv[]) {
 
   syslog(LOG_DEBUG, "Writting %s to file %s", str_to_write, dir_path);
 
-  int write_ret = write(file_fd, str_to_write, strlen(str_to_write));
+  int write_ret = write_all(file_fd, str_to_write, strlen(str_to_write));
   if (write_ret == -1) {
     perror("Error while writting to file");
     return 1;
@@ -0,0 +1,111 @@
+// Copyright (c) 2025 Mateus Menezes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SERVER_INCLUDE_AEDS_CAPTURE_H_
+#define SERVER_INCLUDE_AEDS_CAPTURE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "aeds/ret_types.h"
+
+#define AESD_CAPTURE_MAGIC "AESDCAP1"
+#define AESD_CAPTURE_VERSION 1u
+
+/// aesd_capture_reader_next() reached the end of the trace
+#define AESD_CAPTURE_RET_END 0
+
+/// A client connected. The payload is its IPv4 address in network byte order
+#define AESD_CAPTURE_OPEN 1
+/// Bytes as returned by one recv(), so the trace keeps the chunk boundaries seen by the server
+#define AESD_CAPTURE_DATA 2
+/// The server closed the connection. No payload
+#define AESD_CAPTURE_CLOSE 3
+
+/**
+ * @brief Traffic trace written by the capture mode of aesdsocket and read by aesdreplay.
+ *
+ * The file starts with an aesd_capture_file_header and is followed by records, each one an
+ * aesd_capture_record_header plus @a len bytes of payload. Records are in time order and all
+ * fields are in host byte order, so a trace is meant to be replayed on the same architecture.
+ */
+struct aesd_capture_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t start_realtime_ns;  // Wall clock when the capture started, for reference only
+};
+
+struct aesd_capture_record_header {
+    uint64_t time_ns;  // Since the start of the capture
+    uint32_t conn_id;
+    uint32_t len;
+    uint8_t type;
+    uint8_t reserved[7];
+};
+
+typedef struct aesd_capture_s aesd_capture_t;
+
+/// Sequential reader of a trace
+typedef struct aesd_capture_reader_s {
+    FILE * file;
+    struct aesd_capture_file_header header;
+} aesd_capture_reader_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Creates (truncating) the trace at @a path. Returns NULL on failure
+aesd_capture_t * aesd_capture_open(const char * path);
+
+/// Flushes and closes the trace. Safe to call with NULL
+void aesd_capture_close(aesd_capture_t * capture);
+
+/**
+ * @brief Buffers one record. Writes are batched, so this rarely costs a syscall.
+ *
+ * After the first write error the capture stops, logs it once and drops every later record,
+ * so a full disk never takes the server down.
+ */
+void aesd_capture_record(aesd_capture_t * capture, uint32_t conn_id, uint8_t type,
+    const void * data, size_t len);
+
+aesd_ret_t aesd_capture_reader_open(aesd_capture_reader_t * reader, const char * path);
+
+/**
+ * @brief Reads the next record. @a payload is grown with realloc() as needed and is owned by
+ * the caller.
+ *
+ * @retval AESD_RET_OK a record was read
+ * @retval AESD_CAPTURE_RET_END end of the trace
+ * @retval AESD_RET_ERROR truncated or corrupted trace
+ */
+aesd_ret_t aesd_capture_reader_next(aesd_capture_reader_t * reader,
+    struct aesd_capture_record_header * record, uint8_t ** payload, size_t * payload_cap);
+
+void aesd_capture_reader_close(aesd_capture_reader_t * reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SERVER_INCLUDE_AEDS_CAPTURE_H_
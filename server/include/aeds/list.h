@@ -0,0 +1,96 @@
+// Copyright (c) 2025 Mateus Menezes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SERVER_INCLUDE_AEDS_LIST_H_
+#define SERVER_INCLUDE_AEDS_LIST_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Intrusive circular doubly linked list. The node is embedded in the owning structure,
+ * so linking and unlinking never allocate and unlinking is O(1).
+ *
+ * A node that is not in any list points to itself, which makes aesd_list_unlink() safe to
+ * call more than once.
+ */
+typedef struct aesd_list_s {
+    struct aesd_list_s * prev;
+    struct aesd_list_s * next;
+} aesd_list_t;
+
+#define AESD_LIST_ENTRY(node, type, member) \
+    ((type *)((char *)(node) - offsetof(type, member)))
+
+static inline void
+aesd_list_init(aesd_list_t * node)
+{
+    node->prev = node;
+    node->next = node;
+}
+
+static inline bool
+aesd_list_empty(const aesd_list_t * head)
+{
+    return head->next == head;
+}
+
+static inline bool
+aesd_list_linked(const aesd_list_t * node)
+{
+    return node->next != node;
+}
+
+static inline void
+aesd_list_push_back(aesd_list_t * head, aesd_list_t * node)
+{
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+static inline void
+aesd_list_unlink(aesd_list_t * node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    aesd_list_init(node);
+}
+
+/// Unlinks and returns the first node, or NULL if the list is empty
+static inline aesd_list_t *
+aesd_list_pop_front(aesd_list_t * head)
+{
+    if (aesd_list_empty(head)) {
+        return NULL;
+    }
+
+    aesd_list_t * node = head->next;
+    aesd_list_unlink(node);
+    return node;
+}
+
+/// Iterates over the list. The current node may be unlinked inside the loop body
+#define AESD_LIST_FOR_EACH_SAFE(node, tmp, head) \
+    for ((node) = (head)->next, (tmp) = (node)->next; (node) != (head); \
+         (node) = (tmp), (tmp) = (node)->next)
+
+#endif  // SERVER_INCLUDE_AEDS_LIST_H_
@@ -0,0 +1,68 @@
+// Copyright (c) 2025 Mateus Menezes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SERVER_INCLUDE_AEDS_LZ_H_
+#define SERVER_INCLUDE_AEDS_LZ_H_
+
+/**
+ * @brief LZ77 codec writing the LZ4 block format, so clients can decode the compressed replies
+ * with any LZ4 implementation (LZ4_decompress_safe() and the like) as well as with
+ * aesd_lz_decompress().
+ *
+ * The compressor is greedy with a single hash table probe per position, which is what log text
+ * needs: most of the gain comes from the timestamps, prefixes and words lines repeat.
+ */
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/// Matches reach back this far at most
+#define AESD_LZ_MAX_DISTANCE 65535
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Room aesd_lz_compress() needs for @a src_len bytes that do not compress at all
+static inline size_t
+aesd_lz_compress_bound(size_t src_len)
+{
+    return src_len + src_len / 255 + 16;
+}
+
+/**
+ * @brief Compresses @a src_len bytes of @a src into @a dst.
+ *
+ * @return the compressed size, 0 if it does not fit in @a dst_cap bytes
+ */
+size_t aesd_lz_compress(const void * src, size_t src_len, void * dst, size_t dst_cap);
+
+/**
+ * @brief Decompresses a block written by aesd_lz_compress() (or any LZ4 block).
+ *
+ * @return the decompressed size, -1 if the block is corrupted or does not fit in @a dst_cap bytes
+ */
+ssize_t aesd_lz_decompress(const void * src, size_t src_len, void * dst, size_t dst_cap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SERVER_INCLUDE_AEDS_LZ_H_
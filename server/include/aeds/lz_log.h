@@ -0,0 +1,118 @@
+// Copyright (c) 2025 Mateus Menezes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SERVER_INCLUDE_AEDS_LZ_LOG_H_
+#define SERVER_INCLUDE_AEDS_LZ_LOG_H_
+
+/**
+ * @brief Compressed copy of the log, for the clients that negotiated compressed replies.
+ *
+ * The log is cut into blocks of AESD_LZ_LOG_BLOCK_SIZE bytes. Each block is compressed once,
+ * when the log grows past its end, and its frame is appended to a file, so any number of
+ * replies are then served from that file with sendfile() and no compression work. A reply is:
+ *
+ *   the frames of the sealed blocks, in order
+ *   a raw frame with the tail of the log past the last sealed block, if any
+ *   an end frame
+ *
+ * Every frame starts with a header of AESD_LZ_FRAME_HEADER_SIZE bytes, integers big endian:
+ *
+ *   offset 0  magic     AESD_LZ_FRAME_MAGIC
+ *   offset 1  type      AESD_LZ_FRAME_LZ, AESD_LZ_FRAME_RAW or AESD_LZ_FRAME_END
+ *   offset 2  reserved  0
+ *   offset 4  raw_len   bytes of the log the frame holds
+ *   offset 8  data_len  bytes following the header: an LZ4 block (see aeds/lz.h) that
+ *                       decompresses to raw_len bytes, or the raw_len bytes themselves
+ *
+ * Blocks are independent, so a client decodes each with a buffer of AESD_LZ_LOG_BLOCK_SIZE.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "aeds/ret_types.h"
+
+/// Log bytes per compressed block. Matches the reach of the codec
+#define AESD_LZ_LOG_BLOCK_SIZE (64 * 1024)
+/// Blocks sealed per aesd_lz_log_sync() call at most, so a long log is sealed in short steps
+#define AESD_LZ_LOG_SYNC_BLOCKS 4
+
+#define AESD_LZ_FRAME_HEADER_SIZE 12
+/// Not printable, so a client can tell a framed reply from a raw log of text
+#define AESD_LZ_FRAME_MAGIC 0xae
+#define AESD_LZ_FRAME_LZ 'Z'
+#define AESD_LZ_FRAME_RAW 'R'
+#define AESD_LZ_FRAME_END 'E'
+
+typedef struct aesd_lz_log_s aesd_lz_log_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static inline void
+aesd_lz_frame_header(uint8_t header[AESD_LZ_FRAME_HEADER_SIZE], uint8_t type, uint32_t raw_len,
+    uint32_t data_len)
+{
+    header[0] = AESD_LZ_FRAME_MAGIC;
+    header[1] = type;
+    header[2] = header[3] = 0;
+    for (int i = 0; i < 4; i++) {
+        header[4 + i] = raw_len >> (24 - 8 * i);
+        header[8 + i] = data_len >> (24 - 8 * i);
+    }
+}
+
+/**
+ * @brief Creates an empty compressed log whose frames go to @a frames_fd, an empty file it
+ * takes ownership of.
+ *
+ * @return NULL if no memory was available. @a frames_fd is closed then
+ */
+aesd_lz_log_t * aesd_lz_log_create(int frames_fd);
+void aesd_lz_log_destroy(aesd_lz_log_t * lz_log);
+
+/**
+ * @brief Seals up to AESD_LZ_LOG_SYNC_BLOCKS complete blocks of the log @a log_fd, described by
+ * @a log_stat, that were not sealed yet. A log replaced by another file or truncated starts over
+ * from scratch. Call it again while aesd_lz_log_behind() to seal the rest.
+ *
+ * @retval AESD_RET_ERROR if a block could not be read or its frame written. The blocks sealed
+ * before stay valid, and the next call tries again
+ */
+aesd_ret_t aesd_lz_log_sync(aesd_lz_log_t * lz_log, int log_fd, const struct stat * log_stat);
+
+/// Whether a log of @a log_size bytes has complete blocks left to seal
+bool aesd_lz_log_behind(const aesd_lz_log_t * lz_log, off_t log_size);
+
+/// File holding the frames of the sealed blocks, from offset 0
+int aesd_lz_log_fd(const aesd_lz_log_t * lz_log);
+/// Bytes of frames in aesd_lz_log_fd()
+off_t aesd_lz_log_frames_len(const aesd_lz_log_t * lz_log);
+/// Bytes of the log covered by the sealed blocks
+off_t aesd_lz_log_sealed(const aesd_lz_log_t * lz_log);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SERVER_INCLUDE_AEDS_LZ_LOG_H_
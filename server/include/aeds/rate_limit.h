@@ -0,0 +1,89 @@
+// Copyright (c) 2025 Mateus Menezes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SERVER_INCLUDE_AEDS_RATE_LIMIT_H_
+#define SERVER_INCLUDE_AEDS_RATE_LIMIT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define AESD_NSEC_PER_SEC 1000000000ull
+
+/**
+ * @brief Token bucket that refills at @a rate tokens per second up to @a burst tokens.
+ *
+ * Consumers may take more than what is available. The bucket then goes into debt and
+ * aesd_token_bucket_delay_ns() tells how long to back off, so a caller never has to size its
+ * reads to the tokens left.
+ */
+typedef struct aesd_token_bucket_s {
+    double tokens;
+    double rate;  // 0 disables the bucket
+    double burst;
+    uint64_t last_ns;
+} aesd_token_bucket_t;
+
+/// Counts the connections per IPv4 address
+typedef struct aesd_ip_table_s aesd_ip_table_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// CLOCK_MONOTONIC in nanoseconds
+uint64_t aesd_monotonic_ns(void);
+
+/// Starts the bucket full. A @a rate of 0 creates a disabled bucket that never delays
+void aesd_token_bucket_init(aesd_token_bucket_t * bucket, double rate, double burst, uint64_t now_ns);
+
+static inline bool
+aesd_token_bucket_enabled(const aesd_token_bucket_t * bucket)
+{
+    return bucket->rate > 0;
+}
+
+void aesd_token_bucket_consume(aesd_token_bucket_t * bucket, double tokens, uint64_t now_ns);
+
+/// Whole tokens available now. UINT64_MAX for a disabled bucket
+uint64_t aesd_token_bucket_available(aesd_token_bucket_t * bucket, uint64_t now_ns);
+
+/// Nanoseconds until @a tokens are available. 0 if they are available now
+uint64_t aesd_token_bucket_delay_ns(aesd_token_bucket_t * bucket, double tokens, uint64_t now_ns);
+
+aesd_ip_table_t * aesd_ip_table_create(void);
+void aesd_ip_table_destroy(aesd_ip_table_t * table);
+
+/**
+ * @brief Counts one more connection from @a addr (network byte order) unless it already has
+ * @a max_per_ip of them. A @a max_per_ip of 0 means no limit.
+ *
+ * @return false if the connection must be refused
+ */
+bool aesd_ip_table_acquire(aesd_ip_table_t * table, uint32_t addr, size_t max_per_ip);
+
+/// Undoes a successful aesd_ip_table_acquire()
+void aesd_ip_table_release(aesd_ip_table_t * table, uint32_t addr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SERVER_INCLUDE_AEDS_RATE_LIMIT_H_
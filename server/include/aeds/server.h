@@ -21,11 +21,40 @@
 #ifndef SERVER_INCLUDE_AEDS_SERVER_H_
 #define SERVER_INCLUDE_AEDS_SERVER_H_
 
+#include <signal.h>
 #include <stddef.h>
 
+#include "aeds/capture.h"
 #include "aeds/ret_types.h"
 
-#define LIMIT_OF_INCOMING_CONNECTIONS 1
+/// Backlog of the listening socket. Accepted clients are served concurrently
+#define LIMIT_OF_INCOMING_CONNECTIONS 16
+/// Bytes read from a connection each time it becomes readable
+#define AESD_SERVER_RX_BUF_SIZE (64 * 1024)
+
+/// Default deadlines, in seconds, after which a client is disconnected
+#define AESD_SERVER_DEFAULT_IDLE_TIMEOUT_SEC 300
+#define AESD_SERVER_DEFAULT_READ_TIMEOUT_SEC 60
+#define AESD_SERVER_DEFAULT_SEND_TIMEOUT_SEC 60
+/// Default memory budgets for the bytes received and not handed out yet
+#define AESD_SERVER_DEFAULT_CONN_MEM_BUDGET (1024 * 1024)
+#define AESD_SERVER_DEFAULT_TOTAL_MEM_BUDGET (64 * 1024 * 1024)
+
+/// Lines starting with this prefix are commands to the server and are never appended to the log
+#define AESD_SERVER_CTRL_PREFIX "AESDCTL "
+/**
+ * "AESDCTL SUBSCRIBE [offset]" switches the connection to tail mode: instead of the whole file
+ * after each line, the client gets only the bytes committed after @a offset (default: the
+ * current end of the log), pushed as soon as other clients commit them.
+ */
+#define AESD_SERVER_CTRL_SUBSCRIBE "SUBSCRIBE"
+/**
+ * "AESDCTL COMPRESS [OFF]" makes the server answer the next lines of the connection with the
+ * log as frames (see aeds/lz_log.h): the blocks sealed so far, compressed once for every client,
+ * then the rest raw. The command itself is answered with a lone end frame, which a server
+ * without compression never sends. Subscribers are always pushed raw bytes.
+ */
+#define AESD_SERVER_CTRL_COMPRESS "COMPRESS"
 
 #define AESD_LOG_WITH_FUNC_DEBUG(msg, ...) syslog(LOG_DEBUG, "[%s] " msg, __func__, ##__VA_ARGS__)
 #define AESD_LOG_WITH_FUNC_INFO(msg, ...) syslog(LOG_INFO, "[%s] " msg, __func__, ##__VA_ARGS__)
@@ -33,6 +62,19 @@
 
 typedef struct aesd_server_impl_s aesd_server_impl_t;
 
+/// Admission control and per-connection quotas. 0 disables the corresponding limit
+typedef struct aesd_server_limits_s {
+    size_t max_connections;  // Connections served at the same time. Others are refused
+    size_t max_connections_per_ip;
+    double bytes_per_sec;  // Reads from a client are paused while it is over this rate
+    double lines_per_sec;  // Lines of a client are held back while it is over this rate
+    double idle_timeout_sec;  // Nothing received or sent. Subscribers are exempt
+    double read_timeout_sec;  // Time to finish a line once its first byte arrived
+    double send_timeout_sec;  // Time without progress while a reply is pending
+    size_t conn_mem_budget;  // Bytes a connection may buffer. Longer lines spill to disk
+    size_t total_mem_budget;  // Bytes all connections together may buffer
+} aesd_server_limits_t;
+
 typedef struct aesd_server_s {
     aesd_server_impl_t * impl;
 } aesd_server_t;
@@ -58,10 +100,41 @@ aesd_server_t * aesd_server_create();
 // followed by aesd_server_free().
 void aesd_server_destroy(aesd_server_t * aesd_server);
 
+/**
+ * @brief Starts watching the server socket. Clients are then accepted and served concurrently
+ * while aesd_server_get_line() waits for data.
+ */
 void aesd_server_start_accept_connections(aesd_server_t * aesd_server);
 
 /**
- * @brief Fills @a buf with a string that ends with '\n' sent by the client.
+ * @brief Applies @a limits to connections accepted from now on.
+ */
+void aesd_server_set_limits(aesd_server_t * aesd_server, const aesd_server_limits_t * limits);
+
+/**
+ * @brief Signal mask to install while the server sleeps waiting for events (see epoll_pwait()).
+ *
+ * An application that blocks its termination signals and passes here the mask with them
+ * unblocked is guaranteed to get AESD_SERVER_RET_ERROR from aesd_server_get_line() for a
+ * signal, no matter when it arrives.
+ */
+void aesd_server_set_wait_sigmask(aesd_server_t * aesd_server, const sigset_t * sigmask);
+
+/**
+ * @brief Tells the server which file holds the log, so subscribers can be served from it
+ * before the first line is committed.
+ */
+void aesd_server_attach_log(aesd_server_t * aesd_server, int file_fd);
+
+/**
+ * @brief Records every connection, every chunk received and every close to @a capture, for
+ * aesdreplay. The server does not take ownership. NULL stops the capture.
+ */
+void aesd_server_set_capture(aesd_server_t * aesd_server, aesd_capture_t * capture);
+
+/**
+ * @brief Fills @a buf with a string that ends with '\n' sent by one of the clients. Blocks
+ * while no client has a complete line.
  * 
  * @param aesd_server 
  * @param buf Buffer to store the string
@@ -69,13 +142,35 @@ void aesd_server_start_accept_connections(aesd_server_t * aesd_server);
  * @param line_size If not null, store the length of the line read
  * @retval AESD_SERVER_RET_ERROR if some error ocurred
  * @retval AESD_SERVER_RET_EOL_FOUND if a string ending with '\n' was found and stored in buffer
- * @retval AESD_SERVER_RET_EOL_NOT_FOUND if all space of @buf was filled but none '\n' was not found.
- * In this case line_size = 0. The application code can call this function again to try retrieve
- * a string enfing in '\n'
+ * @retval AESD_SERVER_RET_BUF_FULL if the line does not fit in @a buf. In this case
+ * line_size = 0 and @a buf holds its first @a buf_len bytes. The next call continues the same
+ * line, so it is never interleaved with lines from other clients
+ *
+ * Bytes received after the '\n' are kept for the next call.
  */
 aesd_server_ret_t
 aesd_server_get_line(aesd_server_t * aesd_server, void * buf, size_t buf_len, size_t * line_size);
 
+/**
+ * @brief Pipelined version of aesd_server_get_line(). Fills @a buf with every complete line the
+ * client has already sent, so a burst of lines can be appended and answered as one batch.
+ *
+ * Blocks only while no complete line is available. Return values are the same as
+ * aesd_server_get_line(), with @a batch_size being the offset of the last '\n' in @a buf.
+ */
+aesd_server_ret_t
+aesd_server_get_lines(aesd_server_t * aesd_server, void * buf, size_t buf_len, size_t * batch_size);
+
+/**
+ * @brief Answers the line last returned by aesd_server_get_line() with the content of
+ * @a file_fd, and marks the new content as committed so subscribers get it in the next batch.
+ *
+ * The transfer goes on in the background if the client cannot take it all at once. The client
+ * is not handed further lines until it received the reply.
+ *
+ * @retval AESD_SERVER_RET_ERROR if @a file_fd cannot be used. Failures to reach the client only
+ * close that connection.
+ */
 aesd_server_ret_t
 aesd_server_send_file_content(aesd_server_t * aesd_server, int file_fd);
 
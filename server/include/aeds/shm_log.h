@@ -0,0 +1,135 @@
+// Copyright (c) 2025 Mateus Menezes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SERVER_INCLUDE_AEDS_SHM_LOG_H_
+#define SERVER_INCLUDE_AEDS_SHM_LOG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "aeds/ret_types.h"
+
+/// Name passed to shm_open(). On Linux the mapping shows up as /dev/shm/aesdsocketdata
+#define AESD_SHM_LOG_NAME "/aesdsocketdata"
+#define AESD_SHM_LOG_MAGIC 0x4c534541u  // "AESL" in little endian
+#define AESD_SHM_LOG_VERSION 1u
+/**
+ * Largest data area the writer grows the mapping to. The mapping is a second copy of the log,
+ * held in RAM by tmpfs on top of the log file itself, and its capacity doubles from 1 MiB, so
+ * it costs up to twice the log size with this as a bound. Past it the overflow flag is raised.
+ */
+#define AESD_SHM_LOG_MAX_CAPACITY (256ull * 1024 * 1024)
+
+/// The log outgrew AESD_SHM_LOG_MAX_CAPACITY or the mapping could not grow. Readers must fall
+/// back to the TCP interface
+#define AESD_SHM_LOG_FLAG_OVERFLOW 0x1u
+/// The server has shut down and will not publish anything else in this mapping
+#define AESD_SHM_LOG_FLAG_CLOSED 0x2u
+
+/**
+ * @brief Layout of the first page of the shared-memory log.
+ *
+ * The log bytes start at @a data_offset. The writer copies new bytes into the data area and
+ * only then publishes them by storing @a committed with release semantics, followed by an
+ * increment of @a sequence. A reader that loads @a committed with acquire semantics can read
+ * every byte below it without taking any lock or issuing any syscall. @a capacity is always
+ * published before @a committed grows past the previous capacity, so a reader only needs to
+ * remap when it sees a committed length beyond its own mapping. @a sequence also moves on
+ * every flag change, so a reader seeing the same sequence twice knows nothing changed.
+ */
+struct aesd_shm_log_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t data_offset;
+    uint64_t capacity;
+    uint64_t committed;
+    uint64_t sequence;
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+typedef struct aesd_shm_log_impl_s aesd_shm_log_impl_t;
+
+typedef struct aesd_shm_log_s {
+    aesd_shm_log_impl_t * impl;
+} aesd_shm_log_t;
+
+/// State kept by a local consumer tailing the log
+typedef struct aesd_shm_log_reader_s {
+    int fd;
+    const uint8_t * map;
+    size_t map_len;
+    uint64_t cursor;
+    uint64_t last_sequence;  // Header sequence the cursor is up to date with
+} aesd_shm_log_reader_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Creates (or recreates, truncating any previous content) the shared-memory log
+ * identified by @a name.
+ *
+ * @return the new object or NULL if the shared memory could not be created or mapped
+ */
+aesd_shm_log_t * aesd_shm_log_create(const char * name);
+
+/// Marks the log as closed, unmaps it and removes @a name from the shared-memory namespace
+void aesd_shm_log_destroy(aesd_shm_log_t * shm_log);
+
+/**
+ * @brief Copies @a len bytes to the end of the log and publishes them to the readers.
+ *
+ * @retval AESD_RET_OK if the bytes were published
+ * @retval AESD_RET_ERROR if the mapping could not grow. The overflow flag is raised in the
+ * header and every later call fails as well.
+ */
+aesd_ret_t aesd_shm_log_append(aesd_shm_log_t * shm_log, const void * data, size_t len);
+
+/// Bytes published so far
+uint64_t aesd_shm_log_committed(const aesd_shm_log_t * shm_log);
+
+/**
+ * @brief Maps the log @a name read-only. The cursor starts at the beginning of the log.
+ */
+aesd_ret_t aesd_shm_log_reader_open(aesd_shm_log_reader_t * reader, const char * name);
+
+/**
+ * @brief Points @a data to the bytes published since the last call and advances the cursor.
+ *
+ * Only issues a syscall when the writer grew the mapping past the reader's current view, and
+ * only loads the sequence when it did not move since the last call. The returned bytes stay
+ * valid until the next call.
+ *
+ * @return number of new bytes, 0 if nothing was published since the last call
+ */
+size_t aesd_shm_log_reader_poll(aesd_shm_log_reader_t * reader, const uint8_t ** data);
+
+/// Current header flags (AESD_SHM_LOG_FLAG_*)
+uint32_t aesd_shm_log_reader_flags(const aesd_shm_log_reader_t * reader);
+
+void aesd_shm_log_reader_close(aesd_shm_log_reader_t * reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SERVER_INCLUDE_AEDS_SHM_LOG_H_
@@ -0,0 +1,103 @@
+// Copyright (c) 2025 Mateus Menezes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SERVER_INCLUDE_AEDS_TIMER_WHEEL_H_
+#define SERVER_INCLUDE_AEDS_TIMER_WHEEL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "aeds/list.h"
+
+/// Bits of the tick counter handled by each level of the wheel
+#define AESD_TIMER_WHEEL_BITS 6
+#define AESD_TIMER_WHEEL_SLOTS (1u << AESD_TIMER_WHEEL_BITS)
+/// With 4 levels of 64 slots, deadlines up to 2^24 ticks away are placed directly
+#define AESD_TIMER_WHEEL_LEVELS 4
+
+struct aesd_timer_s;
+typedef void (*aesd_timer_callback_t)(struct aesd_timer_s * timer);
+
+/**
+ * @brief Timer embedded in the object it belongs to. The callback gets the timer back and
+ * finds its owner with AESD_LIST_ENTRY()-style pointer arithmetic.
+ */
+typedef struct aesd_timer_s {
+    aesd_list_t node;
+    uint64_t expires;  // Absolute tick
+    aesd_timer_callback_t callback;
+} aesd_timer_t;
+
+/**
+ * @brief Hierarchical timing wheel (Varghese & Lauck, scheme 7).
+ *
+ * Level 0 has one slot per tick. Each slot of level n covers 64^n ticks and is cascaded into
+ * the level below when the wheel reaches it. Arming and cancelling are O(1) list operations,
+ * and advancing the wheel only touches the slots of the ticks that passed, no matter how many
+ * timers are pending.
+ */
+typedef struct aesd_timer_wheel_s {
+    uint64_t now;  // Next tick to be processed
+    uint64_t num_pending;
+    aesd_list_t slots[AESD_TIMER_WHEEL_LEVELS][AESD_TIMER_WHEEL_SLOTS];
+} aesd_timer_wheel_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void aesd_timer_wheel_init(aesd_timer_wheel_t * wheel, uint64_t now);
+
+void aesd_timer_init(aesd_timer_t * timer, aesd_timer_callback_t callback);
+
+static inline bool
+aesd_timer_pending(const aesd_timer_t * timer)
+{
+    return aesd_list_linked(&timer->node);
+}
+
+/// (Re)arms @a timer to fire at tick @a expires. Deadlines in the past fire on the next advance
+void aesd_timer_arm(aesd_timer_wheel_t * wheel, aesd_timer_t * timer, uint64_t expires);
+
+/// Safe to call on a timer that is not pending
+void aesd_timer_cancel(aesd_timer_wheel_t * wheel, aesd_timer_t * timer);
+
+/**
+ * @brief Runs the callbacks of every timer that expired up to tick @a now, included.
+ *
+ * Callbacks may arm and cancel any timer, including the ones about to expire.
+ */
+void aesd_timer_wheel_advance(aesd_timer_wheel_t * wheel, uint64_t now);
+
+/**
+ * @brief Tick the caller can sleep until before calling aesd_timer_wheel_advance() again.
+ *
+ * Only level 0 is searched, so the answer may be earlier than the first deadline (at most
+ * 64 ticks away), but never later.
+ *
+ * @return UINT64_MAX if no timer is pending
+ */
+uint64_t aesd_timer_wheel_next_tick(const aesd_timer_wheel_t * wheel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SERVER_INCLUDE_AEDS_TIMER_WHEEL_H_
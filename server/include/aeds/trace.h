@@ -0,0 +1,69 @@
+// Copyright (c) 2025 Mateus Menezes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SERVER_INCLUDE_AEDS_TRACE_H_
+#define SERVER_INCLUDE_AEDS_TRACE_H_
+
+/**
+ * @brief Static tracepoints (USDT) of the "aesdsocket" provider.
+ *
+ * With <sys/sdt.h> (systemtap-sdt-dev) available, every probe is a single nop plus a note in
+ * the ELF file describing where its arguments live, so perf, bpftrace or SystemTap can attach
+ * to a running server without rebuilding it. List them with `bpftrace -l 'usdt:./aesdsocket:*'`.
+ * Without the header, or when built with -DAESD_NO_TRACE, the probes compile to nothing. The
+ * Makefile warns about a missing header, and `make TRACE=1` (-DAESD_REQUIRE_TRACE) turns it into
+ * a build error, for builds that must be traceable.
+ *
+ * Probes (a "__" in the name shows up as "-" to the tracers):
+ *  accept(conn_id, ipv4_addr)            refuse(ipv4_addr)
+ *  recv(conn_id, bytes, buffered)        close(conn_id, buffered)
+ *  timeout(conn_id, reason)
+ *  get_line(conn_id, size, ret)          append__start(size)   append__done(size, ret)
+ *  send__start(conn_id, offset, bytes)   send__done(conn_id, bytes_left, alive)
+ */
+
+#if !defined(AESD_NO_TRACE) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define AESD_TRACE_ENABLED 1
+#endif
+#endif
+
+#if defined(AESD_REQUIRE_TRACE) && !defined(AESD_TRACE_ENABLED)
+#error "USDT probes requested with AESD_REQUIRE_TRACE, but <sys/sdt.h> is missing or AESD_NO_TRACE is set"
+#endif
+
+#ifdef AESD_TRACE_ENABLED
+
+#define AESD_TRACE1(name, a) DTRACE_PROBE1(aesdsocket, name, a)
+#define AESD_TRACE2(name, a, b) DTRACE_PROBE2(aesdsocket, name, a, b)
+#define AESD_TRACE3(name, a, b, c) DTRACE_PROBE3(aesdsocket, name, a, b, c)
+
+#else
+
+// The arguments are still referenced, so values computed only for a probe do not trip
+// -Wunused-variable, but the compiler drops them
+#define AESD_TRACE1(name, a) do { (void)(a); } while (0)
+#define AESD_TRACE2(name, a, b) do { (void)(a); (void)(b); } while (0)
+#define AESD_TRACE3(name, a, b, c) do { (void)(a); (void)(b); (void)(c); } while (0)
+
+#endif
+
+#endif  // SERVER_INCLUDE_AEDS_TRACE_H_
@@ -0,0 +1,219 @@
+// Copyright (c) 2025 Mateus Menezes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "aeds/capture.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "aeds/rate_limit.h"
+#include "aeds/server.h"
+
+/// Records are batched in memory and written once this much is buffered
+#define AESD_CAPTURE_BUF_SIZE (256 * 1024)
+
+struct aesd_capture_s {
+    int fd;
+    uint64_t start_ns;
+    bool failed;
+    size_t buf_len;
+    uint8_t buf[AESD_CAPTURE_BUF_SIZE];
+};
+
+static bool
+write_all(int fd, const void * data, size_t len)
+{
+    const uint8_t * cursor = data;
+    while (len > 0) {
+        ssize_t written = write(fd, cursor, len);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        cursor += written;
+        len -= written;
+    }
+
+    return true;
+}
+
+static void
+flush(aesd_capture_t * capture)
+{
+    if (capture->failed || capture->buf_len == 0) {
+        return;
+    }
+
+    if (!write_all(capture->fd, capture->buf, capture->buf_len)) {
+        AESD_LOG_WITH_FUNC_ERR("Error on writing the capture, stopping it: %s", strerror(errno));
+        capture->failed = true;
+    }
+    capture->buf_len = 0;
+}
+
+/// Appends to the batch, or writes straight through when @a len does not fit in an empty one
+static void
+put(aesd_capture_t * capture, const void * data, size_t len)
+{
+    if (capture->buf_len + len > AESD_CAPTURE_BUF_SIZE) {
+        flush(capture);
+    }
+
+    if (len > AESD_CAPTURE_BUF_SIZE) {
+        if (!capture->failed && !write_all(capture->fd, data, len)) {
+            AESD_LOG_WITH_FUNC_ERR("Error on writing the capture, stopping it: %s",
+                strerror(errno));
+            capture->failed = true;
+        }
+        return;
+    }
+
+    memcpy(capture->buf + capture->buf_len, data, len);
+    capture->buf_len += len;
+}
+
+aesd_capture_t *
+aesd_capture_open(const char * path)
+{
+    aesd_capture_t * capture = calloc(1, sizeof(aesd_capture_t));
+    if (capture == NULL) {
+        AESD_LOG_WITH_FUNC_ERR("Error during memory allocation: %s", strerror(errno));
+        return NULL;
+    }
+
+    capture->fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP);
+    if (capture->fd == -1) {
+        AESD_LOG_WITH_FUNC_ERR("Error on creating the capture %s: %s", path, strerror(errno));
+        free(capture);
+        return NULL;
+    }
+
+    struct timespec realtime;
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    capture->start_ns = aesd_monotonic_ns();
+
+    struct aesd_capture_file_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, AESD_CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = AESD_CAPTURE_VERSION;
+    header.start_realtime_ns = (uint64_t)realtime.tv_sec * AESD_NSEC_PER_SEC + realtime.tv_nsec;
+    put(capture, &header, sizeof(header));
+
+    syslog(LOG_INFO, "Capturing incoming traffic to %s", path);
+    return capture;
+}
+
+void
+aesd_capture_close(aesd_capture_t * capture)
+{
+    if (capture == NULL) {
+        return;
+    }
+
+    flush(capture);
+    close(capture->fd);
+    free(capture);
+}
+
+void
+aesd_capture_record(aesd_capture_t * capture, uint32_t conn_id, uint8_t type,
+    const void * data, size_t len)
+{
+    if (capture->failed) {
+        return;
+    }
+
+    struct aesd_capture_record_header record;
+    memset(&record, 0, sizeof(record));
+    record.time_ns = aesd_monotonic_ns() - capture->start_ns;
+    record.conn_id = conn_id;
+    record.len = len;
+    record.type = type;
+
+    put(capture, &record, sizeof(record));
+    put(capture, data, len);
+}
+
+aesd_ret_t
+aesd_capture_reader_open(aesd_capture_reader_t * reader, const char * path)
+{
+    reader->file = fopen(path, "rb");
+    if (reader->file == NULL) {
+        return AESD_RET_ERROR;
+    }
+
+    if (fread(&reader->header, sizeof(reader->header), 1, reader->file) != 1 ||
+        memcmp(reader->header.magic, AESD_CAPTURE_MAGIC, sizeof(reader->header.magic)) != 0 ||
+        reader->header.version != AESD_CAPTURE_VERSION)
+    {
+        fclose(reader->file);
+        reader->file = NULL;
+        errno = EINVAL;
+        return AESD_RET_ERROR;
+    }
+
+    return AESD_RET_OK;
+}
+
+aesd_ret_t
+aesd_capture_reader_next(aesd_capture_reader_t * reader,
+    struct aesd_capture_record_header * record, uint8_t ** payload, size_t * payload_cap)
+{
+    size_t num_read = fread(record, 1, sizeof(*record), reader->file);
+    if (num_read == 0 && feof(reader->file)) {
+        return AESD_CAPTURE_RET_END;
+    }
+    if (num_read != sizeof(*record)) {
+        return AESD_RET_ERROR;
+    }
+
+    if (record->len > *payload_cap) {
+        uint8_t * new_payload = realloc(*payload, record->len);
+        if (new_payload == NULL) {
+            return AESD_RET_ERROR;
+        }
+        *payload = new_payload;
+        *payload_cap = record->len;
+    }
+
+    if (record->len > 0 && fread(*payload, record->len, 1, reader->file) != 1) {
+        return AESD_RET_ERROR;
+    }
+
+    return AESD_RET_OK;
+}
+
+void
+aesd_capture_reader_close(aesd_capture_reader_t * reader)
+{
+    if (reader->file != NULL) {
+        fclose(reader->file);
+        reader->file = NULL;
+    }
+}
@@ -0,0 +1,235 @@
+// Copyright (c) 2025 Mateus Menezes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "aeds/lz.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/// Shortest match worth a sequence
+#define MIN_MATCH 4
+/// The format ends every block with at least this many literals...
+#define LAST_LITERALS 5
+/// ...and starts no match this close to its end
+#define MATCH_FIND_LIMIT 12
+/// Entries of the hash table of the compressor, 32 KiB on the stack
+#define HASH_LOG 13
+/// Misses after which the compressor skips faster over data that does not compress
+#define SKIP_TRIGGER 6
+
+static inline uint32_t
+read32(const uint8_t * p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t
+hash32(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - HASH_LOG);
+}
+
+/// Writes the extra bytes of a length that did not fit in its 4 bits of the token
+static uint8_t *
+write_length(uint8_t * op, size_t length)
+{
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+/**
+ * @brief Writes a sequence: @a num_literals bytes from @a literals, then a match of
+ * @a match_len bytes @a distance bytes back. A @a match_len of 0 writes the final literals.
+ *
+ * @return the new output position, NULL if it does not fit before @a op_end
+ */
+static uint8_t *
+write_sequence(uint8_t * op, uint8_t * op_end, const uint8_t * literals, size_t num_literals,
+    size_t distance, size_t match_len)
+{
+    size_t extra = match_len >= MIN_MATCH ? match_len - MIN_MATCH : 0;
+    size_t worst = 1 + num_literals / 255 + 1 + num_literals + 2 + extra / 255 + 1;
+    if (worst > (size_t)(op_end - op)) {
+        return NULL;
+    }
+
+    uint8_t * token = op++;
+    *token = (num_literals >= 15 ? 15 : num_literals) << 4;
+    if (num_literals >= 15) {
+        op = write_length(op, num_literals - 15);
+    }
+    memcpy(op, literals, num_literals);
+    op += num_literals;
+
+    if (match_len == 0) {
+        return op;
+    }
+
+    *op++ = distance & 0xff;
+    *op++ = distance >> 8;
+    *token |= extra >= 15 ? 15 : extra;
+    if (extra >= 15) {
+        op = write_length(op, extra - 15);
+    }
+    return op;
+}
+
+size_t
+aesd_lz_compress(const void * src, size_t src_len, void * dst, size_t dst_cap)
+{
+    const uint8_t * const in = src;
+    const uint8_t * const in_end = in + src_len;
+    const uint8_t * ip = in;
+    const uint8_t * anchor = in;  // First byte not written out yet
+    uint8_t * op = dst;
+    uint8_t * const op_end = op + dst_cap;
+
+    if (src_len > MATCH_FIND_LIMIT) {
+        // Positions are relative to in. Stale or unset entries are weeded out by comparing bytes
+        uint32_t table[1 << HASH_LOG];
+        memset(table, 0, sizeof(table));
+
+        const uint8_t * const match_limit = in_end - MATCH_FIND_LIMIT;
+        const uint8_t * const extend_limit = in_end - LAST_LITERALS;
+        unsigned misses = 0;
+
+        while (ip < match_limit) {
+            uint32_t sequence = read32(ip);
+            uint32_t * entry = &table[hash32(sequence)];
+            const uint8_t * ref = in + *entry;
+            *entry = ip - in;
+
+            if (ref >= ip || ip - ref > AESD_LZ_MAX_DISTANCE || read32(ref) != sequence) {
+                ip += 1 + (misses++ >> SKIP_TRIGGER);
+                continue;
+            }
+            misses = 0;
+
+            while (ip > anchor && ref > in && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+
+            const uint8_t * match_end = ip + MIN_MATCH;
+            const uint8_t * ref_end = ref + MIN_MATCH;
+            while (match_end < extend_limit && *match_end == *ref_end) {
+                match_end++;
+                ref_end++;
+            }
+
+            op = write_sequence(op, op_end, anchor, ip - anchor, ip - ref, match_end - ip);
+            if (op == NULL) {
+                return 0;
+            }
+
+            ip = anchor = match_end;
+            // Makes the bytes right before the next search findable by later ones
+            if (ip - 2 > in && ip < match_limit) {
+                table[hash32(read32(ip - 2))] = ip - 2 - in;
+            }
+        }
+    }
+
+    op = write_sequence(op, op_end, anchor, in_end - anchor, 0, 0);
+    return op != NULL ? (size_t)(op - (uint8_t *)dst) : 0;
+}
+
+/// Reads the extra bytes of a length. @return false if the block ends in the middle
+static bool
+read_length(const uint8_t ** ip, const uint8_t * ip_end, size_t * length)
+{
+    uint8_t byte;
+    do {
+        if (*ip >= ip_end) {
+            return false;
+        }
+        byte = *(*ip)++;
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+ssize_t
+aesd_lz_decompress(const void * src, size_t src_len, void * dst, size_t dst_cap)
+{
+    const uint8_t * ip = src;
+    const uint8_t * const ip_end = ip + src_len;
+    uint8_t * const out = dst;
+    uint8_t * op = out;
+    uint8_t * const op_end = op + dst_cap;
+
+    while (ip < ip_end) {
+        uint8_t token = *ip++;
+
+        size_t num_literals = token >> 4;
+        if (num_literals == 15 && !read_length(&ip, ip_end, &num_literals)) {
+            return -1;
+        }
+        if (num_literals > (size_t)(ip_end - ip) || num_literals > (size_t)(op_end - op)) {
+            return -1;
+        }
+        memcpy(op, ip, num_literals);
+        ip += num_literals;
+        op += num_literals;
+
+        // The last sequence has no match
+        if (ip == ip_end) {
+            break;
+        }
+
+        if (ip_end - ip < 2) {
+            return -1;
+        }
+        size_t distance = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        if (distance == 0 || distance > (size_t)(op - out)) {
+            return -1;
+        }
+
+        size_t match_len = token & 15;
+        if (match_len == 15 && !read_length(&ip, ip_end, &match_len)) {
+            return -1;
+        }
+        match_len += MIN_MATCH;
+        if (match_len > (size_t)(op_end - op)) {
+            return -1;
+        }
+
+        const uint8_t * ref = op - distance;
+        if (distance >= match_len) {
+            memcpy(op, ref, match_len);
+            op += match_len;
+        } else {
+            // Overlapping copy: the match repeats the last distance bytes
+            for (size_t i = 0; i < match_len; i++) {
+                *op++ = ref[i];
+            }
+        }
+    }
+
+    return op - out;
+}
@@ -0,0 +1,197 @@
+// Copyright (c) 2025 Mateus Menezes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "aeds/lz_log.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "aeds/lz.h"
+#include "aeds/server.h"
+
+/// A frame header followed by aesd_lz_compress_bound() of a block
+#define FRAME_MAX_SIZE \
+    (AESD_LZ_FRAME_HEADER_SIZE + AESD_LZ_LOG_BLOCK_SIZE + AESD_LZ_LOG_BLOCK_SIZE / 255 + 16)
+
+struct aesd_lz_log_s {
+    int frames_fd;
+    off_t frames_len;
+    off_t sealed;
+    dev_t log_dev;  // Log the blocks were read from
+    ino_t log_ino;
+    uint8_t block[AESD_LZ_LOG_BLOCK_SIZE];
+    uint8_t frame[FRAME_MAX_SIZE];
+};
+
+aesd_lz_log_t *
+aesd_lz_log_create(int frames_fd)
+{
+    aesd_lz_log_t * lz_log = calloc(1, sizeof(*lz_log));
+    if (lz_log == NULL) {
+        AESD_LOG_WITH_FUNC_ERR("Error during memory allocation: %s", strerror(errno));
+        close(frames_fd);
+        return NULL;
+    }
+
+    lz_log->frames_fd = frames_fd;
+    return lz_log;
+}
+
+void
+aesd_lz_log_destroy(aesd_lz_log_t * lz_log)
+{
+    if (lz_log == NULL) {
+        return;
+    }
+
+    close(lz_log->frames_fd);
+    free(lz_log);
+}
+
+static aesd_ret_t
+read_block(aesd_lz_log_t * lz_log, int log_fd)
+{
+    size_t len = 0;
+    while (len < sizeof(lz_log->block)) {
+        ssize_t bytes_read = pread(log_fd, lz_log->block + len, sizeof(lz_log->block) - len,
+            lz_log->sealed + len);
+        if (bytes_read == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read <= 0) {
+            AESD_LOG_WITH_FUNC_ERR("Error on reading the log at %lld: %s",
+                (long long)(lz_log->sealed + len),
+                bytes_read == 0 ? "unexpected end of file" : strerror(errno));
+            return AESD_RET_ERROR;
+        }
+        len += bytes_read;
+    }
+
+    return AESD_RET_OK;
+}
+
+static aesd_ret_t
+append_frame(aesd_lz_log_t * lz_log, size_t len)
+{
+    const uint8_t * data = lz_log->frame;
+    off_t offset = lz_log->frames_len;
+    while (len > 0) {
+        ssize_t written = pwrite(lz_log->frames_fd, data, len, offset);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            AESD_LOG_WITH_FUNC_ERR("Error on writing a compressed block: %s", strerror(errno));
+            return AESD_RET_ERROR;
+        }
+        data += written;
+        offset += written;
+        len -= written;
+    }
+
+    lz_log->frames_len = offset;
+    return AESD_RET_OK;
+}
+
+/// Seals the block of the log starting at lz_log->sealed
+static aesd_ret_t
+seal_block(aesd_lz_log_t * lz_log, int log_fd)
+{
+    if (read_block(lz_log, log_fd) != AESD_RET_OK) {
+        return AESD_RET_ERROR;
+    }
+
+    uint8_t * data = lz_log->frame + AESD_LZ_FRAME_HEADER_SIZE;
+    size_t compressed_len = aesd_lz_compress(lz_log->block, sizeof(lz_log->block), data,
+        sizeof(lz_log->frame) - AESD_LZ_FRAME_HEADER_SIZE);
+
+    // Blocks that do not compress are stored as they are
+    uint8_t type = AESD_LZ_FRAME_LZ;
+    if (compressed_len == 0 || compressed_len >= sizeof(lz_log->block)) {
+        memcpy(data, lz_log->block, sizeof(lz_log->block));
+        compressed_len = sizeof(lz_log->block);
+        type = AESD_LZ_FRAME_RAW;
+    }
+    aesd_lz_frame_header(lz_log->frame, type, sizeof(lz_log->block), compressed_len);
+
+    if (append_frame(lz_log, AESD_LZ_FRAME_HEADER_SIZE + compressed_len) != AESD_RET_OK) {
+        return AESD_RET_ERROR;
+    }
+
+    lz_log->sealed += sizeof(lz_log->block);
+    return AESD_RET_OK;
+}
+
+aesd_ret_t
+aesd_lz_log_sync(aesd_lz_log_t * lz_log, int log_fd, const struct stat * log_stat)
+{
+    if (log_stat->st_dev != lz_log->log_dev || log_stat->st_ino != lz_log->log_ino ||
+        log_stat->st_size < lz_log->sealed)
+    {
+        lz_log->log_dev = log_stat->st_dev;
+        lz_log->log_ino = log_stat->st_ino;
+        lz_log->sealed = 0;
+        lz_log->frames_len = 0;
+        // Only gives the space back. The frames are rewritten from the start either way
+        if (ftruncate(lz_log->frames_fd, 0) == -1) {
+            AESD_LOG_WITH_FUNC_INFO("Error on emptying the compressed log: %s", strerror(errno));
+        }
+    }
+
+    for (int i = 0; i < AESD_LZ_LOG_SYNC_BLOCKS && aesd_lz_log_behind(lz_log, log_stat->st_size);
+        i++)
+    {
+        off_t frames_len = lz_log->frames_len;
+        if (seal_block(lz_log, log_fd) != AESD_RET_OK) {
+            // Whatever a failed write left past the last frame is overwritten by the next one
+            lz_log->frames_len = frames_len;
+            return AESD_RET_ERROR;
+        }
+    }
+
+    return AESD_RET_OK;
+}
+
+bool
+aesd_lz_log_behind(const aesd_lz_log_t * lz_log, off_t log_size)
+{
+    return log_size - lz_log->sealed >= AESD_LZ_LOG_BLOCK_SIZE;
+}
+
+int
+aesd_lz_log_fd(const aesd_lz_log_t * lz_log)
+{
+    return lz_log->frames_fd;
+}
+
+off_t
+aesd_lz_log_frames_len(const aesd_lz_log_t * lz_log)
+{
+    return lz_log->frames_len;
+}
+
+off_t
+aesd_lz_log_sealed(const aesd_lz_log_t * lz_log)
+{
+    return lz_log->sealed;
+}
@@ -20,20 +20,27 @@
 
 #include <aeds/server.h>
 #include <aeds/become_daemon.h>
+#include <aeds/capture.h>
+#include <aeds/shm_log.h>
+#include <aeds/trace.h>
 
 #include <errno.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <syslog.h>
 #include <unistd.h>
 
 #define BUFFER_SIZE 1024
+/// A pipelined batch can take as much as the server buffers for a connection
+#define BATCH_BUFFER_SIZE AESD_SERVER_RX_BUF_SIZE
 const char * const TMP_FILE = "/var/tmp/aesdsocketdata";
 
 struct read_buffer {
-  char data[BUFFER_SIZE];
+  char data[BATCH_BUFFER_SIZE];
   size_t qty_bytes_read;
 };
 
@@ -42,6 +49,7 @@ struct file_context {
   int fd;
   int flags;
   mode_t mode;
+  aesd_shm_log_t * shm_log;  // Read-only view exported to local consumers. NULL if unavailable
 };
 
 static volatile sig_atomic_t sigint_or_sigterm_recved = 0;
@@ -54,8 +62,128 @@ signal_handler(int sig) {
   sign_recved = sig;
 }
 
+/**
+ * @brief Appends @a len bytes to the data file and publishes them in the shared-memory view.
+ *
+ * @return bytes written to the data file or -1 on error
+ */
+static ssize_t
+log_append(struct file_context * file_ctx, const void * data, size_t len) {
+  AESD_TRACE1(append__start, len);
+  ssize_t bytes_written = write(file_ctx->fd, data, len);
+  if (bytes_written <= 0 || file_ctx->shm_log == NULL) {
+    AESD_TRACE2(append__done, len, bytes_written);
+    return bytes_written;
+  }
+
+  if (aesd_shm_log_append(file_ctx->shm_log, data, bytes_written) != AESD_RET_OK) {
+    syslog(LOG_ERR, "Shared-memory log overflowed. Local readers must fall back to TCP");
+    aesd_shm_log_destroy(file_ctx->shm_log);
+    file_ctx->shm_log = NULL;
+  }
+
+  AESD_TRACE2(append__done, len, bytes_written);
+  return bytes_written;
+}
+
+static void
+print_usage(const char * prog_name) {
+  printf("Usage: %s [-d] [-p] [-c capture_file] [-C max_conns] [-I max_conns_per_ip]"
+    " [-B bytes_per_sec] [-L lines_per_sec] [-T idle_sec] [-R read_sec] [-W send_sec]"
+    " [-m conn_bytes] [-M total_bytes]\n"
+    "  -d  run as a daemon\n"
+    "  -p  pipelined mode: append every line already received as one batch and answer it once\n"
+    "  -c  record the incoming traffic to this file, to be replayed with aesdreplay\n"
+    "  -C  refuse clients beyond this number of concurrent connections\n"
+    "  -I  refuse clients beyond this number of concurrent connections from the same address\n"
+    "  -B  pause reading from a client that sends faster than this\n"
+    "  -L  hold back the lines of a client that sends more lines per second than this\n"
+    "  -T  close clients that neither send nor receive anything for this long (default %d)\n"
+    "  -R  close clients that take longer than this to finish a line (default %d)\n"
+    "  -W  close clients that stop taking their reply for this long (default %d)\n"
+    "  -m  bytes a client may have buffered in memory. Longer lines spill to disk (default %d)\n"
+    "  -M  bytes all clients together may have buffered in memory (default %d)\n"
+    "  A limit or timeout of 0 disables it\n",
+    prog_name, AESD_SERVER_DEFAULT_IDLE_TIMEOUT_SEC, AESD_SERVER_DEFAULT_READ_TIMEOUT_SEC,
+    AESD_SERVER_DEFAULT_SEND_TIMEOUT_SEC, AESD_SERVER_DEFAULT_CONN_MEM_BUDGET,
+    AESD_SERVER_DEFAULT_TOTAL_MEM_BUDGET);
+}
+
+/// Parses a non-negative limit. 0 keeps the limit disabled
+static bool
+parse_limit(const char * arg, double * value) {
+  char * end;
+  errno = 0;
+  *value = strtod(arg, &end);
+  return errno == 0 && end != arg && *end == '\0' && *value >= 0;
+}
+
 int main(int argc, char ** argv) {
-  if (argc > 1 && strcmp(argv[1], "-d") == 0) {
+  bool run_as_daemon = false;
+  bool pipelined = false;
+  const char * capture_path = NULL;
+  aesd_server_limits_t limits;
+  double limit;
+  int opt;
+
+  memset(&limits, 0, sizeof(limits));
+  limits.idle_timeout_sec = AESD_SERVER_DEFAULT_IDLE_TIMEOUT_SEC;
+  limits.read_timeout_sec = AESD_SERVER_DEFAULT_READ_TIMEOUT_SEC;
+  limits.send_timeout_sec = AESD_SERVER_DEFAULT_SEND_TIMEOUT_SEC;
+  limits.conn_mem_budget = AESD_SERVER_DEFAULT_CONN_MEM_BUDGET;
+  limits.total_mem_budget = AESD_SERVER_DEFAULT_TOTAL_MEM_BUDGET;
+
+  while ((opt = getopt(argc, argv, "dpc:C:I:B:L:T:R:W:m:M:h")) != -1) {
+    switch (opt) {
+      case 'd':
+        run_as_daemon = true;
+        break;
+      case 'p':
+        pipelined = true;
+        break;
+      case 'c':
+        capture_path = optarg;
+        break;
+      case 'C':
+      case 'I':
+      case 'B':
+      case 'L':
+      case 'T':
+      case 'R':
+      case 'W':
+      case 'm':
+      case 'M':
+        if (!parse_limit(optarg, &limit)) {
+          fprintf(stderr, "Invalid value for -%c: %s\n", opt, optarg);
+          return -1;
+        }
+        if (opt == 'C') {
+          limits.max_connections = limit;
+        } else if (opt == 'I') {
+          limits.max_connections_per_ip = limit;
+        } else if (opt == 'B') {
+          limits.bytes_per_sec = limit;
+        } else if (opt == 'L') {
+          limits.lines_per_sec = limit;
+        } else if (opt == 'T') {
+          limits.idle_timeout_sec = limit;
+        } else if (opt == 'R') {
+          limits.read_timeout_sec = limit;
+        } else if (opt == 'W') {
+          limits.send_timeout_sec = limit;
+        } else if (opt == 'm') {
+          limits.conn_mem_budget = limit;
+        } else {
+          limits.total_mem_budget = limit;
+        }
+        break;
+      default:
+        print_usage(argv[0]);
+        return opt == 'h' ? 0 : -1;
+    }
+  }
+
+  if (run_as_daemon) {
     daemon_pipe_fd = becomeDaemon();
     syslog(LOG_INFO, "Starting server as daemon with PID %d", getpid());
   } else {
@@ -79,6 +207,9 @@ int main(int argc, char ** argv) {
     return -1;
   }
 
+  // A client hanging up in the middle of a reply must only cost its own connection
+  signal(SIGPIPE, SIG_IGN);
+
   struct file_context file_ctx;
   struct read_buffer buffer;
   memset(&file_ctx, 0, sizeof(struct file_context));
@@ -92,6 +223,10 @@ int main(int argc, char ** argv) {
     return -1;
   }
 
+  // The data file stays the source of truth. Losing the shared view only costs local readers
+  // a fallback to TCP, so the server keeps going without it
+  file_ctx.shm_log = aesd_shm_log_create(AESD_SHM_LOG_NAME);
+
   aesd_server_t * aesd_server;
   aesd_server = aesd_server_create();
 
@@ -107,18 +242,45 @@ int main(int argc, char ** argv) {
   }
 
   int get_line_ret = AESD_SERVER_RET_EOL_NOT_FOUND;
+  size_t read_size = pipelined ? BATCH_BUFFER_SIZE : BUFFER_SIZE;
   size_t line_size;
   ssize_t bytes_written;
-  while (!sigint_or_sigterm_recved) {
-    if (get_line_ret != AESD_SERVER_RET_BUF_FULL) {
-      aesd_server_start_accept_connections(aesd_server);
+
+  // SIGINT and SIGTERM are only delivered while the server waits for events. Otherwise a signal
+  // arriving between two waits would go unnoticed until the next client shows up
+  sigset_t term_signals;
+  sigset_t wait_sigmask;
+  sigemptyset(&term_signals);
+  sigaddset(&term_signals, SIGINT);
+  sigaddset(&term_signals, SIGTERM);
+  sigprocmask(SIG_BLOCK, &term_signals, &wait_sigmask);
+  aesd_server_set_wait_sigmask(aesd_server, &wait_sigmask);
+
+  aesd_server_set_limits(aesd_server, &limits);
+  aesd_server_attach_log(aesd_server, file_ctx.fd);
+
+  aesd_capture_t * capture = NULL;
+  if (capture_path != NULL) {
+    capture = aesd_capture_open(capture_path);
+    if (capture == NULL) {
+      syslog(LOG_ERR, "Could not start the capture to %s. Serving without it", capture_path);
     }
+    aesd_server_set_capture(aesd_server, capture);
+  }
+
+  aesd_server_start_accept_connections(aesd_server);
 
-    get_line_ret = aesd_server_get_line(aesd_server, buffer.data, BUFFER_SIZE, &line_size);
+  while (!sigint_or_sigterm_recved) {
+    // In pipelined mode a burst of k lines costs one write and one send-back instead of k
+    if (pipelined) {
+      get_line_ret = aesd_server_get_lines(aesd_server, buffer.data, read_size, &line_size);
+    } else {
+      get_line_ret = aesd_server_get_line(aesd_server, buffer.data, read_size, &line_size);
+    }
 
     if (get_line_ret != AESD_SERVER_RET_ERROR && get_line_ret != AESD_SERVER_RET_NO_BYTES_READ) {
-      line_size = get_line_ret == AESD_SERVER_RET_BUF_FULL ? BUFFER_SIZE : line_size + 1;
-      bytes_written = write(file_ctx.fd, buffer.data, line_size);
+      line_size = get_line_ret == AESD_SERVER_RET_BUF_FULL ? read_size : line_size + 1;
+      bytes_written = log_append(&file_ctx, buffer.data, line_size);
 
       if (bytes_written == -1) {
         syslog(LOG_ERR, "Error while writting to file %s: %s", TMP_FILE, strerror(errno));
@@ -144,6 +306,8 @@ int main(int argc, char ** argv) {
   }
 
   aesd_server_destroy(aesd_server);
+  aesd_capture_close(capture);
+  aesd_shm_log_destroy(file_ctx.shm_log);
 
   if (close(file_ctx.fd) == -1) {
     syslog(LOG_ERR, "Error on closing the fd for the file %s: %s", TMP_FILE, strerror(errno));
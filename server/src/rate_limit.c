@@ -0,0 +1,205 @@
+// Copyright (c) 2025 Mateus Menezes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "aeds/rate_limit.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+
+#include "aeds/list.h"
+#include "aeds/server.h"
+
+/// Power of two, so the hash is reduced with a mask
+#define AESD_IP_TABLE_BUCKETS 256
+
+struct ip_entry {
+    uint32_t addr;
+    size_t count;
+    aesd_list_t node;
+};
+
+struct aesd_ip_table_s {
+    aesd_list_t buckets[AESD_IP_TABLE_BUCKETS];
+};
+
+uint64_t
+aesd_monotonic_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * AESD_NSEC_PER_SEC + now.tv_nsec;
+}
+
+void
+aesd_token_bucket_init(aesd_token_bucket_t * bucket, double rate, double burst, uint64_t now_ns)
+{
+    bucket->rate = rate;
+    bucket->burst = burst;
+    bucket->tokens = burst;
+    bucket->last_ns = now_ns;
+}
+
+static void
+refill(aesd_token_bucket_t * bucket, uint64_t now_ns)
+{
+    if (now_ns <= bucket->last_ns) {
+        return;
+    }
+
+    bucket->tokens += bucket->rate * (double)(now_ns - bucket->last_ns) / AESD_NSEC_PER_SEC;
+    if (bucket->tokens > bucket->burst) {
+        bucket->tokens = bucket->burst;
+    }
+    bucket->last_ns = now_ns;
+}
+
+void
+aesd_token_bucket_consume(aesd_token_bucket_t * bucket, double tokens, uint64_t now_ns)
+{
+    if (!aesd_token_bucket_enabled(bucket)) {
+        return;
+    }
+
+    refill(bucket, now_ns);
+    bucket->tokens -= tokens;
+}
+
+uint64_t
+aesd_token_bucket_available(aesd_token_bucket_t * bucket, uint64_t now_ns)
+{
+    if (!aesd_token_bucket_enabled(bucket)) {
+        return UINT64_MAX;
+    }
+
+    refill(bucket, now_ns);
+    return bucket->tokens > 0 ? (uint64_t)bucket->tokens : 0;
+}
+
+uint64_t
+aesd_token_bucket_delay_ns(aesd_token_bucket_t * bucket, double tokens, uint64_t now_ns)
+{
+    if (!aesd_token_bucket_enabled(bucket)) {
+        return 0;
+    }
+
+    refill(bucket, now_ns);
+    if (bucket->tokens >= tokens) {
+        return 0;
+    }
+
+    return (uint64_t)((tokens - bucket->tokens) * AESD_NSEC_PER_SEC / bucket->rate) + 1;
+}
+
+static aesd_list_t *
+ip_bucket(aesd_ip_table_t * table, uint32_t addr)
+{
+    // Fibonacci hashing spreads consecutive addresses over the whole table
+    uint32_t hash = addr * 2654435769u;
+    return &table->buckets[hash >> 24 & (AESD_IP_TABLE_BUCKETS - 1)];
+}
+
+static struct ip_entry *
+ip_find(aesd_list_t * bucket, uint32_t addr)
+{
+    aesd_list_t * node;
+    aesd_list_t * tmp;
+    AESD_LIST_FOR_EACH_SAFE(node, tmp, bucket) {
+        struct ip_entry * entry = AESD_LIST_ENTRY(node, struct ip_entry, node);
+        if (entry->addr == addr) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+aesd_ip_table_t *
+aesd_ip_table_create(void)
+{
+    aesd_ip_table_t * table = malloc(sizeof(aesd_ip_table_t));
+    if (table == NULL) {
+        AESD_LOG_WITH_FUNC_ERR("Error during memory allocation: %s", strerror(errno));
+        return NULL;
+    }
+
+    for (size_t i = 0; i < AESD_IP_TABLE_BUCKETS; i++) {
+        aesd_list_init(&table->buckets[i]);
+    }
+
+    return table;
+}
+
+void
+aesd_ip_table_destroy(aesd_ip_table_t * table)
+{
+    if (table == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < AESD_IP_TABLE_BUCKETS; i++) {
+        aesd_list_t * node;
+        while ((node = aesd_list_pop_front(&table->buckets[i])) != NULL) {
+            free(AESD_LIST_ENTRY(node, struct ip_entry, node));
+        }
+    }
+
+    free(table);
+}
+
+bool
+aesd_ip_table_acquire(aesd_ip_table_t * table, uint32_t addr, size_t max_per_ip)
+{
+    aesd_list_t * bucket = ip_bucket(table, addr);
+    struct ip_entry * entry = ip_find(bucket, addr);
+
+    if (entry == NULL) {
+        entry = calloc(1, sizeof(struct ip_entry));
+        if (entry == NULL) {
+            AESD_LOG_WITH_FUNC_ERR("Error during memory allocation: %s", strerror(errno));
+            return false;
+        }
+        entry->addr = addr;
+        aesd_list_push_back(bucket, &entry->node);
+    }
+
+    if (max_per_ip != 0 && entry->count >= max_per_ip) {
+        return false;
+    }
+
+    entry->count++;
+    return true;
+}
+
+void
+aesd_ip_table_release(aesd_ip_table_t * table, uint32_t addr)
+{
+    struct ip_entry * entry = ip_find(ip_bucket(table, addr), addr);
+    if (entry == NULL) {
+        return;
+    }
+
+    if (--entry->count == 0) {
+        aesd_list_unlink(&entry->node);
+        free(entry);
+    }
+}
@@ -18,17 +18,24 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#define _GNU_SOURCE  // memrchr(), accept4()
+
 #include "aeds/server.h"
 
 #include <arpa/inet.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -36,12 +43,97 @@
 #include <syslog.h>
 #include <unistd.h>
 
+#include "aeds/list.h"
+#include "aeds/lz_log.h"
+#include "aeds/rate_limit.h"
 #include "aeds/ret_types.h"
+#include "aeds/timer_wheel.h"
+#include "aeds/trace.h"
+
+/// Events handled per epoll_wait() call
+#define AESD_SERVER_MAX_EVENTS 64
+/// Lines handed out before looking for new events again, so a client with a deep backlog of
+/// lines cannot starve the others or the subscribers
+#define AESD_SERVER_LINES_PER_POLL 64
+/// Free space the receive buffer must have before calling recv(). It doubles when needed
+#define AESD_SERVER_RX_MIN_FREE 4096
+/// Directory of the unnamed files holding the start of lines too long to stay in memory
+#define AESD_SERVER_SPILL_DIR "/var/tmp"
+/// Resolution of the connection deadlines
+#define AESD_SERVER_TICK_NS (10 * 1000 * 1000ull)
+/// Parts of a reply: the sealed frames, the header and bytes of the raw tail, the end frame
+#define AESD_SERVER_TX_SEGMENTS 4
+
+/// Part of a reply: bytes [off, end) of the file fd, or of conn->tx_headers when fd is -1
+struct aesd_tx_segment {
+    int fd;
+    off_t off;
+    off_t end;
+};
+
+struct aesd_conn {
+    aesd_server_impl_t * impl;  // Lets the timer callbacks reach the server
+    int fd;
+    uint32_t id;
+    uint32_t addr;  // IPv4 address of the peer in network byte order
+    char ip_str[INET_ADDRSTRLEN];
+    bool peer_closed;  // recv() returned 0. Deliver what is left, then hang up
+    bool subscribed;
+    bool compressed;  // Replies are framed and compressed as described in aeds/lz_log.h
+    uint32_t epoll_events;  // Events currently registered for fd
+    char * rx_buf;
+    size_t rx_start;  // First byte not handed to the caller yet
+    size_t rx_len;  // One past the last byte received
+    size_t rx_cap;
+    size_t rx_eol_search;  // [rx_start, rx_eol_search) is known to hold no '\n'
+    bool rx_blocked;  // Buffer full of complete lines. Reads wait until some are handed out
+    int spill_fd;  // Start of the current line when it outgrew the memory budget. -1 if unused
+    off_t spill_len;  // Bytes of the current line in spill_fd. They come before rx_buf
+    off_t spill_off;  // Bytes of spill_fd already handed out
+    struct aesd_tx_segment tx[AESD_SERVER_TX_SEGMENTS];  // Reply being sent, in order
+    unsigned tx_count;
+    unsigned tx_next;  // First segment not completely sent
+    uint8_t tx_headers[2 * AESD_LZ_FRAME_HEADER_SIZE];  // Frame headers of a compressed reply
+    off_t cursor;  // Subscribers only: log bytes already pushed
+    aesd_token_bucket_t bytes_bucket;
+    aesd_token_bucket_t lines_bucket;
+    uint64_t read_paused_until_ns;  // Over the bytes/sec quota. 0 when not paused
+    uint64_t lines_paused_until_ns;  // Over the lines/sec quota. 0 when not paused
+    aesd_list_t node;  // In impl->connections
+    aesd_list_t ready_node;  // In impl->ready while a line waits and nothing is being sent
+    aesd_list_t sub_node;  // In impl->subscribers
+    aesd_timer_t throttle_timer;  // Resumes reads or lines once the quota refilled
+    aesd_timer_t idle_timer;  // Nothing received or sent for too long
+    aesd_timer_t read_timer;  // A line was started and never finished (slowloris)
+    aesd_timer_t send_timer;  // The client stopped taking its reply
+};
 
 struct aesd_server_impl_s {
     int socket_fd;
-    int connection_fd;
-    bool connection_accepted;
+    int epoll_fd;
+    bool accepting;
+    uint32_t next_conn_id;
+    size_t num_connections;
+    uint64_t num_shed;  // Connections refused by admission control
+    aesd_server_limits_t limits;
+    aesd_ip_table_t * ip_table;
+    size_t rx_mem;  // Receive buffers of all connections, counted against limits.total_mem
+    aesd_list_t connections;
+    aesd_list_t ready;
+    aesd_list_t subscribers;
+    aesd_timer_wheel_t timers;
+    uint64_t start_ns;  // Time of tick 0 of the wheel
+    struct aesd_conn * current;  // Connection the last line handed out came from
+    bool current_mid_line;  // The caller got a BUF_FULL chunk and the line goes on
+    unsigned lines_since_poll;
+    int log_fd;
+    aesd_capture_t * capture;  // NULL unless traffic is being recorded
+    off_t committed;
+    bool commit_pending;  // Subscribers were not told about the last commits yet
+    aesd_lz_log_t * lz_log;  // Sealed blocks of the log. NULL until a client asks for them
+    bool lz_log_failed;  // Sealing failed since the last commit, which tries again
+    bool has_wait_sigmask;
+    sigset_t wait_sigmask;  // Signal mask applied only while waiting for events
 };
 
 void *
@@ -96,8 +188,24 @@ aesd_server_init(aesd_server_t * aesd_server)
     }
 
     aesd_server->impl->socket_fd = -1;
-    aesd_server->impl->connection_fd = -1;
-    aesd_server->impl->connection_accepted = false;
+    aesd_server->impl->log_fd = -1;
+    aesd_list_init(&aesd_server->impl->connections);
+    aesd_list_init(&aesd_server->impl->ready);
+    aesd_list_init(&aesd_server->impl->subscribers);
+    aesd_server->impl->start_ns = aesd_monotonic_ns();
+    aesd_timer_wheel_init(&aesd_server->impl->timers, 0);
+
+    aesd_server->impl->ip_table = aesd_ip_table_create();
+    if (aesd_server->impl->ip_table == NULL) {
+        return NULL;
+    }
+
+    aesd_server->impl->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (aesd_server->impl->epoll_fd == -1) {
+        syslog(LOG_ERR, "Error on creating the epoll instance: %s", strerror(errno));
+        aesd_ip_table_destroy(aesd_server->impl->ip_table);
+        return NULL;
+    }
 
     struct addrinfo addrinfo_hints;
     struct addrinfo *servinfo;
@@ -147,128 +255,1191 @@ aesd_server_init(aesd_server_t * aesd_server)
 
 close_socket:
     close(aesd_server->impl->socket_fd);
-    if (aesd_server->impl->connection_accepted) {
-        close(aesd_server->impl->connection_fd);
-    }
+    close(aesd_server->impl->epoll_fd);
+    aesd_ip_table_destroy(aesd_server->impl->ip_table);
 
     return NULL;
 }
 
-void
-aesd_server_start_accept_connections(aesd_server_t * aesd_server)
+static void
+conn_set_events(aesd_server_impl_t * impl, struct aesd_conn * conn, uint32_t events)
+{
+    if (conn->epoll_events == events) {
+        return;
+    }
+
+    struct epoll_event event = { .events = events, .data.ptr = conn };
+    if (epoll_ctl(impl->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event) == -1) {
+        AESD_LOG_WITH_FUNC_ERR("Error on updating events of connection %u: %s",
+            conn->id, strerror(errno));
+        return;
+    }
+
+    conn->epoll_events = events;
+}
+
+static void
+conn_close(aesd_server_impl_t * impl, struct aesd_conn * conn)
+{
+    syslog(LOG_INFO, "Closed connection from %s", conn->ip_str);
+    AESD_LOG_WITH_FUNC_DEBUG("Connection %u closed with %zu bytes left without '\\n'",
+        conn->id, conn->rx_len - conn->rx_start);
+    AESD_TRACE2(close, conn->id, conn->rx_len - conn->rx_start);
+    if (impl->capture != NULL) {
+        aesd_capture_record(impl->capture, conn->id, AESD_CAPTURE_CLOSE, NULL, 0);
+    }
+
+    if (impl->current == conn) {
+        impl->current = NULL;
+        impl->current_mid_line = false;
+    }
+
+    aesd_list_unlink(&conn->node);
+    aesd_list_unlink(&conn->ready_node);
+    aesd_list_unlink(&conn->sub_node);
+    aesd_timer_cancel(&impl->timers, &conn->throttle_timer);
+    aesd_timer_cancel(&impl->timers, &conn->idle_timer);
+    aesd_timer_cancel(&impl->timers, &conn->read_timer);
+    aesd_timer_cancel(&impl->timers, &conn->send_timer);
+    aesd_ip_table_release(impl->ip_table, conn->addr);
+    impl->num_connections--;
+
+    // Closing the descriptor also removes it from the epoll set
+    close(conn->fd);
+    if (conn->spill_fd != -1) {
+        close(conn->spill_fd);
+    }
+    impl->rx_mem -= conn->rx_cap;
+    free(conn->rx_buf);
+    free(conn);
+}
+
+static bool
+conn_tx_idle(const struct aesd_conn * conn)
+{
+    return conn->tx_next >= conn->tx_count;
+}
+
+/// Bytes of the reply of @a conn still to be sent
+static off_t
+conn_tx_left(const struct aesd_conn * conn)
+{
+    off_t left = 0;
+    for (unsigned i = conn->tx_next; i < conn->tx_count; i++) {
+        left += conn->tx[i].end - conn->tx[i].off;
+    }
+
+    return left;
+}
+
+/// Makes [off, end) of @a fd the whole reply of @a conn
+static void
+conn_tx_set_range(struct aesd_conn * conn, int fd, off_t off, off_t end)
+{
+    conn->tx[0] = (struct aesd_tx_segment){ .fd = fd, .off = off, .end = end };
+    conn->tx_count = 1;
+    conn->tx_next = 0;
+}
+
+static void
+conn_tx_add(struct aesd_conn * conn, int fd, off_t off, off_t end)
+{
+    assert(conn->tx_count < AESD_SERVER_TX_SEGMENTS);
+    conn->tx[conn->tx_count++] = (struct aesd_tx_segment){ .fd = fd, .off = off, .end = end };
+}
+
+/**
+ * @brief Makes the first @a size bytes of the log @a file_fd the reply of @a conn, as frames: the
+ * blocks already sealed and compressed, the raw tail and the end frame.
+ *
+ * @return false if the tail is too long for a frame, which only happens when sealing fails or
+ * still catches up on a log of gigabytes
+ */
+static bool
+conn_tx_set_frames(aesd_server_impl_t * impl, struct aesd_conn * conn, int file_fd, off_t size)
+{
+    off_t sealed = 0;
+    conn->tx_count = 0;
+    conn->tx_next = 0;
+
+    if (impl->lz_log != NULL && aesd_lz_log_sealed(impl->lz_log) <= size) {
+        sealed = aesd_lz_log_sealed(impl->lz_log);
+        conn_tx_add(conn, aesd_lz_log_fd(impl->lz_log), 0, aesd_lz_log_frames_len(impl->lz_log));
+    }
+
+    off_t tail = size - sealed;
+    if (tail > UINT32_MAX) {
+        return false;
+    }
+
+    if (tail > 0) {
+        aesd_lz_frame_header(conn->tx_headers, AESD_LZ_FRAME_RAW, tail, tail);
+        conn_tx_add(conn, -1, 0, AESD_LZ_FRAME_HEADER_SIZE);
+        conn_tx_add(conn, file_fd, sealed, size);
+    }
+
+    aesd_lz_frame_header(conn->tx_headers + AESD_LZ_FRAME_HEADER_SIZE, AESD_LZ_FRAME_END, 0, 0);
+    conn_tx_add(conn, -1, AESD_LZ_FRAME_HEADER_SIZE, 2 * AESD_LZ_FRAME_HEADER_SIZE);
+    return true;
+}
+
+static char *
+conn_find_eol(struct aesd_conn * conn)
 {
-    struct sockaddr_storage client_addr;
-    socklen_t client_addr_len = sizeof(client_addr);
+    if (conn->rx_eol_search < conn->rx_start) {
+        conn->rx_eol_search = conn->rx_start;
+    }
+
+    char * eol = memchr(conn->rx_buf + conn->rx_eol_search, '\n',
+        conn->rx_len - conn->rx_eol_search);
+    conn->rx_eol_search = eol != NULL ? (size_t)(eol - conn->rx_buf) : conn->rx_len;
+
+    return eol;
+}
 
-    aesd_server->impl->connection_fd = accept(
-        aesd_server->impl->socket_fd, (struct sockaddr *)&client_addr, &client_addr_len);
+/**
+ * @brief Decides what to wait for on @a conn after its state changed: queue it as ready when
+ * it holds a complete line and nothing is being sent, and hang up once a closed peer has
+ * nothing left to deliver.
+ */
+static void
+conn_update(aesd_server_impl_t * impl, struct aesd_conn * conn)
+{
+    // The caller still owes this connection a reply or the rest of a line
+    if (conn == impl->current) {
+        return;
+    }
 
-    if (aesd_server->impl->connection_fd == -1) {
-        if (EINTR == errno) {
-            syslog(LOG_INFO, "Accept connection interrupted by a signal");
+    if (!conn_tx_idle(conn)) {
+        aesd_list_unlink(&conn->ready_node);
+        conn_set_events(impl, conn, EPOLLOUT);
+        return;
+    }
+
+    bool has_line = conn_find_eol(conn) != NULL;
+    if (has_line && conn->lines_paused_until_ns == 0) {
+        if (!aesd_list_linked(&conn->ready_node)) {
+            aesd_list_push_back(&impl->ready, &conn->ready_node);
         }
+    } else {
+        aesd_list_unlink(&conn->ready_node);
+    }
 
-        syslog(LOG_ERR, "Error on accepting new connection: %s", strerror(errno));
+    if (conn->peer_closed) {
+        if (!has_line) {
+            conn_close(impl, conn);
+        } else {
+            conn_set_events(impl, conn, 0);
+        }
+        return;
+    }
 
-        aesd_server->impl->connection_accepted = false;
-        close(aesd_server->impl->socket_fd);
+    // Not reading lets the socket buffer fill up, which slows the client down through TCP
+    // flow control at no cost for us
+    conn_set_events(impl, conn,
+        conn->read_paused_until_ns != 0 || conn->rx_blocked ? 0 : EPOLLIN);
+}
+
+/// Tick of the wheel at @a ns, rounded up so a deadline never fires early
+static uint64_t
+ns_to_tick(const aesd_server_impl_t * impl, uint64_t ns)
+{
+    return (ns - impl->start_ns + AESD_SERVER_TICK_NS - 1) / AESD_SERVER_TICK_NS;
+}
+
+/// Arms @a timer to fire @a timeout_sec from now. A timeout of 0 leaves it disabled
+static void
+conn_arm_timer(aesd_server_impl_t * impl, aesd_timer_t * timer, double timeout_sec)
+{
+    if (timeout_sec <= 0) {
         return;
     }
 
-    syslog(LOG_INFO, "AESD Server ready to receive data");
-    aesd_server->impl->connection_accepted = true;
+    uint64_t deadline_ns = aesd_monotonic_ns() + (uint64_t)(timeout_sec * AESD_NSEC_PER_SEC);
+    aesd_timer_arm(&impl->timers, timer, ns_to_tick(impl, deadline_ns));
 }
 
-void
-aesd_server_fini(aesd_server_t * aesd_server)
+/// Pushes the idle deadline forward. Subscribers wait on other clients by design and never idle
+static void
+conn_touch(aesd_server_impl_t * impl, struct aesd_conn * conn)
 {
-    assert(aesd_server);
+    if (!conn->subscribed) {
+        conn_arm_timer(impl, &conn->idle_timer, impl->limits.idle_timeout_sec);
+    }
+}
 
-    close(aesd_server->impl->socket_fd);
-    close(aesd_server->impl->connection_fd);
+static void
+conn_timed_out(struct aesd_conn * conn, const char * reason)
+{
+    syslog(LOG_INFO, "Connection %u from %s timed out: %s", conn->id, conn->ip_str, reason);
+    AESD_TRACE2(timeout, conn->id, reason);
+    conn_close(conn->impl, conn);
 }
 
-aesd_server_t *
-aesd_server_create()
+static void
+on_idle_timer(aesd_timer_t * timer)
 {
-    aesd_server_t * aesd_server = aesd_server_alloc();
-    if (!aesd_server) {
-        goto error_alloc;
+    conn_timed_out(AESD_LIST_ENTRY(timer, struct aesd_conn, idle_timer), "idle");
+}
+
+static void
+on_read_timer(aesd_timer_t * timer)
+{
+    conn_timed_out(AESD_LIST_ENTRY(timer, struct aesd_conn, read_timer), "line not finished");
+}
+
+static void
+on_send_timer(aesd_timer_t * timer)
+{
+    conn_timed_out(AESD_LIST_ENTRY(timer, struct aesd_conn, send_timer), "reply not taken");
+}
+
+/// Arms the throttle timer at the earliest pause still running, or cancels it if none is
+static void
+conn_arm_throttle_timer(aesd_server_impl_t * impl, struct aesd_conn * conn)
+{
+    uint64_t until_ns = conn->read_paused_until_ns;
+    if (until_ns == 0 ||
+        (conn->lines_paused_until_ns != 0 && conn->lines_paused_until_ns < until_ns))
+    {
+        until_ns = conn->lines_paused_until_ns;
     }
 
-    aesd_server_t * tmp = aesd_server_init(aesd_server);
-    if (!tmp) {
-        goto error_init;
+    if (until_ns == 0) {
+        aesd_timer_cancel(&impl->timers, &conn->throttle_timer);
+        return;
     }
-    aesd_server = tmp;
 
-    return aesd_server;
+    aesd_timer_arm(&impl->timers, &conn->throttle_timer, ns_to_tick(impl, until_ns));
+}
 
-error_init:
-    aesd_server_free(aesd_server);
-error_alloc:
-    return NULL;
+static void
+conn_throttle(aesd_server_impl_t * impl, struct aesd_conn * conn, uint64_t * paused_until_ns,
+    uint64_t delay_ns, uint64_t now_ns)
+{
+    *paused_until_ns = now_ns + delay_ns;
+    conn_arm_throttle_timer(impl, conn);
 }
 
-void
-aesd_server_destroy(aesd_server_t * aesd_server)
+/// Resumes whatever was paused on the connection once its quota refilled
+static void
+on_throttle_timer(aesd_timer_t * timer)
 {
-    // aesd_server_destroy() and aesd_server_free() are the only methods which can be called
-    // with `aesd_server == NULL`.
-    if (aesd_server) {
-        aesd_server_fini(aesd_server);
-        aesd_server_free(aesd_server);
+    struct aesd_conn * conn = AESD_LIST_ENTRY(timer, struct aesd_conn, throttle_timer);
+    uint64_t now_ns = aesd_monotonic_ns();
+
+    if (conn->read_paused_until_ns <= now_ns) {
+        conn->read_paused_until_ns = 0;
+    }
+    if (conn->lines_paused_until_ns <= now_ns) {
+        conn->lines_paused_until_ns = 0;
     }
-}
 
-aesd_server_ret_t
-aesd_server_get_line(aesd_server_t * aesd_server, void * buf, size_t buf_len, size_t * line_size) {
-    ssize_t num_bytes_read = 0;
-    size_t total_bytes_read = 0;
-    char * first_end_str;
-    char * this_buf = buf;
+    conn_arm_throttle_timer(conn->impl, conn);
+    conn_update(conn->impl, conn);
+}
 
-    assert(line_size);
+/**
+ * @brief Runs the callbacks of the deadlines that passed.
+ *
+ * @return milliseconds until the next one may expire, -1 if none is armed
+ */
+static int
+run_timers(aesd_server_impl_t * impl)
+{
+    uint64_t now_ns = aesd_monotonic_ns();
+    aesd_timer_wheel_advance(&impl->timers, (now_ns - impl->start_ns) / AESD_SERVER_TICK_NS);
 
-    if (aesd_server == NULL) {
-        AESD_LOG_WITH_FUNC_ERR("server is not properly initialized. Passed a null pointer");
+    uint64_t next_tick = aesd_timer_wheel_next_tick(&impl->timers);
+    if (next_tick == UINT64_MAX) {
         return -1;
     }
 
-    total_bytes_read = 0;
-    while (total_bytes_read < buf_len) {
-        num_bytes_read = recv(aesd_server->impl->connection_fd,
-            this_buf + num_bytes_read, buf_len - total_bytes_read, 0);
+    uint64_t next_ns = impl->start_ns + next_tick * AESD_SERVER_TICK_NS;
+    if (next_ns <= now_ns) {
+        return 0;
+    }
+
+    // Round up, so we do not wake up right before the deadline and spin
+    return (next_ns - now_ns + 999999) / 1000000;
+}
+
+/**
+ * @brief Sends the pending reply to @a conn. Subscribers keep going until they caught up with
+ * the committed length.
+ *
+ * @return false if the connection was closed
+ */
+static bool
+conn_send(aesd_server_impl_t * impl, struct aesd_conn * conn)
+{
+    while (true) {
+        while (!conn_tx_idle(conn)) {
+            struct aesd_tx_segment * seg = &conn->tx[conn->tx_next];
+            if (seg->off >= seg->end) {
+                conn->tx_next++;
+                continue;
+            }
+
+            AESD_TRACE3(send__start, conn->id, seg->off, seg->end - seg->off);
+            ssize_t sent;
+            if (seg->fd != -1) {
+                sent = sendfile(conn->fd, seg->fd, &seg->off, seg->end - seg->off);
+            } else {
+                // A frame header goes out in the same packet as the data following it
+                int more = conn->tx_next + 1 < conn->tx_count ? MSG_MORE : 0;
+                sent = send(conn->fd, conn->tx_headers + seg->off, seg->end - seg->off,
+                    MSG_NOSIGNAL | more);
+                if (sent > 0) {
+                    seg->off += sent;
+                }
+            }
+            if (sent == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    if (!aesd_timer_pending(&conn->send_timer)) {
+                        conn_arm_timer(impl, &conn->send_timer, impl->limits.send_timeout_sec);
+                    }
+                    AESD_TRACE3(send__done, conn->id, conn_tx_left(conn), 1);
+                    conn_update(impl, conn);
+                    return true;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                AESD_LOG_WITH_FUNC_ERR("Error on transferring data to connection %u: %s",
+                    conn->id, strerror(errno));
+                AESD_TRACE3(send__done, conn->id, conn_tx_left(conn), 0);
+                conn_close(impl, conn);
+                return false;
+            }
+
+            if (sent == 0) {
+                // The file is shorter than expected. Nothing else can be sent from this range
+                seg->end = seg->off;
+            } else if (aesd_timer_pending(&conn->send_timer)) {
+                // The client is taking its reply, slowly. Give it another full send timeout
+                conn_arm_timer(impl, &conn->send_timer, impl->limits.send_timeout_sec);
+            }
+        }
+
+        if (!conn->subscribed) {
+            break;
+        }
+
+        // Subscribers are sent the log one range at a time, from their cursor on. The reply just
+        // sent may also be the answer to a command
+        if (conn->tx[0].fd == impl->log_fd) {
+            conn->cursor = conn->tx[0].end;
+        }
+        if (conn->cursor >= impl->committed) {
+            break;
+        }
+
+        conn_tx_set_range(conn, impl->log_fd, conn->cursor, impl->committed);
+    }
+
+    AESD_TRACE3(send__done, conn->id, 0, 1);
+    aesd_timer_cancel(&impl->timers, &conn->send_timer);
+    conn_touch(impl, conn);
+    conn_update(impl, conn);
+    return true;
+}
+
+/**
+ * @brief Starts pushing to @a conn everything committed past its cursor.
+ *
+ * @return false if the connection was closed
+ */
+static bool
+conn_push(aesd_server_impl_t * impl, struct aesd_conn * conn)
+{
+    if (!conn_tx_idle(conn) || conn->cursor >= impl->committed || impl->log_fd < 0) {
+        return true;
+    }
+
+    conn_tx_set_range(conn, impl->log_fd, conn->cursor, impl->committed);
+    return conn_send(impl, conn);
+}
+
+/// Wakes every subscriber once for all lines committed since the last flush
+static void
+flush_subscribers(aesd_server_impl_t * impl)
+{
+    if (!impl->commit_pending) {
+        return;
+    }
+    impl->commit_pending = false;
+
+    aesd_list_t * node;
+    aesd_list_t * tmp;
+    AESD_LIST_FOR_EACH_SAFE(node, tmp, &impl->subscribers) {
+        conn_push(impl, AESD_LIST_ENTRY(node, struct aesd_conn, sub_node));
+    }
+}
+
+static int
+open_spill_file(void)
+{
+    int fd = open(AESD_SERVER_SPILL_DIR, O_TMPFILE | O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd != -1 || (errno != EOPNOTSUPP && errno != EISDIR && errno != EINVAL)) {
+        return fd;
+    }
+
+    // The file system does not support unnamed files. Create one and remove its name at once
+    char path[] = AESD_SERVER_SPILL_DIR "/aesdsocket-spill-XXXXXX";
+    fd = mkostemp(path, O_CLOEXEC);
+    if (fd != -1) {
+        unlink(path);
+    }
+
+    return fd;
+}
+
+/// "AESDCTL SUBSCRIBE [offset]"
+static bool
+conn_subscribe(aesd_server_impl_t * impl, struct aesd_conn * conn, const char * args)
+{
+    off_t start = impl->committed;
+    char * end;
+    long long requested = strtoll(args, &end, 10);
+    if (end != args && requested >= 0 && requested < start) {
+        start = requested;
+    }
+
+    conn->subscribed = true;
+    conn->cursor = start;
+    aesd_timer_cancel(&impl->timers, &conn->idle_timer);
+    if (!aesd_list_linked(&conn->sub_node)) {
+        aesd_list_push_back(&impl->subscribers, &conn->sub_node);
+    }
+
+    syslog(LOG_INFO, "Connection %u subscribed from offset %lld", conn->id, (long long)start);
+    return true;
+}
+
+/**
+ * @brief "AESDCTL COMPRESS [OFF]". Answered with a lone end frame, which the caller sends
+ * before handing out the next line of @a conn.
+ */
+static bool
+conn_compress(aesd_server_impl_t * impl, struct aesd_conn * conn, const char * args)
+{
+    args += strspn(args, " ");
+    if (*args != '\0' && strcmp(args, "OFF") != 0) {
+        return false;
+    }
+
+    conn->compressed = *args == '\0';
+
+    // Otherwise the end frame, sent right after the tail, waits for the client to acknowledge
+    // the tail, which it delays expecting more data
+    int nodelay = conn->compressed;
+    if (setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) == -1) {
+        AESD_LOG_WITH_FUNC_ERR("Error on configuring connection %u: %s", conn->id,
+            strerror(errno));
+    }
+    if (conn->compressed && impl->lz_log == NULL) {
+        // The log is sealed a few blocks per poll from now on. Until then replies are a raw tail
+        int frames_fd = open_spill_file();
+        if (frames_fd == -1) {
+            AESD_LOG_WITH_FUNC_ERR("Error on creating the compressed log in %s: %s",
+                AESD_SERVER_SPILL_DIR, strerror(errno));
+        } else {
+            impl->lz_log = aesd_lz_log_create(frames_fd);
+        }
+    }
+
+    aesd_lz_frame_header(conn->tx_headers, AESD_LZ_FRAME_END, 0, 0);
+    conn_tx_set_range(conn, -1, 0, AESD_LZ_FRAME_HEADER_SIZE);
+
+    syslog(LOG_INFO, "Connection %u turned compression %s", conn->id,
+        conn->compressed ? "on" : "off");
+    return true;
+}
+
+static bool
+ctrl_command_is(const char * cmd, size_t cmd_len, const char * name)
+{
+    return cmd_len == strlen(name) && memcmp(cmd, name, cmd_len) == 0;
+}
+
+/**
+ * @brief Handles a line starting with AESD_SERVER_CTRL_PREFIX.
+ *
+ * @return false if the line is not a known command and must be treated as data
+ */
+static bool
+conn_handle_control(aesd_server_impl_t * impl, struct aesd_conn * conn, char * line, size_t len)
+{
+    const size_t prefix_len = sizeof(AESD_SERVER_CTRL_PREFIX) - 1;
+    if (len <= prefix_len || memcmp(line, AESD_SERVER_CTRL_PREFIX, prefix_len) != 0) {
+        return false;
+    }
+
+    // The command name, then its arguments after a space
+    char * cmd = line + prefix_len;
+    size_t cmd_len = len - prefix_len;
+    char args[32] = {0};
+    char * space = memchr(cmd, ' ', cmd_len);
+    if (space != NULL) {
+        size_t args_len = cmd + cmd_len - space;
+        if (args_len >= sizeof(args)) {
+            return false;
+        }
+        memcpy(args, space, args_len);
+        cmd_len = space - cmd;
+    }
+
+    if (ctrl_command_is(cmd, cmd_len, AESD_SERVER_CTRL_SUBSCRIBE)) {
+        return conn_subscribe(impl, conn, args);
+    }
+    if (ctrl_command_is(cmd, cmd_len, AESD_SERVER_CTRL_COMPRESS)) {
+        return conn_compress(impl, conn, args);
+    }
+
+    return false;
+}
+
+/// Whether the receive buffer of @a conn can grow to @a new_cap within the memory budgets
+static bool
+conn_rx_may_grow(const aesd_server_impl_t * impl, const struct aesd_conn * conn, size_t new_cap)
+{
+    // Every connection gets a minimal buffer, or it could never make progress
+    if (conn->rx_cap == 0) {
+        return true;
+    }
+
+    const aesd_server_limits_t * limits = &impl->limits;
+    if (limits->conn_mem_budget != 0 && new_cap > limits->conn_mem_budget) {
+        return false;
+    }
+
+    return limits->total_mem_budget == 0 ||
+        impl->rx_mem - conn->rx_cap + new_cap <= limits->total_mem_budget;
+}
+
+/**
+ * @brief Moves the partial line buffered for @a conn to its spill file, so a line of any length
+ * only costs a bounded amount of memory. The line is read back from the file when it completes.
+ *
+ * @return false if the bytes could not be written
+ */
+static bool
+conn_spill(aesd_server_impl_t * impl, struct aesd_conn * conn)
+{
+    if (conn->spill_fd == -1) {
+        conn->spill_fd = open_spill_file();
+        if (conn->spill_fd == -1) {
+            AESD_LOG_WITH_FUNC_ERR("Error on creating a spill file in %s: %s",
+                AESD_SERVER_SPILL_DIR, strerror(errno));
+            return false;
+        }
+    }
+
+    if (conn->spill_len == 0) {
+        AESD_LOG_WITH_FUNC_INFO("Line of connection %u exceeds the memory budget. Spilling it",
+            conn->id);
+    }
+
+    const char * data = conn->rx_buf + conn->rx_start;
+    size_t len = conn->rx_len - conn->rx_start;
+    while (len > 0) {
+        ssize_t written = pwrite(conn->spill_fd, data, len, conn->spill_len);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            AESD_LOG_WITH_FUNC_ERR("Error on spilling a line of connection %u: %s",
+                conn->id, strerror(errno));
+            return false;
+        }
+        data += written;
+        len -= written;
+        conn->spill_len += written;
+    }
+
+    conn->rx_start = conn->rx_len = conn->rx_eol_search = 0;
+    return true;
+}
+
+/// Forgets the spilled bytes once handed out. The file is kept for the next long line
+static void
+conn_spill_reset(struct aesd_conn * conn)
+{
+    if (conn->spill_len == 0) {
+        return;
+    }
+
+    if (ftruncate(conn->spill_fd, 0) == -1) {
+        AESD_LOG_WITH_FUNC_ERR("Error on truncating the spill file of connection %u: %s",
+            conn->id, strerror(errno));
+    }
+    conn->spill_len = 0;
+    conn->spill_off = 0;
+}
+
+/**
+ * @brief Copies up to @a buf_len spilled bytes of the current line to @a buf.
+ *
+ * @return bytes copied. On a read error the spilled bytes are dropped and 0 is returned
+ */
+static size_t
+conn_take_spilled(struct aesd_conn * conn, void * buf, size_t buf_len)
+{
+    size_t len = conn->spill_len - conn->spill_off;
+    if (len > buf_len) {
+        len = buf_len;
+    }
+
+    size_t copied = 0;
+    while (copied < len) {
+        ssize_t num_read = pread(conn->spill_fd, (char *)buf + copied, len - copied,
+            conn->spill_off + copied);
+        if (num_read == -1 && errno == EINTR) {
+            continue;
+        }
+        if (num_read <= 0) {
+            AESD_LOG_WITH_FUNC_ERR("Error on reading back a line of connection %u: %s. "
+                "Dropping its first %llu bytes", conn->id, num_read == 0 ? "truncated" :
+                strerror(errno), (unsigned long long)conn->spill_len);
+            conn_spill_reset(conn);
+            return 0;
+        }
+        copied += num_read;
+    }
+
+    conn->spill_off += copied;
+    return copied;
+}
+
+/// Bytes of @a conn were handed out: reads may resume and a drained oversized buffer is freed
+static void
+conn_rx_consumed(aesd_server_impl_t * impl, struct aesd_conn * conn)
+{
+    conn->rx_blocked = false;
+
+    if (conn->rx_start == conn->rx_len && conn->rx_cap > AESD_SERVER_RX_BUF_SIZE) {
+        impl->rx_mem -= conn->rx_cap;
+        free(conn->rx_buf);
+        conn->rx_buf = NULL;
+        conn->rx_cap = 0;
+        conn->rx_start = conn->rx_len = conn->rx_eol_search = 0;
+    }
+}
+
+/**
+ * @brief Copies the next line of @a conn to @a buf (or every complete line that fits, when
+ * @a whole_batch is true). Control lines are consumed here and never reach the caller.
+ *
+ * @retval AESD_SERVER_RET_EOL_NOT_FOUND if @a conn has nothing to hand out right now or a
+ * control line was just consumed
+ */
+static aesd_server_ret_t
+conn_take(aesd_server_impl_t * impl, struct aesd_conn * conn, void * buf, size_t buf_len,
+    size_t * line_size, bool whole_batch)
+{
+    char * eol;
+    char * start;
+
+    while (true) {
+        eol = conn_find_eol(conn);
+        if (eol == NULL) {
+            return AESD_SERVER_RET_EOL_NOT_FOUND;
+        }
+
+        start = conn->rx_buf + conn->rx_start;
+        if (impl->current_mid_line || conn->spill_len > 0 ||
+            !conn_handle_control(impl, conn, start, eol - start))
+        {
+            break;
+        }
+
+        // Let the caller push whatever the command asked for before the next line
+        conn->rx_start = eol - conn->rx_buf + 1;
+        return AESD_SERVER_RET_EOL_NOT_FOUND;
+    }
+
+    // A line that outgrew the memory budget starts in the spill file
+    size_t spilled = 0;
+    if (conn->spill_off < conn->spill_len) {
+        spilled = conn_take_spilled(conn, buf, buf_len);
+    }
+    if (conn->spill_off == conn->spill_len) {
+        conn_spill_reset(conn);
+    }
+
+    char * dst = (char *)buf + spilled;
+    size_t room = buf_len - spilled;
+    if ((size_t)(eol - start) + 1 > room) {
+        memcpy(dst, start, room);
+        conn->rx_start += room;
+        conn_rx_consumed(impl, conn);
+        impl->current_mid_line = true;
+        *line_size = 0;
+        AESD_TRACE3(get_line, conn->id, buf_len, AESD_SERVER_RET_BUF_FULL);
+        return AESD_SERVER_RET_BUF_FULL;
+    }
+
+    if (whole_batch) {
+        // Extend the batch with the following lines while they fit and are plain data
+        char * rx_end = conn->rx_buf + conn->rx_len;
+        char * next_eol;
+        while (eol + 1 < rx_end &&
+            (next_eol = memchr(eol + 1, '\n', rx_end - eol - 1)) != NULL &&
+            (size_t)(next_eol - start) + 1 <= room &&
+            memcmp(eol + 1, AESD_SERVER_CTRL_PREFIX, sizeof(AESD_SERVER_CTRL_PREFIX) - 1) != 0)
+        {
+            eol = next_eol;
+        }
+    }
+
+    memcpy(dst, start, eol - start + 1);
+    conn->rx_start += eol - start + 1;
+    conn_rx_consumed(impl, conn);
+    *line_size = spilled + (eol - start);
+    impl->current_mid_line = false;
+    AESD_LOG_WITH_FUNC_DEBUG("End of line found at buf[%ld]", *line_size);
+    AESD_TRACE3(get_line, conn->id, *line_size + 1, AESD_SERVER_RET_EOL_FOUND);
+
+    return AESD_SERVER_RET_EOL_FOUND;
+}
+
+/**
+ * @brief Reads what @a conn has queued, up to AESD_SERVER_RX_BUF_SIZE bytes.
+ */
+static void
+conn_recv(aesd_server_impl_t * impl, struct aesd_conn * conn)
+{
+    size_t total_bytes_read = 0;
+
+    while (total_bytes_read < AESD_SERVER_RX_BUF_SIZE) {
+        if (conn->rx_start == conn->rx_len) {
+            conn->rx_start = conn->rx_len = conn->rx_eol_search = 0;
+        }
+
+        if (conn->rx_cap - conn->rx_len < AESD_SERVER_RX_MIN_FREE && conn->rx_start > 0) {
+            memmove(conn->rx_buf, conn->rx_buf + conn->rx_start, conn->rx_len - conn->rx_start);
+            conn->rx_len -= conn->rx_start;
+            conn->rx_eol_search -= conn->rx_start;
+            conn->rx_start = 0;
+        }
+
+        if (conn->rx_cap - conn->rx_len < AESD_SERVER_RX_MIN_FREE) {
+            size_t new_cap = conn->rx_cap ? conn->rx_cap * 2 : AESD_SERVER_RX_MIN_FREE;
+            if (!conn_rx_may_grow(impl, conn, new_cap)) {
+                if (conn_find_eol(conn) != NULL) {
+                    // Complete lines fill the budget. Let the caller take some first
+                    conn->rx_blocked = true;
+                    break;
+                }
+                if (!conn_spill(impl, conn)) {
+                    conn_close(impl, conn);
+                    return;
+                }
+                continue;
+            }
+
+            char * new_buf = realloc(conn->rx_buf, new_cap);
+            if (new_buf == NULL) {
+                AESD_LOG_WITH_FUNC_ERR("Error during memory allocation: %s", strerror(errno));
+                conn_close(impl, conn);
+                return;
+            }
+            impl->rx_mem += new_cap - conn->rx_cap;
+            conn->rx_buf = new_buf;
+            conn->rx_cap = new_cap;
+        }
+
+        // Never read more than the quota allows, so the rest waits in the socket buffer
+        size_t read_len = conn->rx_cap - conn->rx_len;
+        uint64_t quota = aesd_token_bucket_available(&conn->bytes_bucket, aesd_monotonic_ns());
+        if (quota < read_len) {
+            read_len = quota > 0 ? quota : 1;
+        }
+
+        ssize_t num_bytes_read = recv(conn->fd, conn->rx_buf + conn->rx_len, read_len, 0);
+
         if (num_bytes_read == 0) {
-            return AESD_SERVER_RET_NO_BYTES_READ;
+            conn->peer_closed = true;
+            break;
         }
 
         if (num_bytes_read == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
             if (errno == EINTR) {
-                syslog(LOG_INFO, "recv interrupted due to signal handling\n");
-                return AESD_SERVER_RET_ERROR;
+                continue;
             }
             syslog(LOG_ERR, "Error during recv call: %s\n", strerror(errno));
-            return AESD_SERVER_RET_ERROR;
+            conn_close(impl, conn);
+            return;
         }
 
-        first_end_str = memchr(buf, '\n', num_bytes_read);
-        if (first_end_str != NULL) {
-            *line_size = first_end_str - this_buf;
-            AESD_LOG_WITH_FUNC_DEBUG("End of line found at buf[%ld]", *line_size);
-            return AESD_SERVER_RET_EOL_FOUND;
+        conn->rx_len += num_bytes_read;
+        total_bytes_read += num_bytes_read;
+        AESD_TRACE3(recv, conn->id, num_bytes_read, conn->rx_len - conn->rx_start);
+        if (impl->capture != NULL) {
+            aesd_capture_record(impl->capture, conn->id, AESD_CAPTURE_DATA,
+                conn->rx_buf + conn->rx_len - num_bytes_read, num_bytes_read);
         }
+        conn_touch(impl, conn);
 
-        if (buf_len == num_bytes_read) {
-            return AESD_SERVER_RET_BUF_FULL;
+        if (aesd_token_bucket_enabled(&conn->bytes_bucket)) {
+            uint64_t now_ns = aesd_monotonic_ns();
+            aesd_token_bucket_consume(&conn->bytes_bucket, num_bytes_read, now_ns);
+
+            uint64_t delay_ns = aesd_token_bucket_delay_ns(&conn->bytes_bucket, 0, now_ns);
+            if (delay_ns != 0) {
+                conn_throttle(impl, conn, &conn->read_paused_until_ns, delay_ns, now_ns);
+                break;
+            }
         }
+    }
 
-        total_bytes_read += num_bytes_read;
+    // The read deadline starts with the first byte of a line and the bytes that follow do not
+    // push it forward, so trickling a line one byte at a time does not keep it alive
+    bool partial_line = conn->rx_len > conn->rx_start ?
+        conn->rx_buf[conn->rx_len - 1] != '\n' : conn->spill_len > 0;
+    if (!partial_line) {
+        aesd_timer_cancel(&impl->timers, &conn->read_timer);
+    } else if (!aesd_timer_pending(&conn->read_timer)) {
+        conn_arm_timer(impl, &conn->read_timer, impl->limits.read_timeout_sec);
+    }
+
+    conn_update(impl, conn);
+}
+
+static void
+accept_connections(aesd_server_impl_t * impl)
+{
+    while (true) {
+        struct sockaddr_storage client_addr;
+        socklen_t client_addr_len = sizeof(client_addr);
+
+        int connection_fd = accept4(impl->socket_fd, (struct sockaddr *)&client_addr,
+            &client_addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (connection_fd == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return;
+            }
+            if (errno == ECONNABORTED) {
+                continue;
+            }
+            syslog(LOG_ERR, "Error on accepting new connection: %s", strerror(errno));
+            return;
+        }
+
+        // Shedding right here costs one accept() and one close(), and keeps an overloaded
+        // server from spending memory on clients it cannot serve
+        uint32_t addr = ((struct sockaddr_in *)&client_addr)->sin_addr.s_addr;
+        if ((impl->limits.max_connections != 0 &&
+                impl->num_connections >= impl->limits.max_connections) ||
+            !aesd_ip_table_acquire(impl->ip_table, addr, impl->limits.max_connections_per_ip))
+        {
+            close(connection_fd);
+            AESD_TRACE1(refuse, addr);
+            if (impl->num_shed++ % 1000 == 0) {
+                syslog(LOG_INFO, "Refused %llu connections over the admission limits",
+                    (unsigned long long)impl->num_shed);
+            }
+            continue;
+        }
+
+        struct aesd_conn * conn = calloc(1, sizeof(struct aesd_conn));
+        if (conn == NULL) {
+            syslog(LOG_ERR, "Error during memory allocation: %s", strerror(errno));
+            aesd_ip_table_release(impl->ip_table, addr);
+            close(connection_fd);
+            continue;
+        }
+
+        conn->impl = impl;
+        conn->fd = connection_fd;
+        conn->id = impl->next_conn_id++;
+        conn->addr = addr;
+        conn->epoll_events = EPOLLIN;
+        conn->spill_fd = -1;
+        aesd_list_init(&conn->ready_node);
+        aesd_list_init(&conn->sub_node);
+        aesd_timer_init(&conn->throttle_timer, on_throttle_timer);
+        aesd_timer_init(&conn->idle_timer, on_idle_timer);
+        aesd_timer_init(&conn->read_timer, on_read_timer);
+        aesd_timer_init(&conn->send_timer, on_send_timer);
+        inet_ntop(AF_INET, &((struct sockaddr_in *)&client_addr)->sin_addr,
+            conn->ip_str, sizeof(conn->ip_str));
+
+        // One second worth of quota is allowed in a burst
+        uint64_t now_ns = aesd_monotonic_ns();
+        aesd_token_bucket_init(&conn->bytes_bucket, impl->limits.bytes_per_sec,
+            impl->limits.bytes_per_sec, now_ns);
+        aesd_token_bucket_init(&conn->lines_bucket, impl->limits.lines_per_sec,
+            impl->limits.lines_per_sec, now_ns);
+
+        struct epoll_event event = { .events = conn->epoll_events, .data.ptr = conn };
+        if (epoll_ctl(impl->epoll_fd, EPOLL_CTL_ADD, connection_fd, &event) == -1) {
+            syslog(LOG_ERR, "Error on watching new connection: %s", strerror(errno));
+            aesd_ip_table_release(impl->ip_table, addr);
+            close(connection_fd);
+            free(conn);
+            continue;
+        }
+
+        impl->num_connections++;
+        aesd_list_push_back(&impl->connections, &conn->node);
+        conn_touch(impl, conn);
+        AESD_TRACE2(accept, conn->id, conn->addr);
+        if (impl->capture != NULL) {
+            aesd_capture_record(impl->capture, conn->id, AESD_CAPTURE_OPEN, &conn->addr,
+                sizeof(conn->addr));
+        }
+        syslog(LOG_INFO, "Accepted connection from %s", conn->ip_str);
+    }
+}
+
+/**
+ * @brief Waits up to @a timeout_ms for socket events and handles them: accepts clients,
+ * receives data and continues pending sends.
+ */
+static aesd_server_ret_t
+wait_for_events(aesd_server_impl_t * impl, int timeout_ms)
+{
+    struct epoll_event events[AESD_SERVER_MAX_EVENTS];
+
+    int num_events = epoll_pwait(impl->epoll_fd, events, AESD_SERVER_MAX_EVENTS, timeout_ms,
+        impl->has_wait_sigmask ? &impl->wait_sigmask : NULL);
+    if (num_events == -1) {
+        if (errno == EINTR) {
+            syslog(LOG_INFO, "epoll_wait interrupted due to signal handling\n");
+        } else {
+            AESD_LOG_WITH_FUNC_ERR("Error on waiting for events: %s", strerror(errno));
+        }
+        return AESD_SERVER_RET_ERROR;
+    }
+
+    for (int i = 0; i < num_events; i++) {
+        struct aesd_conn * conn = events[i].data.ptr;
+        if (conn == NULL) {
+            accept_connections(impl);
+            continue;
+        }
+
+        if (events[i].events & EPOLLOUT) {
+            if (!conn_send(impl, conn)) {
+                continue;
+            }
+        }
+
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            conn_recv(impl, conn);
+        }
+    }
+
+    return AESD_SERVER_RET_OK;
+}
+
+void
+aesd_server_start_accept_connections(aesd_server_t * aesd_server)
+{
+    aesd_server_impl_t * impl = aesd_server->impl;
+    if (impl->accepting) {
+        return;
+    }
+
+    int flags = fcntl(impl->socket_fd, F_GETFL);
+    if (flags == -1 || fcntl(impl->socket_fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        syslog(LOG_ERR, "Error on making the socket non-blocking: %s", strerror(errno));
+        return;
+    }
+
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+    if (epoll_ctl(impl->epoll_fd, EPOLL_CTL_ADD, impl->socket_fd, &event) == -1) {
+        syslog(LOG_ERR, "Error on watching the server socket: %s", strerror(errno));
+        return;
+    }
+
+    syslog(LOG_INFO, "AESD Server ready to receive data");
+    impl->accepting = true;
+}
+
+void
+aesd_server_set_wait_sigmask(aesd_server_t * aesd_server, const sigset_t * sigmask)
+{
+    aesd_server->impl->wait_sigmask = *sigmask;
+    aesd_server->impl->has_wait_sigmask = true;
+}
+
+void
+aesd_server_set_limits(aesd_server_t * aesd_server, const aesd_server_limits_t * limits)
+{
+    aesd_server->impl->limits = *limits;
+}
+
+void
+aesd_server_attach_log(aesd_server_t * aesd_server, int file_fd)
+{
+    struct stat file_stat;
+    if (fstat(file_fd, &file_stat) == -1) {
+        AESD_LOG_WITH_FUNC_ERR("File does not exist or cannot be accessed: %s", strerror(errno));
+        return;
+    }
+
+    aesd_server->impl->log_fd = file_fd;
+    aesd_server->impl->committed = file_stat.st_size;
+}
+
+void
+aesd_server_set_capture(aesd_server_t * aesd_server, aesd_capture_t * capture)
+{
+    aesd_server->impl->capture = capture;
+}
+
+/// Charges the lines of a batch just handed out to the lines/sec quota of @a conn
+static void
+consume_lines(struct aesd_conn * conn, const char * batch, size_t batch_size)
+{
+    if (!aesd_token_bucket_enabled(&conn->lines_bucket)) {
+        return;
+    }
+
+    size_t num_lines = 0;
+    const char * end = batch + batch_size;
+    while ((batch = memchr(batch, '\n', end - batch)) != NULL) {
+        num_lines++;
+        batch++;
+    }
+
+    aesd_token_bucket_consume(&conn->lines_bucket, num_lines, aesd_monotonic_ns());
+}
+
+/**
+ * @brief Seals the next blocks of the log, described by @a log_stat, into the compressed log.
+ *
+ * @return true if complete blocks are left to seal, for a later call
+ */
+static bool
+seal_log(aesd_server_impl_t * impl, int log_fd, const struct stat * log_stat)
+{
+    if (impl->lz_log == NULL || impl->lz_log_failed) {
+        return false;
+    }
+
+    if (aesd_lz_log_sync(impl->lz_log, log_fd, log_stat) != AESD_RET_OK) {
+        AESD_LOG_WITH_FUNC_ERR("Compressed replies carry a longer raw tail until sealing succeeds");
+        impl->lz_log_failed = true;
+        return false;
+    }
+
+    return aesd_lz_log_behind(impl->lz_log, log_stat->st_size);
+}
+
+/// Goes on sealing a log that grew by more than a commit seals, between polls for events
+static bool
+seal_log_backlog(aesd_server_impl_t * impl)
+{
+    if (impl->lz_log == NULL || impl->lz_log_failed || impl->log_fd < 0 ||
+        !aesd_lz_log_behind(impl->lz_log, impl->committed))
+    {
+        return false;
+    }
+
+    struct stat log_stat;
+    if (fstat(impl->log_fd, &log_stat) == -1) {
+        AESD_LOG_WITH_FUNC_ERR("Error on reading the state of the log: %s", strerror(errno));
+        impl->lz_log_failed = true;
+        return false;
     }
 
+    return seal_log(impl, impl->log_fd, &log_stat);
+}
+
+static aesd_server_ret_t
+get_lines(aesd_server_t * aesd_server, void * buf, size_t buf_len, size_t * line_size,
+    bool whole_batch)
+{
+    assert(line_size);
+
+    if (aesd_server == NULL) {
+        AESD_LOG_WITH_FUNC_ERR("server is not properly initialized. Passed a null pointer");
+        return -1;
+    }
+
+    aesd_server_impl_t * impl = aesd_server->impl;
+    aesd_server_ret_t ret;
     *line_size = 0;
 
-    return AESD_SERVER_RET_EOL_NOT_FOUND;
+    if (impl->current != NULL) {
+        struct aesd_conn * conn = impl->current;
+        if (impl->current_mid_line) {
+            return conn_take(impl, conn, buf, buf_len, line_size, whole_batch);
+        }
+
+        // The previous line was answered (or the caller chose not to). Move on
+        impl->current = NULL;
+        conn_update(impl, conn);
+    }
+
+    while (true) {
+        aesd_list_t * node;
+        while (impl->lines_since_poll < AESD_SERVER_LINES_PER_POLL &&
+            (node = aesd_list_pop_front(&impl->ready)) != NULL)
+        {
+            struct aesd_conn * conn = AESD_LIST_ENTRY(node, struct aesd_conn, ready_node);
+            if (aesd_token_bucket_enabled(&conn->lines_bucket)) {
+                uint64_t now_ns = aesd_monotonic_ns();
+                uint64_t delay_ns = aesd_token_bucket_delay_ns(&conn->lines_bucket, 1, now_ns);
+                if (delay_ns != 0) {
+                    conn_throttle(impl, conn, &conn->lines_paused_until_ns, delay_ns, now_ns);
+                    conn_update(impl, conn);
+                    continue;
+                }
+            }
+
+            ret = conn_take(impl, conn, buf, buf_len, line_size, whole_batch);
+            if (ret != AESD_SERVER_RET_EOL_NOT_FOUND) {
+                if (ret == AESD_SERVER_RET_EOL_FOUND) {
+                    consume_lines(conn, buf, *line_size + 1);
+                }
+                impl->current = conn;
+                impl->lines_since_poll++;
+                return ret;
+            }
+
+            // A command may have queued its answer
+            if (!conn_tx_idle(conn)) {
+                conn_send(impl, conn);
+            } else if (conn_push(impl, conn)) {
+                conn_update(impl, conn);
+            }
+        }
+
+        flush_subscribers(impl);
+        bool sealing = seal_log_backlog(impl);
+
+        int timeout_ms = run_timers(impl);
+        if (!aesd_list_empty(&impl->ready) || sealing) {
+            timeout_ms = 0;
+        }
+
+        impl->lines_since_poll = 0;
+        ret = wait_for_events(impl, timeout_ms);
+        if (ret == AESD_SERVER_RET_ERROR) {
+            return ret;
+        }
+    }
+}
+
+aesd_server_ret_t
+aesd_server_get_line(aesd_server_t * aesd_server, void * buf, size_t buf_len, size_t * line_size)
+{
+    return get_lines(aesd_server, buf, buf_len, line_size, false);
+}
+
+aesd_server_ret_t
+aesd_server_get_lines(aesd_server_t * aesd_server, void * buf, size_t buf_len, size_t * batch_size)
+{
+    return get_lines(aesd_server, buf, buf_len, batch_size, true);
 }
 
 aesd_server_ret_t
@@ -284,19 +1455,91 @@ aesd_server_send_file_content(aesd_server_t * aesd_server, int file_fd) {
         return AESD_SERVER_RET_ERROR;
     }
 
-    off_t file_offset = 0;  // Always read from the begin of the file
-    int ret = sendfile(aesd_server->impl->connection_fd, file_fd, &file_offset, file_stat.st_size);
+    aesd_server_impl_t * impl = aesd_server->impl;
+    impl->log_fd = file_fd;
+    impl->committed = file_stat.st_size;
+    impl->commit_pending = true;
 
-    if (ret == -1) {
-        AESD_LOG_WITH_FUNC_ERR("Error on transferring data between fds: %s", strerror(errno));
-        return AESD_SERVER_RET_ERROR;
+    // Blocks are compressed once, as the log grows past them, whoever the reply is for. A few
+    // per commit: a log that was long already when the first client asked for compression is
+    // sealed over the next polls, and replies carry a longer raw tail meanwhile
+    impl->lz_log_failed = false;
+    seal_log(impl, file_fd, &file_stat);
+
+    struct aesd_conn * conn = impl->current;
+    if (conn == NULL) {
+        // The client hung up before its reply was ready
+        return AESD_SERVER_RET_OK;
     }
 
-    if (ret != file_stat.st_size) {
-        AESD_LOG_WITH_FUNC_ERR(
-            "Expected to transfer %ld, but only %d was transferred", file_stat.st_size, ret);
-        return AESD_SERVER_RET_ERROR;
+    impl->current = NULL;
+    if (conn->subscribed) {
+        // Subscribers get the new bytes only, which include their own line
+        if (conn_push(impl, conn)) {
+            conn_update(impl, conn);
+        }
+        return AESD_SERVER_RET_OK;
+    }
+
+    // Always read from the begin of the file
+    if (!conn->compressed) {
+        conn_tx_set_range(conn, file_fd, 0, file_stat.st_size);
+    } else if (!conn_tx_set_frames(impl, conn, file_fd, file_stat.st_size)) {
+        AESD_LOG_WITH_FUNC_ERR("Log too long to be sent uncompressed to connection %u", conn->id);
+        conn_close(impl, conn);
+        return AESD_SERVER_RET_OK;
     }
+    conn_send(impl, conn);
 
     return AESD_SERVER_RET_OK;
 }
+
+void
+aesd_server_fini(aesd_server_t * aesd_server)
+{
+    assert(aesd_server);
+
+    aesd_list_t * node;
+    aesd_list_t * tmp;
+    AESD_LIST_FOR_EACH_SAFE(node, tmp, &aesd_server->impl->connections) {
+        conn_close(aesd_server->impl, AESD_LIST_ENTRY(node, struct aesd_conn, node));
+    }
+
+    close(aesd_server->impl->socket_fd);
+    close(aesd_server->impl->epoll_fd);
+    aesd_ip_table_destroy(aesd_server->impl->ip_table);
+    aesd_lz_log_destroy(aesd_server->impl->lz_log);
+}
+
+aesd_server_t *
+aesd_server_create()
+{
+    aesd_server_t * aesd_server = aesd_server_alloc();
+    if (!aesd_server) {
+        goto error_alloc;
+    }
+
+    aesd_server_t * tmp = aesd_server_init(aesd_server);
+    if (!tmp) {
+        goto error_init;
+    }
+    aesd_server = tmp;
+
+    return aesd_server;
+
+error_init:
+    aesd_server_free(aesd_server);
+error_alloc:
+    return NULL;
+}
+
+void
+aesd_server_destroy(aesd_server_t * aesd_server)
+{
+    // aesd_server_destroy() and aesd_server_free() are the only methods which can be called
+    // with `aesd_server == NULL`.
+    if (aesd_server) {
+        aesd_server_fini(aesd_server);
+        aesd_server_free(aesd_server);
+    }
+}
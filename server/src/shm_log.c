@@ -0,0 +1,304 @@
+// Copyright (c) 2025 Mateus Menezes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#define _GNU_SOURCE  // mremap()
+
+#include "aeds/shm_log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "aeds/server.h"
+
+/// Data area backed when the log is created. It doubles every time it fills up, up to
+/// AESD_SHM_LOG_MAX_CAPACITY
+#define AESD_SHM_LOG_INITIAL_CAPACITY (1024 * 1024)
+
+struct aesd_shm_log_impl_s {
+    char * name;
+    int fd;
+    uint8_t * map;
+    size_t map_len;
+    struct aesd_shm_log_header * header;
+    uint64_t committed;  // Writer private copy, avoids reading back the shared header
+};
+
+static size_t
+header_size(void)
+{
+    // Keep the data area page aligned so readers can map it without surprises
+    return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+static aesd_ret_t
+grow(aesd_shm_log_impl_t * impl, uint64_t needed)
+{
+    if (needed > AESD_SHM_LOG_MAX_CAPACITY) {
+        AESD_LOG_WITH_FUNC_INFO("%s would outgrow its %llu bytes limit, no longer exporting",
+            impl->name, (unsigned long long)AESD_SHM_LOG_MAX_CAPACITY);
+        return AESD_RET_ERROR;
+    }
+
+    uint64_t capacity = impl->header->capacity;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    if (capacity > AESD_SHM_LOG_MAX_CAPACITY) {
+        capacity = AESD_SHM_LOG_MAX_CAPACITY;
+    }
+
+    size_t new_len = header_size() + capacity;
+    if (ftruncate(impl->fd, new_len) == -1) {
+        AESD_LOG_WITH_FUNC_ERR("Error on growing %s to %zu bytes: %s",
+            impl->name, new_len, strerror(errno));
+        return AESD_RET_ERROR;
+    }
+
+    void * new_map = mremap(impl->map, impl->map_len, new_len, MREMAP_MAYMOVE);
+    if (new_map == MAP_FAILED) {
+        AESD_LOG_WITH_FUNC_ERR("Error on remapping %s: %s", impl->name, strerror(errno));
+        return AESD_RET_ERROR;
+    }
+
+    impl->map = new_map;
+    impl->map_len = new_len;
+    impl->header = (struct aesd_shm_log_header *)new_map;
+    __atomic_store_n(&impl->header->capacity, capacity, __ATOMIC_RELEASE);
+
+    AESD_LOG_WITH_FUNC_DEBUG("Shared log capacity is now %llu bytes",
+        (unsigned long long)capacity);
+    return AESD_RET_OK;
+}
+
+aesd_shm_log_t *
+aesd_shm_log_create(const char * name)
+{
+    aesd_shm_log_t * shm_log = malloc(sizeof(aesd_shm_log_t));
+    if (shm_log == NULL) {
+        AESD_LOG_WITH_FUNC_ERR("Error during memory allocation: %s", strerror(errno));
+        return NULL;
+    }
+
+    shm_log->impl = calloc(1, sizeof(aesd_shm_log_impl_t));
+    if (shm_log->impl == NULL) {
+        AESD_LOG_WITH_FUNC_ERR("Error during memory allocation: %s", strerror(errno));
+        goto error_free_outer;
+    }
+
+    aesd_shm_log_impl_t * impl = shm_log->impl;
+    impl->name = strdup(name);
+    if (impl->name == NULL) {
+        goto error_free_impl;
+    }
+
+    impl->fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (impl->fd == -1) {
+        AESD_LOG_WITH_FUNC_ERR("Error on opening shared memory %s: %s", name, strerror(errno));
+        goto error_free_name;
+    }
+
+    impl->map_len = header_size() + AESD_SHM_LOG_INITIAL_CAPACITY;
+    if (ftruncate(impl->fd, impl->map_len) == -1) {
+        AESD_LOG_WITH_FUNC_ERR("Error on sizing shared memory %s: %s", name, strerror(errno));
+        goto error_unlink;
+    }
+
+    impl->map = mmap(NULL, impl->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, impl->fd, 0);
+    if (impl->map == MAP_FAILED) {
+        AESD_LOG_WITH_FUNC_ERR("Error on mapping shared memory %s: %s", name, strerror(errno));
+        goto error_unlink;
+    }
+
+    impl->header = (struct aesd_shm_log_header *)impl->map;
+    impl->header->data_offset = header_size();
+    impl->header->capacity = AESD_SHM_LOG_INITIAL_CAPACITY;
+    impl->header->version = AESD_SHM_LOG_VERSION;
+    // A reader only trusts the rest of the header once it sees the magic number
+    __atomic_store_n(&impl->header->magic, AESD_SHM_LOG_MAGIC, __ATOMIC_RELEASE);
+
+    syslog(LOG_INFO, "Exporting the log through shared memory %s", name);
+    return shm_log;
+
+error_unlink:
+    close(impl->fd);
+    shm_unlink(name);
+error_free_name:
+    free(impl->name);
+error_free_impl:
+    free(shm_log->impl);
+error_free_outer:
+    free(shm_log);
+    return NULL;
+}
+
+void
+aesd_shm_log_destroy(aesd_shm_log_t * shm_log)
+{
+    if (shm_log == NULL) {
+        return;
+    }
+
+    aesd_shm_log_impl_t * impl = shm_log->impl;
+    __atomic_fetch_or(&impl->header->flags, AESD_SHM_LOG_FLAG_CLOSED, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&impl->header->sequence, 1, __ATOMIC_RELEASE);
+
+    munmap(impl->map, impl->map_len);
+    close(impl->fd);
+    if (shm_unlink(impl->name) == -1) {
+        AESD_LOG_WITH_FUNC_ERR("Error on removing %s: %s", impl->name, strerror(errno));
+    }
+
+    free(impl->name);
+    free(impl);
+    free(shm_log);
+}
+
+aesd_ret_t
+aesd_shm_log_append(aesd_shm_log_t * shm_log, const void * data, size_t len)
+{
+    aesd_shm_log_impl_t * impl = shm_log->impl;
+
+    if (impl->header->flags & AESD_SHM_LOG_FLAG_OVERFLOW) {
+        return AESD_RET_ERROR;
+    }
+
+    uint64_t new_committed = impl->committed + len;
+    if (new_committed > impl->header->capacity && grow(impl, new_committed) != AESD_RET_OK) {
+        __atomic_fetch_or(&impl->header->flags, AESD_SHM_LOG_FLAG_OVERFLOW, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&impl->header->sequence, 1, __ATOMIC_RELEASE);
+        return AESD_RET_ERROR;
+    }
+
+    memcpy(impl->map + impl->header->data_offset + impl->committed, data, len);
+    impl->committed = new_committed;
+
+    __atomic_store_n(&impl->header->committed, new_committed, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&impl->header->sequence, 1, __ATOMIC_RELEASE);
+
+    return AESD_RET_OK;
+}
+
+uint64_t
+aesd_shm_log_committed(const aesd_shm_log_t * shm_log)
+{
+    return shm_log->impl->committed;
+}
+
+aesd_ret_t
+aesd_shm_log_reader_open(aesd_shm_log_reader_t * reader, const char * name)
+{
+    memset(reader, 0, sizeof(*reader));
+
+    reader->fd = shm_open(name, O_RDONLY, 0);
+    if (reader->fd == -1) {
+        return AESD_RET_ERROR;
+    }
+
+    struct stat shm_stat;
+    if (fstat(reader->fd, &shm_stat) == -1 || (size_t)shm_stat.st_size < header_size()) {
+        goto error_close;
+    }
+
+    reader->map_len = shm_stat.st_size;
+    reader->map = mmap(NULL, reader->map_len, PROT_READ, MAP_SHARED, reader->fd, 0);
+    if (reader->map == MAP_FAILED) {
+        goto error_close;
+    }
+
+    const struct aesd_shm_log_header * header = (const struct aesd_shm_log_header *)reader->map;
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != AESD_SHM_LOG_MAGIC ||
+        header->version != AESD_SHM_LOG_VERSION)
+    {
+        munmap((void *)reader->map, reader->map_len);
+        goto error_close;
+    }
+
+    return AESD_RET_OK;
+
+error_close:
+    close(reader->fd);
+    reader->fd = -1;
+    return AESD_RET_ERROR;
+}
+
+size_t
+aesd_shm_log_reader_poll(aesd_shm_log_reader_t * reader, const uint8_t ** data)
+{
+    const struct aesd_shm_log_header * header = (const struct aesd_shm_log_header *)reader->map;
+
+    // The writer bumps the sequence after publishing, so an unchanged one means nothing new
+    uint64_t sequence = __atomic_load_n(&header->sequence, __ATOMIC_ACQUIRE);
+    if (sequence == reader->last_sequence) {
+        return 0;
+    }
+
+    uint64_t committed = __atomic_load_n(&header->committed, __ATOMIC_ACQUIRE);
+    if (committed <= reader->cursor) {
+        reader->last_sequence = sequence;
+        return 0;
+    }
+
+    if (header->data_offset + committed > reader->map_len) {
+        // The writer grew the log after we mapped it. The capacity was published before
+        // committed, so it already covers every byte we are about to read
+        size_t new_len = header->data_offset + __atomic_load_n(&header->capacity, __ATOMIC_ACQUIRE);
+        void * new_map = mmap(NULL, new_len, PROT_READ, MAP_SHARED, reader->fd, 0);
+        if (new_map == MAP_FAILED) {
+            return 0;  // Leaves last_sequence behind, so the next call tries again
+        }
+
+        munmap((void *)reader->map, reader->map_len);
+        reader->map = new_map;
+        reader->map_len = new_len;
+        header = (const struct aesd_shm_log_header *)reader->map;
+    }
+
+    *data = reader->map + header->data_offset + reader->cursor;
+    size_t new_bytes = committed - reader->cursor;
+    reader->cursor = committed;
+    reader->last_sequence = sequence;
+
+    return new_bytes;
+}
+
+uint32_t
+aesd_shm_log_reader_flags(const aesd_shm_log_reader_t * reader)
+{
+    const struct aesd_shm_log_header * header = (const struct aesd_shm_log_header *)reader->map;
+    return __atomic_load_n(&header->flags, __ATOMIC_ACQUIRE);
+}
+
+void
+aesd_shm_log_reader_close(aesd_shm_log_reader_t * reader)
+{
+    if (reader->fd == -1) {
+        return;
+    }
+
+    munmap((void *)reader->map, reader->map_len);
+    close(reader->fd);
+    reader->fd = -1;
+}
@@ -0,0 +1,179 @@
+// Copyright (c) 2025 Mateus Menezes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "aeds/timer_wheel.h"
+
+#include <stddef.h>
+
+#define SLOT_MASK (AESD_TIMER_WHEEL_SLOTS - 1)
+#define LEVEL_SHIFT(level) ((level) * AESD_TIMER_WHEEL_BITS)
+/// Farthest deadline a timer can be placed at. Farther ones are placed here and re-placed
+/// when they cascade down
+#define MAX_DELTA ((1ull << LEVEL_SHIFT(AESD_TIMER_WHEEL_LEVELS)) - 1)
+
+void
+aesd_timer_wheel_init(aesd_timer_wheel_t * wheel, uint64_t now)
+{
+    wheel->now = now;
+    wheel->num_pending = 0;
+
+    for (size_t level = 0; level < AESD_TIMER_WHEEL_LEVELS; level++) {
+        for (size_t slot = 0; slot < AESD_TIMER_WHEEL_SLOTS; slot++) {
+            aesd_list_init(&wheel->slots[level][slot]);
+        }
+    }
+}
+
+void
+aesd_timer_init(aesd_timer_t * timer, aesd_timer_callback_t callback)
+{
+    aesd_list_init(&timer->node);
+    timer->expires = 0;
+    timer->callback = callback;
+}
+
+static void
+place(aesd_timer_wheel_t * wheel, aesd_timer_t * timer)
+{
+    uint64_t expires = timer->expires < wheel->now ? wheel->now : timer->expires;
+    uint64_t delta = expires - wheel->now;
+    if (delta > MAX_DELTA) {
+        delta = MAX_DELTA;
+        expires = wheel->now + delta;
+    }
+
+    size_t level = 0;
+    while (level < AESD_TIMER_WHEEL_LEVELS - 1 && delta >= 1ull << LEVEL_SHIFT(level + 1)) {
+        level++;
+    }
+
+    size_t slot = (expires >> LEVEL_SHIFT(level)) & SLOT_MASK;
+    aesd_list_push_back(&wheel->slots[level][slot], &timer->node);
+}
+
+void
+aesd_timer_arm(aesd_timer_wheel_t * wheel, aesd_timer_t * timer, uint64_t expires)
+{
+    aesd_timer_cancel(wheel, timer);
+
+    timer->expires = expires;
+    place(wheel, timer);
+    wheel->num_pending++;
+}
+
+void
+aesd_timer_cancel(aesd_timer_wheel_t * wheel, aesd_timer_t * timer)
+{
+    if (!aesd_timer_pending(timer)) {
+        return;
+    }
+
+    aesd_list_unlink(&timer->node);
+    wheel->num_pending--;
+}
+
+/// Moves @a slot to a local list, so callbacks can touch the wheel while it is being walked
+static void
+take_slot(aesd_list_t * slot, aesd_list_t * taken)
+{
+    aesd_list_init(taken);
+    if (aesd_list_empty(slot)) {
+        return;
+    }
+
+    taken->next = slot->next;
+    taken->prev = slot->prev;
+    taken->next->prev = taken;
+    taken->prev->next = taken;
+    aesd_list_init(slot);
+}
+
+/**
+ * @brief Re-places the timers of the slot of @a level the wheel just reached.
+ *
+ * @return the index of that slot. 0 means the level above must cascade as well
+ */
+static size_t
+cascade(aesd_timer_wheel_t * wheel, size_t level)
+{
+    size_t slot = (wheel->now >> LEVEL_SHIFT(level)) & SLOT_MASK;
+
+    aesd_list_t taken;
+    take_slot(&wheel->slots[level][slot], &taken);
+
+    aesd_list_t * node;
+    while ((node = aesd_list_pop_front(&taken)) != NULL) {
+        place(wheel, AESD_LIST_ENTRY(node, aesd_timer_t, node));
+    }
+
+    return slot;
+}
+
+void
+aesd_timer_wheel_advance(aesd_timer_wheel_t * wheel, uint64_t now)
+{
+    while (wheel->now <= now) {
+        size_t slot = wheel->now & SLOT_MASK;
+        if (slot == 0) {
+            for (size_t level = 1; level < AESD_TIMER_WHEEL_LEVELS; level++) {
+                if (cascade(wheel, level) != 0) {
+                    break;
+                }
+            }
+        }
+
+        aesd_list_t expired;
+        take_slot(&wheel->slots[0][slot], &expired);
+
+        aesd_list_t * node;
+        while ((node = aesd_list_pop_front(&expired)) != NULL) {
+            aesd_timer_t * timer = AESD_LIST_ENTRY(node, aesd_timer_t, node);
+            if (timer->expires > wheel->now) {
+                // Its deadline was too far to be placed exactly. Try again from here
+                place(wheel, timer);
+                continue;
+            }
+
+            wheel->num_pending--;
+            timer->callback(timer);
+        }
+
+        wheel->now++;
+    }
+}
+
+uint64_t
+aesd_timer_wheel_next_tick(const aesd_timer_wheel_t * wheel)
+{
+    if (wheel->num_pending == 0) {
+        return UINT64_MAX;
+    }
+
+    // Stop at the next cascade, which may bring earlier deadlines down to level 0
+    uint64_t tick = wheel->now;
+    do {
+        if (!aesd_list_empty(&wheel->slots[0][tick & SLOT_MASK])) {
+            break;
+        }
+        tick++;
+    } while ((tick & SLOT_MASK) != 0);
+
+    return tick;
+}
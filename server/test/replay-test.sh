@@ -0,0 +1,59 @@
+#!/bin/sh
+# Replays clients repeating the same line against aesdsocket, plain and pipelined, and checks
+# aesdreplay matches every request with its reply: all of them answered, in order, and in plain
+# mode the replies to the burst of connection 1, which grow with the log, completing one after
+# the other rather than all at the first copy of the line.
+
+set -e
+set -u
+
+cd "$(dirname "$0")/.."
+make aesdsocket aesdreplay test/replay_trace > /dev/null
+
+trace=$(mktemp)
+out=$(mktemp)
+server_pid=
+cleanup() {
+	if [ -n "$server_pid" ]; then
+		kill "$server_pid" 2> /dev/null || true
+		wait "$server_pid" 2> /dev/null || true
+	fi
+	rm -f "$trace" "$out"
+}
+trap cleanup EXIT
+
+./test/replay_trace "$trace"
+requests=120
+
+failed=0
+for mode in "" -p; do
+	./aesdsocket $mode &
+	server_pid=$!
+	sleep 0.5
+
+	./aesdreplay -s 1 -v $mode "$trace" > "$out"
+	kill "$server_pid"
+	wait "$server_pid" || true
+	server_pid=
+
+	if ! grep -q "requests: ${requests} answered, 0 unanswered" "$out"; then
+		echo "FAIL aesdsocket ${mode}: $(grep requests: "$out")"
+		failed=1
+	fi
+	# "<connection> <request> <latency us>", the burst being sent at once
+	if ! awk -v strict="$([ -z "$mode" ] && echo 1 || echo 0)" '$1 == 1 && NF == 3 {
+			if (n > 0 && $3 < last) bad = 1;
+			if (n == 0) first = $3;
+			last = $3; n++
+		}
+		END { exit (bad || n == 0 || (strict && last <= first)) }' "$out"
+	then
+		echo "FAIL aesdsocket ${mode}: the burst replies did not complete one after the other"
+		failed=1
+	fi
+done
+
+if [ "$failed" -ne 0 ]; then
+	exit 1
+fi
+echo "success"
@@ -0,0 +1,80 @@
+// Copyright (c) 2025 Mateus Menezes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/**
+ * @file replay_trace.c
+ * @brief Writes the trace replayed by replay-test.sh: clients sending the same line over and
+ * over, which is what makes a reply impossible to tell apart from the previous ones by its text.
+ *
+ *   connection 1  BURST_LINES copies of a long line, in a single chunk
+ *   connection 2  SPACED_LINES copies of "a\n", SPACED_GAP_MS apart
+ *
+ * Usage: replay_trace TRACE
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "aeds/capture.h"
+
+#define BURST_LINES 100
+#define BURST_LINE_LEN 100
+#define SPACED_LINES 20
+#define SPACED_GAP_MS 5
+
+int
+main(int argc, char ** argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s TRACE\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    aesd_capture_t * capture = aesd_capture_open(argv[1]);
+    if (capture == NULL) {
+        fprintf(stderr, "Cannot create %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    static char burst[BURST_LINES * BURST_LINE_LEN];
+    memset(burst, 'x', sizeof(burst));
+    for (size_t i = 1; i <= BURST_LINES; i++) {
+        burst[i * BURST_LINE_LEN - 1] = '\n';
+    }
+
+    const uint8_t addr[4] = { 127, 0, 0, 1 };
+    aesd_capture_record(capture, 1, AESD_CAPTURE_OPEN, addr, sizeof(addr));
+    aesd_capture_record(capture, 2, AESD_CAPTURE_OPEN, addr, sizeof(addr));
+    aesd_capture_record(capture, 1, AESD_CAPTURE_DATA, burst, sizeof(burst));
+
+    struct timespec gap = { .tv_sec = 0, .tv_nsec = SPACED_GAP_MS * 1000000l };
+    for (int i = 0; i < SPACED_LINES; i++) {
+        aesd_capture_record(capture, 2, AESD_CAPTURE_DATA, "a\n", 2);
+        nanosleep(&gap, NULL);
+    }
+
+    aesd_capture_record(capture, 1, AESD_CAPTURE_CLOSE, NULL, 0);
+    aesd_capture_record(capture, 2, AESD_CAPTURE_CLOSE, NULL, 0);
+    aesd_capture_close(capture);
+    return EXIT_SUCCESS;
+}
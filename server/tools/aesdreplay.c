@@ -0,0 +1,726 @@
+// Copyright (c) 2025 Mateus Menezes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/**
+ * @file aesdreplay.c
+ * @brief Replays a trace recorded with `aesdsocket -c` against a running server and reports the
+ * latency of every request.
+ *
+ * Each traced connection is reopened at its original time (scaled by -s) and gets the same
+ * chunks of bytes at the same offsets in time. A request is a line sent by the client. Its
+ * latency goes from the moment its '\n' left the tool until the moment its whole reply came back.
+ *
+ * A reply is the whole log, so its text cannot tell where it ends: the same lines show up again
+ * and again in a log. The tool therefore turns on compressed replies ("AESDCTL COMPRESS") before
+ * replaying a connection and counts the end frame closing every reply, whatever the frames
+ * hold. aesdsocket answers each line with one reply. In pipelined mode (-p, for aesdsocket -p)
+ * one reply answers a whole batch: it completes the oldest pending request, then the next ones
+ * as long as their lines fit in what the log grew since the previous reply of the connection.
+ * The first reply of a connection is taken to answer every line sent before it.
+ *
+ * A connection whose trace turns compression off or subscribes stops being timed there. Its
+ * later requests are reported as unanswered.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "aeds/capture.h"
+#include "aeds/lz_log.h"
+#include "aeds/rate_limit.h"
+#include "aeds/server.h"
+
+#define DEFAULT_HOST "127.0.0.1"
+#define DEFAULT_PORT "9000"
+/// Start of a line kept to recognize control lines: the prefix, a command and its arguments
+#define LINE_HEAD_LEN 64
+/// Records applied in a row before looking at the sockets again when replaying at max speed
+#define RECORDS_PER_POLL 256
+/// Once the trace is over, give up on replies that do not show up for this long
+#define DRAIN_TIMEOUT_MS 5000
+#define MAX_EVENTS 64
+
+struct request {
+    uint64_t eol_pos;  // Offset of its '\n' in the stream sent on the connection
+    uint64_t sent_ns;  // 0 until that '\n' was handed to the kernel
+    uint64_t len;  // Of the line, '\n' included
+};
+
+struct replay_conn {
+    uint32_t id;
+    int fd;
+    bool closing;  // The trace closed it: shut down the write side once everything was sent
+    bool done;
+
+    uint8_t * tx_buf;  // Bytes of the trace not sent yet
+    size_t tx_off;
+    size_t tx_len;
+    size_t tx_cap;
+    uint64_t tx_pos;  // Offset in the sent stream of tx_buf[tx_off]
+    uint64_t queued;  // Bytes queued so far, i.e. offset of the next byte of the stream
+
+    size_t line_len;
+    char line_head[LINE_HEAD_LEN];
+
+    struct request * reqs;
+    size_t req_head;  // Oldest request not answered yet
+    size_t req_sent;  // Requests whose '\n' already left
+    size_t req_len;
+    size_t req_cap;
+    size_t req_timed;  // Requests answered with frames, before compression off or a subscription
+
+    uint8_t frame_header[AESD_LZ_FRAME_HEADER_SIZE];  // Of the frame being received
+    size_t frame_header_len;
+    uint64_t frame_skip;  // Bytes of the current frame's data still to come
+    uint64_t reply_len;  // Log bytes in the frames of the reply being received
+    uint64_t last_reply_len;  // 0 before the first reply
+    size_t pending_acks;  // Lone end frames answering the COMPRESS commands sent
+    bool unframed;  // Got something else than frames: the server lacks compressed replies
+};
+
+struct replay {
+    int epoll_fd;
+    struct addrinfo * server_addr;
+    bool verbose;
+    bool pipelined;
+
+    struct replay_conn ** conns;  // Indexed by the connection id of the trace
+    size_t conns_cap;
+    size_t num_conns;
+    size_t num_open;
+
+    uint64_t * latencies_ns;
+    size_t num_latencies;
+    size_t latencies_cap;
+    size_t num_requests;
+    size_t num_unanswered;
+    size_t num_failed_conns;
+};
+
+static bool
+grow(void ** array, size_t * cap, size_t needed, size_t elem_size)
+{
+    if (needed <= *cap) {
+        return true;
+    }
+
+    size_t new_cap = *cap != 0 ? *cap : 16;
+    while (new_cap < needed) {
+        new_cap *= 2;
+    }
+
+    void * new_array = realloc(*array, new_cap * elem_size);
+    if (new_array == NULL) {
+        return false;
+    }
+    memset((uint8_t *)new_array + *cap * elem_size, 0, (new_cap - *cap) * elem_size);
+
+    *array = new_array;
+    *cap = new_cap;
+    return true;
+}
+
+static void
+conn_watch(struct replay * replay, struct replay_conn * conn)
+{
+    struct epoll_event event = {
+        .events = EPOLLIN | (conn->tx_off < conn->tx_len ? EPOLLOUT : 0),
+        .data.ptr = conn,
+    };
+    epoll_ctl(replay->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+}
+
+static void
+conn_finish(struct replay * replay, struct replay_conn * conn)
+{
+    if (conn->done) {
+        return;
+    }
+
+    replay->num_unanswered += conn->req_len - conn->req_head;
+    close(conn->fd);
+    conn->done = true;
+    replay->num_open--;
+}
+
+static void
+conn_open(struct replay * replay, uint32_t id)
+{
+    if (!grow((void **)&replay->conns, &replay->conns_cap, (size_t)id + 1,
+            sizeof(struct replay_conn *)))
+    {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+
+    struct replay_conn * conn = calloc(1, sizeof(struct replay_conn));
+    if (conn == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    conn->id = id;
+    conn->req_timed = SIZE_MAX;
+    replay->conns[id] = conn;
+    replay->num_conns++;
+
+    const struct addrinfo * addr = replay->server_addr;
+    conn->fd = socket(addr->ai_family, addr->ai_socktype | SOCK_CLOEXEC, addr->ai_protocol);
+    if (conn->fd == -1 || connect(conn->fd, addr->ai_addr, addr->ai_addrlen) == -1) {
+        fprintf(stderr, "Connection %u: %s\n", id, strerror(errno));
+        if (conn->fd != -1) {
+            close(conn->fd);
+        }
+        conn->done = true;
+        replay->num_failed_conns++;
+        return;
+    }
+
+    // Connect blocking, so the connection is up when its first chunk is due. Then go async
+    int one = 1;
+    setsockopt(conn->fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+    if (fcntl(conn->fd, F_SETFL, O_NONBLOCK) == -1) {
+        perror("fcntl");
+        exit(EXIT_FAILURE);
+    }
+
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = conn };
+    if (epoll_ctl(replay->epoll_fd, EPOLL_CTL_ADD, conn->fd, &event) == -1) {
+        perror("epoll_ctl");
+        exit(EXIT_FAILURE);
+    }
+    replay->num_open++;
+}
+
+static bool
+line_is_command(const char * cmd, size_t cmd_len, const char * name)
+{
+    return cmd_len == strlen(name) && memcmp(cmd, name, cmd_len) == 0;
+}
+
+/**
+ * @brief Accounts for the control line of @a len bytes ('\n' excluded) starting with @a line,
+ * as aesdsocket parses it.
+ *
+ * @return false if the server takes the line as data, i.e. it is a request
+ */
+static bool
+conn_control(struct replay_conn * conn, const char * line, size_t len)
+{
+    const size_t prefix_len = sizeof(AESD_SERVER_CTRL_PREFIX) - 1;
+    if (len <= prefix_len || len > LINE_HEAD_LEN ||
+        memcmp(line, AESD_SERVER_CTRL_PREFIX, prefix_len) != 0)
+    {
+        return false;
+    }
+
+    const char * cmd = line + prefix_len;
+    size_t cmd_len = len - prefix_len;
+    const char * args = "";
+    size_t args_len = 0;
+    const char * space = memchr(cmd, ' ', cmd_len);
+    if (space != NULL) {
+        args_len = cmd + cmd_len - space;
+        if (args_len >= 32) {
+            return false;  // Longer than the server takes
+        }
+        args = space;
+        cmd_len = space - cmd;
+    }
+
+    if (line_is_command(cmd, cmd_len, AESD_SERVER_CTRL_SUBSCRIBE)) {
+        // Pushes replace the replies from there on
+        if (conn->req_timed == SIZE_MAX) {
+            conn->req_timed = conn->req_len;
+        }
+        return true;
+    }
+    if (line_is_command(cmd, cmd_len, AESD_SERVER_CTRL_COMPRESS)) {
+        while (args_len > 0 && *args == ' ') {
+            args++;
+            args_len--;
+        }
+        bool off = args_len == 3 && memcmp(args, "OFF", 3) == 0;
+        if (args_len != 0 && !off) {
+            return false;
+        }
+        conn->pending_acks++;
+        if (off && conn->req_timed == SIZE_MAX) {
+            conn->req_timed = conn->req_len;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+/// Records the requests ended by @a data and queues it for sending
+static void
+conn_queue(struct replay_conn * conn, const uint8_t * data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (conn->line_len < LINE_HEAD_LEN) {
+            conn->line_head[conn->line_len] = data[i];
+        }
+        conn->line_len++;
+
+        if (data[i] != '\n') {
+            continue;
+        }
+
+        // Control lines are answered differently, if at all. They are not requests
+        if (!conn_control(conn, conn->line_head, conn->line_len - 1)) {
+            if (!grow((void **)&conn->reqs, &conn->req_cap, conn->req_len + 1,
+                    sizeof(struct request)))
+            {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+
+            struct request * req = &conn->reqs[conn->req_len++];
+            req->eol_pos = conn->queued + i;
+            req->sent_ns = 0;
+            req->len = conn->line_len;
+        }
+        conn->line_len = 0;
+    }
+    conn->queued += len;
+
+    if (conn->tx_off == conn->tx_len) {
+        conn->tx_off = 0;
+        conn->tx_len = 0;
+    }
+    if (!grow((void **)&conn->tx_buf, &conn->tx_cap, conn->tx_len + len, 1)) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(conn->tx_buf + conn->tx_len, data, len);
+    conn->tx_len += len;
+}
+
+static void
+conn_flush(struct replay * replay, struct replay_conn * conn)
+{
+    while (conn->tx_off < conn->tx_len) {
+        // Taken before the send, so being preempted in between cannot hide the server's time
+        uint64_t now_ns = aesd_monotonic_ns();
+        ssize_t sent = send(conn->fd, conn->tx_buf + conn->tx_off, conn->tx_len - conn->tx_off,
+            MSG_NOSIGNAL);
+        if (sent == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                fprintf(stderr, "Connection %u: %s\n", conn->id, strerror(errno));
+                conn_finish(replay, conn);
+                return;
+            }
+            break;
+        }
+
+        conn->tx_off += sent;
+        conn->tx_pos += sent;
+        while (conn->req_sent < conn->req_len &&
+            conn->reqs[conn->req_sent].eol_pos < conn->tx_pos)
+        {
+            conn->reqs[conn->req_sent++].sent_ns = now_ns;
+        }
+    }
+
+    if (conn->closing && conn->tx_off == conn->tx_len) {
+        shutdown(conn->fd, SHUT_WR);
+    }
+    conn_watch(replay, conn);
+}
+
+static void
+record_latency(struct replay * replay, const struct replay_conn * conn, size_t index,
+    uint64_t now_ns)
+{
+    uint64_t latency_ns = now_ns - conn->reqs[index].sent_ns;
+
+    if (!grow((void **)&replay->latencies_ns, &replay->latencies_cap, replay->num_latencies + 1,
+            sizeof(uint64_t)))
+    {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    replay->latencies_ns[replay->num_latencies++] = latency_ns;
+
+    if (replay->verbose) {
+        printf("%u %zu %.1f\n", conn->id, index, latency_ns / 1e3);
+    }
+}
+
+static uint32_t
+frame_u32(const uint8_t * bytes)
+{
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+/// Completes the requests answered by the reply of @a reply_len log bytes that just ended
+static void
+conn_reply_end(struct replay * replay, struct replay_conn * conn, uint64_t reply_len,
+    uint64_t now_ns)
+{
+    if (conn->req_head == conn->req_sent) {
+        return;  // Cannot answer a line that did not leave yet. Not aesdsocket
+    }
+
+    size_t end = conn->req_head + 1;
+    if (replay->pipelined) {
+        uint64_t budget = conn->last_reply_len != 0 && reply_len > conn->last_reply_len ?
+            reply_len - conn->last_reply_len : UINT64_MAX;
+        uint64_t batch_len = conn->reqs[conn->req_head].len;
+        while (end < conn->req_sent && end < conn->req_timed &&
+            batch_len + conn->reqs[end].len <= budget)
+        {
+            batch_len += conn->reqs[end++].len;
+        }
+    }
+
+    for (size_t k = conn->req_head; k < end; k++) {
+        record_latency(replay, conn, k, now_ns);
+    }
+    conn->req_head = end;
+    conn->last_reply_len = reply_len;
+}
+
+/// Follows the frames of the replies in @a chunk and completes a request at every end frame
+static void
+conn_match(struct replay * replay, struct replay_conn * conn, const uint8_t * chunk, size_t len)
+{
+    uint64_t now_ns = aesd_monotonic_ns();
+    size_t i = 0;
+
+    while (i < len && !conn->unframed && conn->req_head < conn->req_timed) {
+        if (conn->frame_skip > 0) {
+            size_t skip = len - i < conn->frame_skip ? len - i : conn->frame_skip;
+            i += skip;
+            conn->frame_skip -= skip;
+            continue;
+        }
+
+        conn->frame_header[conn->frame_header_len++] = chunk[i++];
+        if (conn->frame_header_len < AESD_LZ_FRAME_HEADER_SIZE) {
+            continue;
+        }
+        conn->frame_header_len = 0;
+
+        const uint8_t * header = conn->frame_header;
+        if (header[0] != AESD_LZ_FRAME_MAGIC) {
+            fprintf(stderr, "Connection %u: the server does not answer with frames, it needs "
+                "support for " AESD_SERVER_CTRL_PREFIX AESD_SERVER_CTRL_COMPRESS "\n", conn->id);
+            conn->unframed = true;
+            break;
+        }
+
+        if (header[1] != AESD_LZ_FRAME_END) {
+            conn->reply_len += frame_u32(header + 4);
+            conn->frame_skip = frame_u32(header + 8);
+        } else if (conn->reply_len == 0 && conn->pending_acks > 0) {
+            // Replies hold at least the line they answer, so an empty one is an acknowledgement
+            conn->pending_acks--;
+        } else {
+            conn_reply_end(replay, conn, conn->reply_len, now_ns);
+            conn->reply_len = 0;
+        }
+    }
+}
+
+static void
+conn_read(struct replay * replay, struct replay_conn * conn)
+{
+    uint8_t buf[64 * 1024];
+
+    while (true) {
+        ssize_t num_bytes_read = recv(conn->fd, buf, sizeof(buf), 0);
+        if (num_bytes_read == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                conn_finish(replay, conn);
+            }
+            return;
+        }
+
+        if (num_bytes_read == 0) {
+            conn_finish(replay, conn);
+            return;
+        }
+
+        conn_match(replay, conn, buf, num_bytes_read);
+    }
+}
+
+static void
+apply(struct replay * replay, const struct aesd_capture_record_header * record,
+    const uint8_t * payload)
+{
+    if (record->type == AESD_CAPTURE_OPEN) {
+        conn_open(replay, record->conn_id);
+        struct replay_conn * conn = replay->conns[record->conn_id];
+        if (!conn->done) {
+            // Framed replies are what tells where each reply ends
+            static const char compress[] = AESD_SERVER_CTRL_PREFIX AESD_SERVER_CTRL_COMPRESS "\n";
+            conn_queue(conn, (const uint8_t *)compress, sizeof(compress) - 1);
+            conn_flush(replay, conn);
+        }
+        return;
+    }
+
+    if (record->conn_id >= replay->conns_cap || replay->conns[record->conn_id] == NULL) {
+        // The connection was open before the capture started. Its earlier bytes are missing
+        return;
+    }
+
+    struct replay_conn * conn = replay->conns[record->conn_id];
+    if (conn->done) {
+        return;
+    }
+
+    if (record->type == AESD_CAPTURE_DATA) {
+        conn_queue(conn, payload, record->len);
+    } else if (record->type == AESD_CAPTURE_CLOSE) {
+        conn->closing = true;
+    }
+    conn_flush(replay, conn);
+}
+
+static int
+compare_u64(const void * a, const void * b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double
+percentile_us(const uint64_t * sorted, size_t count, double p)
+{
+    double rank = p / 100.0 * count;
+    size_t index = (size_t)rank;
+    if (index < rank) {
+        index++;
+    }
+    return sorted[index > 0 ? index - 1 : 0] / 1e3;
+}
+
+static void
+report(struct replay * replay, double elapsed_sec)
+{
+    for (size_t i = 0; i < replay->conns_cap; i++) {
+        struct replay_conn * conn = replay->conns[i];
+        if (conn != NULL) {
+            conn_finish(replay, conn);
+        }
+    }
+
+    printf("connections: %zu (%zu failed)\n", replay->num_conns, replay->num_failed_conns);
+    printf("requests: %zu answered, %zu unanswered in %.3f s\n", replay->num_latencies,
+        replay->num_unanswered, elapsed_sec);
+    if (replay->num_latencies == 0) {
+        return;
+    }
+
+    uint64_t * sorted = replay->latencies_ns;
+    size_t count = replay->num_latencies;
+    qsort(sorted, count, sizeof(uint64_t), compare_u64);
+
+    double sum_us = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum_us += sorted[i] / 1e3;
+    }
+
+    printf("latency (us): min %.1f  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f  "
+        "mean %.1f\n", sorted[0] / 1e3, percentile_us(sorted, count, 50),
+        percentile_us(sorted, count, 90), percentile_us(sorted, count, 99),
+        percentile_us(sorted, count, 99.9), sorted[count - 1] / 1e3, sum_us / count);
+}
+
+static void
+print_usage(const char * prog_name)
+{
+    fprintf(stderr, "Usage: %s [-s speed] [-H host] [-P port] [-p] [-v] trace\n"
+        "  -s  1 replays at the recorded pace (default), N runs N times faster, 0 as fast as\n"
+        "      possible\n"
+        "  -H  server address (default " DEFAULT_HOST ")\n"
+        "  -P  server port (default " DEFAULT_PORT ")\n"
+        "  -p  the server runs pipelined (aesdsocket -p): a reply may answer several lines\n"
+        "  -v  print \"<connection> <request> <latency us>\" for every answered request\n",
+        prog_name);
+}
+
+int
+main(int argc, char ** argv)
+{
+    const char * host = DEFAULT_HOST;
+    const char * port = DEFAULT_PORT;
+    double speed = 1;
+    struct replay replay;
+    int opt;
+
+    memset(&replay, 0, sizeof(replay));
+
+    while ((opt = getopt(argc, argv, "s:H:P:pvh")) != -1) {
+        switch (opt) {
+            case 's': {
+                char * end;
+                speed = strtod(optarg, &end);
+                if (end == optarg || *end != '\0' || speed < 0) {
+                    fprintf(stderr, "Invalid speed: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
+            case 'H':
+                host = optarg;
+                break;
+            case 'P':
+                port = optarg;
+                break;
+            case 'p':
+                replay.pipelined = true;
+                break;
+            case 'v':
+                replay.verbose = true;
+                break;
+            default:
+                print_usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc - 1) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    aesd_capture_reader_t reader;
+    if (aesd_capture_reader_open(&reader, argv[optind]) != AESD_RET_OK) {
+        fprintf(stderr, "Cannot read trace %s: %s\n", argv[optind], strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    int gai_ret = getaddrinfo(host, port, &hints, &replay.server_addr);
+    if (gai_ret != 0) {
+        fprintf(stderr, "Cannot resolve %s:%s: %s\n", host, port, gai_strerror(gai_ret));
+        return EXIT_FAILURE;
+    }
+
+    replay.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (replay.epoll_fd == -1) {
+        perror("epoll_create1");
+        return EXIT_FAILURE;
+    }
+
+    struct aesd_capture_record_header record;
+    uint8_t * payload = NULL;
+    size_t payload_cap = 0;
+    aesd_ret_t next_ret = aesd_capture_reader_next(&reader, &record, &payload, &payload_cap);
+
+    uint64_t start_ns = aesd_monotonic_ns();
+    uint64_t last_progress_ns = start_ns;
+    int exit_code = EXIT_SUCCESS;
+
+    while (true) {
+        uint64_t now_ns = aesd_monotonic_ns();
+        int timeout_ms = -1;
+
+        for (size_t applied = 0; next_ret == AESD_RET_OK; applied++) {
+            uint64_t due_ns = speed > 0 ? start_ns + (uint64_t)(record.time_ns / speed) : 0;
+            if (due_ns > now_ns) {
+                timeout_ms = (due_ns - now_ns + 999999) / 1000000;
+                break;
+            }
+            if (applied == RECORDS_PER_POLL) {
+                timeout_ms = 0;
+                break;
+            }
+
+            apply(&replay, &record, payload);
+            next_ret = aesd_capture_reader_next(&reader, &record, &payload, &payload_cap);
+            last_progress_ns = now_ns;
+        }
+
+        if (next_ret == AESD_RET_ERROR) {
+            fprintf(stderr, "Trace is truncated or corrupted. Stopping the replay there\n");
+            next_ret = AESD_CAPTURE_RET_END;
+            exit_code = EXIT_FAILURE;
+        }
+
+        if (next_ret == AESD_CAPTURE_RET_END) {
+            if (replay.num_open == 0 ||
+                now_ns - last_progress_ns >= DRAIN_TIMEOUT_MS * 1000000ull)
+            {
+                break;
+            }
+            timeout_ms = DRAIN_TIMEOUT_MS - (now_ns - last_progress_ns) / 1000000;
+
+            // Connections still open when the capture stopped end with the trace
+            for (size_t i = 0; i < replay.conns_cap; i++) {
+                struct replay_conn * conn = replay.conns[i];
+                if (conn != NULL && !conn->done && !conn->closing) {
+                    conn->closing = true;
+                    conn_flush(&replay, conn);
+                }
+            }
+        }
+
+        struct epoll_event events[MAX_EVENTS];
+        int num_events = epoll_wait(replay.epoll_fd, events, MAX_EVENTS, timeout_ms);
+        if (num_events == -1 && errno != EINTR) {
+            perror("epoll_wait");
+            return EXIT_FAILURE;
+        }
+
+        for (int i = 0; i < num_events; i++) {
+            struct replay_conn * conn = events[i].data.ptr;
+            if (!conn->done && (events[i].events & EPOLLOUT)) {
+                conn_flush(&replay, conn);
+            }
+            if (!conn->done && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+                conn_read(&replay, conn);
+            }
+        }
+        if (num_events > 0) {
+            last_progress_ns = aesd_monotonic_ns();
+        }
+    }
+
+    report(&replay, (aesd_monotonic_ns() - start_ns) / 1e9);
+
+    aesd_capture_reader_close(&reader);
+    freeaddrinfo(replay.server_addr);
+    close(replay.epoll_fd);
+    return exit_code;
+}
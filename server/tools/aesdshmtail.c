@@ -0,0 +1,322 @@
+// Copyright (c) 2025 Mateus Menezes
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/**
+ * @file aesdshmtail.c
+ * @brief Local consumer of the log aesdsocket exports through shared memory.
+ *
+ * By default it copies the log to stdout as it is published, without any syscall while there
+ * is something new, until the server closes the mapping.
+ *
+ * With -t it checks the publishing protocol instead: a writer thread appends numbered records
+ * of every size to a private log, growing the mapping up to the requested size, while the main
+ * thread polls it as a reader would. Every byte below a published length must already hold the
+ * record the writer copied there, across every remap, and the reader must end up with exactly
+ * what was appended.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "aeds/shm_log.h"
+
+/// Sleep between two polls finding nothing new
+#define IDLE_POLL_NS (1000 * 1000)
+/// Bytes appended by -t when no size is given, enough for several remaps
+#define DEFAULT_CHECK_BYTES (64ull * 1024 * 1024)
+#define MAX_RECORD_PAYLOAD (64 * 1024)
+
+/// Self-check record: this header, then payload_len bytes given by record_byte()
+struct record_header {
+    uint32_t payload_len;
+    uint32_t seq;
+};
+
+struct check_writer {
+    aesd_shm_log_t * shm_log;
+    uint64_t target_bytes;
+    uint64_t appended;
+    bool failed;
+};
+
+/// Incremental parser of the records, fed with the bytes in whatever chunks the polls return
+struct check_reader {
+    struct record_header header;
+    size_t header_got;
+    uint32_t payload_got;
+    uint32_t expected_seq;
+    uint64_t offset;
+};
+
+static uint8_t
+record_byte(uint32_t seq, uint32_t index)
+{
+    return (uint8_t)(seq * 31 + index * 7 + 1);  // Never the zeros of unwritten memory
+}
+
+static uint32_t
+record_payload_len(uint32_t seq)
+{
+    // Mostly small records as the server appends, now and then large ones crossing pages
+    return seq % 64 == 0 ? (seq * 2654435761u) % MAX_RECORD_PAYLOAD : 1 + seq % 200;
+}
+
+static void
+idle(void)
+{
+    struct timespec delay = { .tv_sec = 0, .tv_nsec = IDLE_POLL_NS };
+    nanosleep(&delay, NULL);
+}
+
+static void *
+check_write(void * arg)
+{
+    struct check_writer * writer = arg;
+    uint8_t * record = malloc(sizeof(struct record_header) + MAX_RECORD_PAYLOAD);
+    if (record == NULL) {
+        perror("malloc");
+        writer->failed = true;
+        aesd_shm_log_destroy(writer->shm_log);
+        return NULL;
+    }
+
+    for (uint32_t seq = 0;; seq++) {
+        struct record_header header = { .payload_len = record_payload_len(seq), .seq = seq };
+        size_t len = sizeof(header) + header.payload_len;
+        if (writer->appended + len > writer->target_bytes) {
+            break;
+        }
+        memcpy(record, &header, sizeof(header));
+        for (uint32_t i = 0; i < header.payload_len; i++) {
+            record[sizeof(header) + i] = record_byte(seq, i);
+        }
+
+        if (aesd_shm_log_append(writer->shm_log, record, len) != AESD_RET_OK) {
+            fprintf(stderr, "Append of record %u failed\n", seq);
+            writer->failed = true;
+            break;
+        }
+        writer->appended += len;
+        if (seq % 16 == 0) {
+            sched_yield();  // Lets the reader in between appends even with a single CPU
+        }
+    }
+
+    free(record);
+    // Raises the closed flag once everything is published
+    aesd_shm_log_destroy(writer->shm_log);
+    return NULL;
+}
+
+static bool
+check_bytes(struct check_reader * reader, const uint8_t * data, size_t len)
+{
+    for (size_t i = 0; i < len; i++, reader->offset++) {
+        if (reader->header_got < sizeof(reader->header)) {
+            ((uint8_t *)&reader->header)[reader->header_got++] = data[i];
+            if (reader->header_got == sizeof(reader->header) &&
+                (reader->header.seq != reader->expected_seq ||
+                reader->header.payload_len != record_payload_len(reader->expected_seq)))
+            {
+                fprintf(stderr, "Bad record header at offset %llu: seq %u, %u bytes, "
+                    "expected record %u\n", (unsigned long long)reader->offset,
+                    reader->header.seq, reader->header.payload_len, reader->expected_seq);
+                return false;
+            }
+        } else if (data[i] != record_byte(reader->header.seq, reader->payload_got++)) {
+            fprintf(stderr, "Published byte at offset %llu of record %u was not written yet\n",
+                (unsigned long long)reader->offset, reader->header.seq);
+            return false;
+        }
+
+        if (reader->header_got == sizeof(reader->header) &&
+            reader->payload_got == reader->header.payload_len)
+        {
+            reader->header_got = 0;
+            reader->payload_got = 0;
+            reader->expected_seq++;
+        }
+    }
+    return true;
+}
+
+static int
+run_check(uint64_t target_bytes)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/aesdshmtail-check-%d", (int)getpid());
+
+    struct check_writer writer = { .target_bytes = target_bytes };
+    writer.shm_log = aesd_shm_log_create(name);
+    if (writer.shm_log == NULL) {
+        fprintf(stderr, "Cannot create shared memory %s: %s\n", name, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    aesd_shm_log_reader_t shm_reader;
+    if (aesd_shm_log_reader_open(&shm_reader, name) != AESD_RET_OK) {
+        fprintf(stderr, "Cannot open shared memory %s: %s\n", name, strerror(errno));
+        aesd_shm_log_destroy(writer.shm_log);
+        return EXIT_FAILURE;
+    }
+
+    pthread_t writer_thread;
+    if (pthread_create(&writer_thread, NULL, check_write, &writer) != 0) {
+        fprintf(stderr, "Cannot start the writer thread\n");
+        aesd_shm_log_reader_close(&shm_reader);
+        aesd_shm_log_destroy(writer.shm_log);
+        return EXIT_FAILURE;
+    }
+
+    struct check_reader reader;
+    memset(&reader, 0, sizeof(reader));
+    bool ok = true;
+    uint64_t polls = 0;
+    uint64_t empty_polls = 0;
+    while (ok) {
+        // Flags first: once closed is seen, a poll returns everything ever published
+        uint32_t flags = aesd_shm_log_reader_flags(&shm_reader);
+        const uint8_t * data;
+        size_t len = aesd_shm_log_reader_poll(&shm_reader, &data);
+        polls++;
+        if (len > 0) {
+            ok = check_bytes(&reader, data, len);
+        } else if (flags & AESD_SHM_LOG_FLAG_CLOSED) {
+            break;
+        } else {
+            empty_polls++;
+            sched_yield();
+        }
+    }
+
+    pthread_join(writer_thread, NULL);
+    aesd_shm_log_reader_close(&shm_reader);
+
+    if (ok && !writer.failed && reader.offset != writer.appended) {
+        fprintf(stderr, "Read %llu bytes, %llu were appended\n",
+            (unsigned long long)reader.offset, (unsigned long long)writer.appended);
+        ok = false;
+    }
+    if (!ok || writer.failed) {
+        return EXIT_FAILURE;
+    }
+
+    printf("%u records, %llu bytes read back in %llu polls (%llu empty)\n",
+        reader.expected_seq, (unsigned long long)reader.offset, (unsigned long long)polls,
+        (unsigned long long)empty_polls);
+    return EXIT_SUCCESS;
+}
+
+static int
+run_tail(const char * name)
+{
+    aesd_shm_log_reader_t reader;
+    if (aesd_shm_log_reader_open(&reader, name) != AESD_RET_OK) {
+        fprintf(stderr, "Cannot open shared memory %s, is aesdsocket running?\n", name);
+        return EXIT_FAILURE;
+    }
+
+    int exit_code = EXIT_SUCCESS;
+    while (true) {
+        uint32_t flags = aesd_shm_log_reader_flags(&reader);
+        const uint8_t * data;
+        size_t len = aesd_shm_log_reader_poll(&reader, &data);
+        if (len > 0) {
+            if (fwrite(data, 1, len, stdout) != len || fflush(stdout) == EOF) {
+                exit_code = EXIT_FAILURE;
+                break;
+            }
+        } else if (flags & AESD_SHM_LOG_FLAG_OVERFLOW) {
+            fprintf(stderr, "The log outgrew its shared memory, read the rest over TCP\n");
+            exit_code = EXIT_FAILURE;
+            break;
+        } else if (flags & AESD_SHM_LOG_FLAG_CLOSED) {
+            break;
+        } else {
+            idle();
+        }
+    }
+
+    aesd_shm_log_reader_close(&reader);
+    return exit_code;
+}
+
+static void
+print_usage(const char * prog_name)
+{
+    fprintf(stderr, "Usage: %s [-n name]\n"
+        "       %s -t [-b bytes]\n"
+        "  -n  shared memory name (default " AESD_SHM_LOG_NAME ")\n"
+        "  -t  check the publishing protocol against a private log instead of tailing\n"
+        "  -b  bytes appended by -t (default %llu)\n",
+        prog_name, prog_name, (unsigned long long)DEFAULT_CHECK_BYTES);
+}
+
+int
+main(int argc, char ** argv)
+{
+    const char * name = AESD_SHM_LOG_NAME;
+    bool check = false;
+    uint64_t check_bytes_target = DEFAULT_CHECK_BYTES;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:tb:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                name = optarg;
+                break;
+            case 't':
+                check = true;
+                break;
+            case 'b': {
+                char * end;
+                check_bytes_target = strtoull(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || check_bytes_target == 0 ||
+                    check_bytes_target > AESD_SHM_LOG_MAX_CAPACITY)
+                {
+                    fprintf(stderr, "Invalid size: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
+            default:
+                print_usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    return check ? run_check(check_bytes_target) : run_tail(name);
+}
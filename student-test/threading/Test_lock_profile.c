@@ -0,0 +1,84 @@
+#define _GNU_SOURCE  // PTHREAD_MUTEX_ADAPTIVE_NP in locks.h
+#include "unity.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "../../examples/threading/threading.h"
+
+#define POOL_TASKS 64
+#define THREAD_TASKS 8
+
+static void count_locks(const void *lock, const struct histogram *wait,
+    const struct histogram *hold, void *arg)
+{
+    (void)lock;
+    (void)wait;
+    (void)hold;
+    (*(int *)arg)++;
+}
+
+/**
+* Every pool task on a mutex adds exactly one wait and one hold sample for it, all merged once
+* the pool is destroyed.
+*/
+void test_lock_profile_pool_counts()
+{
+    static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    lock_profile_reset();
+
+    struct thread_pool *pool = thread_pool_create(2);
+    TEST_ASSERT_NOT_NULL_MESSAGE(pool, "thread_pool_create failed");
+    for (int i = 0; i < POOL_TASKS; i++) {
+        struct thread_future *future = thread_pool_start_obtaining_mutex(pool, &mutex, 0, 0);
+        TEST_ASSERT_NOT_NULL_MESSAGE(future, "thread_pool_start_obtaining_mutex failed");
+        TEST_ASSERT_TRUE_MESSAGE(thread_future_release(future), "Task failed");
+    }
+    thread_pool_destroy(pool);
+
+    struct histogram wait;
+    struct histogram hold;
+    TEST_ASSERT_TRUE_MESSAGE(lock_profile_get(&mutex, &wait, &hold), "Mutex was not profiled");
+    TEST_ASSERT_EQUAL_UINT64_MESSAGE(POOL_TASKS, wait.count, "Wrong number of wait samples");
+    TEST_ASSERT_EQUAL_UINT64_MESSAGE(POOL_TASKS, hold.count, "Wrong number of hold samples");
+
+    int num_locks = 0;
+    lock_profile_for_each(count_locks, &num_locks);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(1, num_locks, "Unexpected profiled locks");
+
+    lock_profile_reset();
+    TEST_ASSERT_FALSE_MESSAGE(lock_profile_get(&mutex, &wait, &hold), "Reset kept samples");
+}
+
+/**
+* Dedicated threads taking a struct lock merge their sample before they exit, so the counts are
+* exact as soon as the threads are joined, and the hold times cover the requested hold.
+*/
+void test_lock_profile_thread_counts()
+{
+    static struct lock lock;
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, lock_init(&lock, LOCK_FUTEX), "lock_init failed");
+    lock_profile_reset();
+
+    pthread_t threads[THREAD_TASKS];
+    for (int i = 0; i < THREAD_TASKS; i++) {
+        TEST_ASSERT_TRUE_MESSAGE(start_thread_obtaining_lock(&threads[i], &lock, 0, 1),
+            "start_thread_obtaining_lock failed");
+    }
+    for (int i = 0; i < THREAD_TASKS; i++) {
+        struct thread_data *data;
+        pthread_join(threads[i], (void **)&data);
+        TEST_ASSERT_TRUE_MESSAGE(data->thread_complete_success, "Thread failed");
+        free(data);
+    }
+
+    struct histogram wait;
+    struct histogram hold;
+    TEST_ASSERT_TRUE_MESSAGE(lock_profile_get(&lock, &wait, &hold), "Lock was not profiled");
+    TEST_ASSERT_EQUAL_UINT64_MESSAGE(THREAD_TASKS, wait.count, "Wrong number of wait samples");
+    TEST_ASSERT_EQUAL_UINT64_MESSAGE(THREAD_TASKS, hold.count, "Wrong number of hold samples");
+    TEST_ASSERT_TRUE_MESSAGE(hold.sum >= THREAD_TASKS * 1000000ull,
+        "Hold times are shorter than the requested hold");
+
+    lock_profile_reset();
+    lock_destroy(&lock);
+}
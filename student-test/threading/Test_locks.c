@@ -0,0 +1,113 @@
+#define _GNU_SOURCE  // PTHREAD_MUTEX_ADAPTIVE_NP in locks.h
+#include "unity.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "../../examples/threading/locks.h"
+
+#define CONTENDERS 4
+#define ITERATIONS 5000
+#define YIELD_EVERY 64
+
+struct contention {
+    struct lock lock;
+    pthread_barrier_t start_barrier;
+    uint64_t counter;
+    int holders;
+    bool overlapped;
+    bool failed;
+};
+
+static void *contend(void *arg)
+{
+    struct contention *contention = arg;
+    struct lock_node node;
+    pthread_barrier_wait(&contention->start_barrier);
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        if (lock_acquire(&contention->lock, &node) != 0) {
+            contention->failed = true;
+            break;
+        }
+        if (__atomic_add_fetch(&contention->holders, 1, __ATOMIC_RELAXED) != 1) {
+            contention->overlapped = true;
+        }
+        // Split read and write, yielding in between now and then, so a second holder loses
+        // increments even on a single CPU
+        uint64_t counter = *(volatile uint64_t *)&contention->counter;
+        if (i % YIELD_EVERY == 0) {
+            sched_yield();
+        }
+        *(volatile uint64_t *)&contention->counter = counter + 1;
+        __atomic_sub_fetch(&contention->holders, 1, __ATOMIC_RELAXED);
+        if (lock_release(&contention->lock, &node) != 0) {
+            contention->failed = true;
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void check_mutual_exclusion(enum lock_type type)
+{
+    static struct contention contention;
+    contention = (struct contention){0};
+    int init_ret = lock_init(&contention.lock, type);
+    if (init_ret == ENOTSUP) {
+        return;
+    }
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, init_ret, lock_type_name(type));
+    pthread_barrier_init(&contention.start_barrier, NULL, CONTENDERS);
+
+    pthread_t threads[CONTENDERS];
+    for (int i = 0; i < CONTENDERS; i++) {
+        TEST_ASSERT_EQUAL_INT_MESSAGE(0, pthread_create(&threads[i], NULL, contend, &contention),
+            "pthread_create failed");
+    }
+    for (int i = 0; i < CONTENDERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    TEST_ASSERT_FALSE_MESSAGE(contention.failed, lock_type_name(type));
+    TEST_ASSERT_FALSE_MESSAGE(contention.overlapped, lock_type_name(type));
+    TEST_ASSERT_EQUAL_UINT64_MESSAGE((uint64_t)CONTENDERS * ITERATIONS, contention.counter,
+        lock_type_name(type));
+
+    // Released by every contender, so free again
+    struct lock_node node;
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, lock_try_acquire(&contention.lock, &node),
+        lock_type_name(type));
+    struct lock_node other;
+    TEST_ASSERT_EQUAL_INT_MESSAGE(EBUSY, lock_try_acquire(&contention.lock, &other),
+        lock_type_name(type));
+    lock_release(&contention.lock, &node);
+
+    pthread_barrier_destroy(&contention.start_barrier);
+    lock_destroy(&contention.lock);
+}
+
+/**
+* Every lock type of locks.h must let a single contender at a time in, and lose no increment of
+* a counter updated without atomics, under contention from more threads than there are CPUs here.
+*/
+void test_locks_mutual_exclusion()
+{
+    for (int type = 0; type < LOCK_TYPE_COUNT; type++) {
+        check_mutual_exclusion((enum lock_type)type);
+    }
+}
+
+/**
+* With _GNU_SOURCE defined on glibc, adaptive mutexes are available and not replaced by a default
+* mutex.
+*/
+void test_locks_adaptive_available()
+{
+#ifdef __GLIBC__
+    struct lock lock;
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, lock_init(&lock, LOCK_ADAPTIVE), "adaptive");
+    lock_destroy(&lock);
+#endif
+}
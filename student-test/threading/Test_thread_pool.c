@@ -0,0 +1,113 @@
+#include "unity.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../../examples/threading/threading.h"
+
+#define STRESS_ITERATIONS 500
+#define STRESS_TASKS 8
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static void sleep_ms(int ms)
+{
+    struct timespec duration = {
+        .tv_sec = ms / 1000,
+        .tv_nsec = (ms % 1000) * 1000000l,
+    };
+    nanosleep(&duration, NULL);
+}
+
+/**
+* Starts tasks on a pool, waits for each of them and checks the recorded times follow the
+* requested waits before handing the futures back.
+*/
+void test_thread_pool_submit_wait()
+{
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    struct thread_pool *pool = thread_pool_create(0);
+    TEST_ASSERT_NOT_NULL_MESSAGE(pool, "thread_pool_create failed");
+
+    struct thread_future *futures[STRESS_TASKS];
+    for (int t = 0; t < STRESS_TASKS; t++) {
+        futures[t] = thread_pool_start_obtaining_mutex(pool, &mutex, 5, 5);
+        TEST_ASSERT_NOT_NULL_MESSAGE(futures[t], "thread_pool_start_obtaining_mutex failed");
+    }
+    for (int t = 0; t < STRESS_TASKS; t++) {
+        struct thread_data *data = thread_future_wait(futures[t]);
+        TEST_ASSERT_TRUE_MESSAGE(thread_future_done(futures[t]), "Waited task is not done");
+        TEST_ASSERT_TRUE_MESSAGE(data->thread_complete_success, "Task failed");
+        TEST_ASSERT_TRUE_MESSAGE(data->lock_requested_ns != 0
+            && data->lock_acquired_ns >= data->lock_requested_ns
+            && data->lock_released_ns >= data->lock_acquired_ns + 5 * 1000000ull,
+            "Task times are out of order");
+        TEST_ASSERT_TRUE_MESSAGE(thread_future_release(futures[t]), "Released task failed");
+    }
+
+    thread_pool_destroy(pool);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, pthread_mutex_trylock(&mutex), "Mutex left locked");
+    pthread_mutex_unlock(&mutex);
+    pthread_mutex_destroy(&mutex);
+}
+
+/**
+* Creates and destroys pools back to back, with and without tasks, so a worker missing the stop
+* signal sent while it ran its last tasks hangs thread_pool_destroy() instead of passing.
+*/
+void test_thread_pool_create_destroy_stress()
+{
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    for (int i = 0; i < STRESS_ITERATIONS; i++) {
+        struct thread_pool *pool = thread_pool_create(1 + i % 3);
+        TEST_ASSERT_NOT_NULL_MESSAGE(pool, "thread_pool_create failed");
+
+        int num_tasks = i % (STRESS_TASKS + 1);
+        struct thread_future *futures[STRESS_TASKS];
+        for (int t = 0; t < num_tasks; t++) {
+            futures[t] = thread_pool_start_obtaining_mutex(pool, &mutex, 0, 0);
+            TEST_ASSERT_NOT_NULL_MESSAGE(futures[t], "thread_pool_start_obtaining_mutex failed");
+        }
+        for (int t = 0; t < num_tasks; t++) {
+            TEST_ASSERT_TRUE_MESSAGE(thread_future_release(futures[t]), "Task failed");
+        }
+        thread_pool_destroy(pool);
+    }
+    pthread_mutex_destroy(&mutex);
+}
+
+/**
+* A task whose mutex is held by a thread outside of the pool must still be waiting once its
+* wait to obtain expired, and must get the mutex through its trylock polling once released.
+*/
+void test_thread_pool_blocked_task_times_out()
+{
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    struct thread_pool *pool = thread_pool_create(2);
+    TEST_ASSERT_NOT_NULL_MESSAGE(pool, "thread_pool_create failed");
+
+    pthread_mutex_lock(&mutex);
+    struct thread_future *future = thread_pool_start_obtaining_mutex(pool, &mutex, 10, 10);
+    TEST_ASSERT_NOT_NULL_MESSAGE(future, "thread_pool_start_obtaining_mutex failed");
+    sleep_ms(100);
+    TEST_ASSERT_FALSE_MESSAGE(thread_future_done(future),
+        "Task completed while its mutex was held");
+
+    uint64_t unlocked_ns = monotonic_ns();
+    pthread_mutex_unlock(&mutex);
+    struct thread_data *data = thread_future_wait(future);
+    TEST_ASSERT_TRUE_MESSAGE(data->thread_complete_success, "Task failed");
+    TEST_ASSERT_TRUE_MESSAGE(data->lock_acquired_ns >= unlocked_ns,
+        "Task obtained the mutex before it was released");
+    TEST_ASSERT_TRUE_MESSAGE(data->lock_released_ns - data->lock_acquired_ns >= 10 * 1000000ull,
+        "Task did not hold the mutex for its wait to release");
+
+    thread_future_release(future);
+    thread_pool_destroy(pool);
+    pthread_mutex_destroy(&mutex);
+}